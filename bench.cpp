@@ -0,0 +1,637 @@
+/*
+ * bench.cpp
+ *
+ * Générateur de charge pour le serveur de messagerie.
+ *
+ * Ouvre N utilisateurs simulés (bench0, bench1, ...) répartis sur T
+ * threads, puis envoie un mélange de messages unicast, de broadcasts
+ * et de LIST_USERS à un débit cible, et mesure :
+ *   - le débit réel (opérations envoyées, livraisons reçues)
+ *   - la latence de bout en bout : de l'envoi au MSG: reçu par le
+ *     destinataire (unicast, chaque destinataire d'un broadcast), ou à
+ *     la réponse USERS: (LIST_USERS)
+ *
+ * Boucle ouverte : les envois suivent un calendrier fixe (un envoi
+ * toutes les T / débit secondes par thread) et la latence est mesurée
+ * depuis l'instant PRÉVU de l'envoi. Un serveur qui ralentit retarde
+ * donc les mesures au lieu de ralentir le générateur (pas d'omission
+ * coordonnée). Les sockets sont non bloquants : un envoi qui ne passe
+ * pas attend dans un tampon sans bloquer les réceptions du thread.
+ *
+ * L'instant prévu de l'envoi est écrit dans le corps du message ;
+ * émetteurs et destinataires sont dans le même processus, ce qui
+ * permet d'utiliser une horloge monotone commune.
+ *
+ * Résultats en texte sur la sortie standard et en JSON (--json).
+ *
+ * Linux uniquement (epoll).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "message.h"
+#include "socket_utils.h"
+#include "histogram.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+/* ========================================================================== */
+/*                          CONFIGURATION                                     */
+/* ========================================================================== */
+
+constexpr size_t MAX_BENCH_FRAME_SIZE = 16 * 1024 * 1024;  /* Taille max d'une réponse  */
+constexpr int MAX_BENCH_EVENTS = 256;                       /* Événements par epoll_wait */
+
+/* Types d'opérations générées */
+enum Operation {
+    OP_UNICAST = 0,
+    OP_BROADCAST = 1,
+    OP_LIST_USERS = 2,
+    OP_COUNT = 3
+};
+
+const char* const OPERATION_NAMES[OP_COUNT] = { "unicast", "broadcast", "list_users" };
+
+/*
+ * Options de lancement (forme --nom=valeur) :
+ *   --host=IP            : adresse du serveur (défaut : 127.0.0.1)
+ *   --port=N             : port du serveur (défaut : 8888)
+ *   --users=N            : utilisateurs simulés (défaut : 100)
+ *   --threads=N          : threads du générateur (défaut : 4)
+ *   --rate=N             : opérations par seconde, tous threads (défaut : 1000)
+ *   --duration=S         : durée des envois en secondes (défaut : 10)
+ *   --drain=S            : attente des dernières livraisons (défaut : 2)
+ *   --mix=U:B:L          : poids unicast:broadcast:LIST_USERS (défaut : 80:10:10)
+ *   --wire=1|2           : format des messages, legacy ou compact (défaut : 2)
+ *   --json=FICHIER       : résultats JSON dans un fichier ("-" : sortie standard)
+ */
+struct BenchConfig {
+    std::string host;
+    int port;
+    int users;
+    int threads;
+    double rate;
+    double durationSeconds;
+    double drainSeconds;
+    unsigned mix[OP_COUNT];
+    WireFormat wireFormat;
+    std::string jsonPath;
+};
+
+using Clock = std::chrono::steady_clock;
+
+/* Horloge commune aux émetteurs et aux destinataires (ns) */
+static uint64_t nowNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count());
+}
+
+/*
+ * Utilisateur simulé : connexion non bloquante, tampon de lecture et
+ * tampon d'envoi (ce qui n'a pas pu partir immédiatement).
+ */
+struct BenchUser {
+    std::string name;
+    SOCKET socket;
+    FrameReader reader;
+    std::string outBuffer;          /* Octets en attente d'envoi              */
+    bool watchingOut;               /* EPOLLOUT demandé                       */
+    std::vector<uint64_t> listSent; /* Instants prévus des LIST_USERS en vol  */
+    size_t listNext;                /* Prochaine réponse USERS: attendue      */
+
+    BenchUser() : socket(INVALID_SOCKET), reader(MAX_BENCH_FRAME_SIZE), watchingOut(false), listNext(0) {}
+};
+
+/* Mesures d'un thread (fusionnées à la fin) */
+struct ThreadStats {
+    uint64_t sent[OP_COUNT] = {0, 0, 0};
+    uint64_t delivered[OP_COUNT] = {0, 0, 0};
+    uint64_t errors = 0;            /* ERROR: / NACK: reçus                   */
+    uint64_t maxLagNanos = 0;       /* Retard max d'un envoi sur le calendrier */
+    Histogram latency[OP_COUNT];    /* Latences de bout en bout (ns)          */
+};
+
+BenchConfig g_config;
+std::atomic<int> g_readyThreads(0);             /* Threads connectés           */
+std::atomic<uint64_t> g_startNanos(0);          /* Début des envois (0 : attente) */
+
+/* ========================================================================== */
+/*                          CONNEXION                                         */
+/* ========================================================================== */
+
+/*
+ * Connexion et identification d'un utilisateur simulé (bloquant),
+ * puis passage du socket en non bloquant.
+ */
+void connectUser(BenchUser& user) {
+    user.socket = SocketUtils::createTCPSocket();
+    SocketUtils::connectToServer(user.socket, g_config.host, g_config.port);
+
+    std::string hello = "HELLO:" + std::to_string(static_cast<int>(g_config.wireFormat)) + ":" + user.name;
+    SocketUtils::sendWithLength(user.socket, hello.c_str(), hello.size());
+
+    std::vector<char> buffer(MAX_BENCH_FRAME_SIZE);
+    size_t size = SocketUtils::receiveWithLength(user.socket, buffer.data(), buffer.size());
+    std::string response(buffer.data(), size);
+    if (response.compare(0, 8, "WELCOME:") != 0) {
+        throw std::runtime_error("Identification refusée pour " + user.name + ": " + response);
+    }
+
+    SocketUtils::setNonBlocking(user.socket);
+}
+
+/* ========================================================================== */
+/*                          ENVOIS                                            */
+/* ========================================================================== */
+
+/* Ajout d'une trame [longueur][données] au tampon d'envoi */
+void appendFrame(std::string& out, const std::string& data) {
+    uint32_t netLength = htonl(static_cast<uint32_t>(data.size()));
+    out.append(reinterpret_cast<const char*>(&netLength), sizeof(netLength));
+    out += data;
+}
+
+/*
+ * Envoi non bloquant du tampon ; le reste attend EPOLLOUT.
+ * Retourne false si la connexion est perdue.
+ */
+bool flushUser(int epollFd, BenchUser& user) {
+    while (!user.outBuffer.empty()) {
+        ssize_t sent = send(user.socket, user.outBuffer.data(), user.outBuffer.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+            break;
+        }
+        user.outBuffer.erase(0, static_cast<size_t>(sent));
+    }
+
+    bool wantOut = !user.outBuffer.empty();
+    if (wantOut != user.watchingOut) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = wantOut ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.ptr = &user;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, user.socket, &ev);
+        user.watchingOut = wantOut;
+    }
+    return true;
+}
+
+/*
+ * Prépare une opération de l'utilisateur : "SEND:" suivi du message
+ * (corps = instant prévu), ou "LIST_USERS".
+ */
+void queueOperation(BenchUser& user, Operation op, const std::string& recipient,
+                    uint64_t intendedNanos, ThreadStats& stats) {
+    if (op == OP_LIST_USERS) {
+        appendFrame(user.outBuffer, "LIST_USERS");
+        user.listSent.push_back(intendedNanos);
+    } else {
+        Message msg(user.name, op == OP_BROADCAST ? "all" : recipient, "bench", std::to_string(intendedNanos));
+        std::string payload;
+        msg.encode(g_config.wireFormat, payload);
+        appendFrame(user.outBuffer, "SEND:");
+        appendFrame(user.outBuffer, payload);
+    }
+    stats.sent[op]++;
+}
+
+/* ========================================================================== */
+/*                          RÉCEPTIONS                                        */
+/* ========================================================================== */
+
+/*
+ * Traite une trame reçue : MSG: (livraison, latence depuis l'instant
+ * prévu inscrit dans le corps), USERS: (réponse à la plus ancienne
+ * LIST_USERS en vol), ERROR:/NACK: (comptées). Les acquittements et
+ * notifications sont ignorés.
+ */
+void handleFrame(BenchUser& user, const char* data, size_t size, ThreadStats& stats) {
+    uint64_t now = nowNanos();
+
+    if (size >= 4 && memcmp(data, "MSG:", 4) == 0) {
+        Message msg;
+        try {
+            Message::decodeInto(g_config.wireFormat, data + 4, size - 4, msg);
+        } catch (const std::runtime_error&) {
+            stats.errors++;
+            return;
+        }
+        if (strcmp(msg.subject, "bench") != 0) {
+            return;
+        }
+        uint64_t intended = std::strtoull(msg.body, nullptr, 10);
+        Operation op = (strcmp(msg.to, "all") == 0) ? OP_BROADCAST : OP_UNICAST;
+        stats.delivered[op]++;
+        stats.latency[op].record(now > intended ? now - intended : 0);
+
+    } else if (size >= 6 && memcmp(data, "USERS:", 6) == 0) {
+        if (user.listNext < user.listSent.size()) {
+            uint64_t intended = user.listSent[user.listNext++];
+            stats.delivered[OP_LIST_USERS]++;
+            stats.latency[OP_LIST_USERS].record(now > intended ? now - intended : 0);
+        }
+
+    } else if ((size >= 6 && memcmp(data, "ERROR:", 6) == 0) || (size >= 5 && memcmp(data, "NACK:", 5) == 0)) {
+        stats.errors++;
+    }
+}
+
+/*
+ * Lit ce qui est disponible et traite les trames complètes.
+ * Retourne false si la connexion est perdue.
+ */
+bool readUser(BenchUser& user, ThreadStats& stats) {
+    while (true) {
+        FrameReader::Status status = user.reader.fill(user.socket);
+        if (status == FrameReader::Status::WouldBlock) {
+            return true;
+        }
+        if (status != FrameReader::Status::Ok) {
+            return false;
+        }
+
+        const char* data;
+        size_t size;
+        while (user.reader.nextFrame(data, size)) {
+            handleFrame(user, data, size, stats);
+        }
+    }
+}
+
+/* ========================================================================== */
+/*                          THREAD DU GÉNÉRATEUR                              */
+/* ========================================================================== */
+
+/*
+ * Un thread : connecte ses utilisateurs (les numéros i tels que
+ * i % threads == index), attend les autres threads, puis alterne
+ * envois selon le calendrier et réceptions jusqu'à la fin du drain.
+ */
+void benchThread(int index, ThreadStats& stats) {
+    std::vector<std::unique_ptr<BenchUser>> users;
+    for (int i = index; i < g_config.users; i += g_config.threads) {
+        auto user = std::make_unique<BenchUser>();
+        user->name = "bench" + std::to_string(i);
+        connectUser(*user);
+        users.push_back(std::move(user));
+    }
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        throw std::runtime_error("Échec de epoll_create1: " + std::string(strerror(errno)));
+    }
+    for (auto& user : users) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = user.get();
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, user->socket, &ev);
+    }
+
+    /* Départ commun, fixé par le premier thread qui voit tout le monde connecté */
+    g_readyThreads++;
+    while (g_startNanos.load() == 0) {
+        if (g_readyThreads.load() >= g_config.threads) {
+            uint64_t unset = 0;
+            g_startNanos.compare_exchange_strong(unset, nowNanos() + 100 * 1000 * 1000);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint64_t start = g_startNanos.load();
+    uint64_t sendEnd = start + static_cast<uint64_t>(g_config.durationSeconds * 1e9);
+    uint64_t drainEnd = sendEnd + static_cast<uint64_t>(g_config.drainSeconds * 1e9);
+    double threadRate = g_config.rate / g_config.threads;
+    uint64_t interval = threadRate > 0 ? static_cast<uint64_t>(1e9 / threadRate) : UINT64_MAX;
+    uint64_t next = start + interval * static_cast<uint64_t>(index) / static_cast<uint64_t>(g_config.threads);
+
+    std::mt19937_64 random(static_cast<uint64_t>(index) * 7919 + 1);
+    unsigned mixTotal = g_config.mix[OP_UNICAST] + g_config.mix[OP_BROADCAST] + g_config.mix[OP_LIST_USERS];
+    struct epoll_event events[MAX_BENCH_EVENTS];
+
+    while (true) {
+        uint64_t now = nowNanos();
+        if (now >= drainEnd) {
+            break;
+        }
+
+        /* Envois en retard sur le calendrier (tous, pour rattraper) */
+        while (next < sendEnd && next <= now && !users.empty()) {
+            BenchUser& user = *users[random() % users.size()];
+            unsigned draw = static_cast<unsigned>(random() % mixTotal);
+            Operation op = draw < g_config.mix[OP_UNICAST] ? OP_UNICAST
+                         : draw < g_config.mix[OP_UNICAST] + g_config.mix[OP_BROADCAST] ? OP_BROADCAST
+                         : OP_LIST_USERS;
+
+            /* Destinataire tiré parmi tous les utilisateurs, sauf l'émetteur */
+            std::string recipient;
+            if (g_config.users > 1) {
+                do {
+                    recipient = "bench" + std::to_string(random() % static_cast<uint64_t>(g_config.users));
+                } while (recipient == user.name);
+            } else {
+                recipient = user.name;
+            }
+
+            queueOperation(user, op, recipient, next, stats);
+            if (!flushUser(epollFd, user)) {
+                throw std::runtime_error("Connexion perdue: " + user.name);
+            }
+
+            if (now - next > stats.maxLagNanos) {
+                stats.maxLagNanos = now - next;
+            }
+            next += interval;
+        }
+
+        /* Attente jusqu'au prochain envoi prévu (ou la fin du drain) */
+        uint64_t wakeAt = (next < sendEnd) ? next : drainEnd;
+        now = nowNanos();
+        int timeoutMs = wakeAt > now ? static_cast<int>((wakeAt - now) / 1000000) : 0;
+
+        int count = epoll_wait(epollFd, events, MAX_BENCH_EVENTS, timeoutMs);
+        if (count < 0 && errno != EINTR) {
+            throw std::runtime_error("Échec de epoll_wait: " + std::string(strerror(errno)));
+        }
+        for (int i = 0; i < count; ++i) {
+            BenchUser& user = *static_cast<BenchUser*>(events[i].data.ptr);
+            bool open = true;
+            if (events[i].events & EPOLLOUT) {
+                open = flushUser(epollFd, user);
+            }
+            if (open && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                open = readUser(user, stats);
+            }
+            if (!open) {
+                throw std::runtime_error("Connexion perdue: " + user.name);
+            }
+        }
+    }
+
+    for (auto& user : users) {
+        SocketUtils::closeSocket(user->socket);
+    }
+    close(epollFd);
+}
+
+/* ========================================================================== */
+/*                          RAPPORT                                           */
+/* ========================================================================== */
+
+/* Latence en microsecondes (une décimale) */
+static std::string micros(uint64_t nanos) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << static_cast<double>(nanos) / 1000.0;
+    return out.str();
+}
+
+/*
+ * Rapport texte et JSON à partir des mesures fusionnées.
+ * Livraisons attendues : une par unicast, users - 1 par broadcast
+ * (l'émetteur est exclu), une réponse par LIST_USERS.
+ */
+void report(const ThreadStats& total) {
+    uint64_t expected[OP_COUNT] = {
+        total.sent[OP_UNICAST],
+        total.sent[OP_BROADCAST] * static_cast<uint64_t>(g_config.users - 1),
+        total.sent[OP_LIST_USERS]
+    };
+    uint64_t sentTotal = total.sent[OP_UNICAST] + total.sent[OP_BROADCAST] + total.sent[OP_LIST_USERS];
+    uint64_t deliveredTotal = total.delivered[OP_UNICAST] + total.delivered[OP_BROADCAST]
+                              + total.delivered[OP_LIST_USERS];
+    double duration = g_config.durationSeconds;
+
+    std::cout << "=== Banc de charge ===" << std::endl;
+    std::cout << "Serveur            : " << g_config.host << ":" << g_config.port << std::endl;
+    std::cout << "Utilisateurs       : " << g_config.users << " (" << g_config.threads << " thread(s))" << std::endl;
+    std::cout << "Débit visé         : " << g_config.rate << " op/s pendant " << duration << " s, mix "
+              << g_config.mix[OP_UNICAST] << ":" << g_config.mix[OP_BROADCAST] << ":" << g_config.mix[OP_LIST_USERS]
+              << std::endl;
+    std::cout << "Opérations envoyées: " << sentTotal << " (" << std::fixed << std::setprecision(1)
+              << sentTotal / duration << " op/s)" << std::endl;
+    std::cout << "Livraisons reçues  : " << deliveredTotal << " (" << deliveredTotal / duration << " /s)" << std::endl;
+    std::cout << "Erreurs            : " << total.errors << std::endl;
+    std::cout << "Retard max émetteur: " << micros(total.maxLagNanos) << " µs" << std::endl;
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(13) << "Latence (µs)" << std::right
+              << std::setw(10) << "envoyés" << std::setw(12) << "reçus" << std::setw(10) << "perdus"
+              << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+              << std::setw(10) << "max" << std::endl;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        const Histogram& h = total.latency[op];
+        uint64_t missing = expected[op] > total.delivered[op] ? expected[op] - total.delivered[op] : 0;
+        std::cout << std::left << std::setw(12) << OPERATION_NAMES[op] << std::right
+                  << std::setw(10) << total.sent[op] << std::setw(12) << total.delivered[op]
+                  << std::setw(10) << missing
+                  << std::setw(10) << micros(h.percentile(50)) << std::setw(10) << micros(h.percentile(99))
+                  << std::setw(10) << micros(h.percentile(99.9)) << std::setw(10) << micros(h.max()) << std::endl;
+    }
+
+    if (g_config.jsonPath.empty()) {
+        return;
+    }
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(1);
+    json << "{\n";
+    json << "  \"config\": {\"host\": \"" << g_config.host << "\", \"port\": " << g_config.port
+         << ", \"users\": " << g_config.users << ", \"threads\": " << g_config.threads
+         << ", \"rate\": " << g_config.rate << ", \"duration_s\": " << duration
+         << ", \"mix\": [" << g_config.mix[OP_UNICAST] << ", " << g_config.mix[OP_BROADCAST] << ", "
+         << g_config.mix[OP_LIST_USERS] << "], \"wire\": " << static_cast<int>(g_config.wireFormat) << "},\n";
+    json << "  \"sent\": " << sentTotal << ",\n";
+    json << "  \"delivered\": " << deliveredTotal << ",\n";
+    json << "  \"errors\": " << total.errors << ",\n";
+    json << "  \"throughput_ops_per_s\": " << sentTotal / duration << ",\n";
+    json << "  \"throughput_deliveries_per_s\": " << deliveredTotal / duration << ",\n";
+    json << "  \"max_sender_lag_us\": " << micros(total.maxLagNanos) << ",\n";
+    json << "  \"operations\": {\n";
+    for (int op = 0; op < OP_COUNT; ++op) {
+        const Histogram& h = total.latency[op];
+        json << "    \"" << OPERATION_NAMES[op] << "\": {\"sent\": " << total.sent[op]
+             << ", \"delivered\": " << total.delivered[op] << ", \"expected\": " << expected[op]
+             << ", \"latency_us\": {\"p50\": " << micros(h.percentile(50))
+             << ", \"p99\": " << micros(h.percentile(99))
+             << ", \"p99_9\": " << micros(h.percentile(99.9))
+             << ", \"max\": " << micros(h.max()) << "}}"
+             << (op + 1 < OP_COUNT ? "," : "") << "\n";
+    }
+    json << "  }\n";
+    json << "}\n";
+
+    if (g_config.jsonPath == "-") {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(g_config.jsonPath);
+        if (!file) {
+            throw std::runtime_error("Impossible d'écrire " + g_config.jsonPath);
+        }
+        file << json.str();
+    }
+}
+
+/* ========================================================================== */
+/*                          ARGUMENTS                                         */
+/* ========================================================================== */
+
+BenchConfig parseArguments(int argc, char* argv[]) {
+    BenchConfig config;
+    config.host = "127.0.0.1";
+    config.port = 8888;
+    config.users = 100;
+    config.threads = 4;
+    config.rate = 1000;
+    config.durationSeconds = 10;
+    config.drainSeconds = 2;
+    config.mix[OP_UNICAST] = 80;
+    config.mix[OP_BROADCAST] = 10;
+    config.mix[OP_LIST_USERS] = 10;
+    config.wireFormat = WireFormat::Compact;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t separator = arg.find('=');
+        std::string name = arg.substr(0, separator);
+        std::string value = (separator == std::string::npos) ? "" : arg.substr(separator + 1);
+
+        if (name == "--host") {
+            config.host = value;
+        } else if (name == "--port") {
+            config.port = std::stoi(value);
+            if (config.port < 1 || config.port > 65535) {
+                throw std::invalid_argument("--port doit être entre 1 et 65535");
+            }
+        } else if (name == "--users") {
+            config.users = std::stoi(value);
+            if (config.users < 1) {
+                throw std::invalid_argument("--users doit être >= 1");
+            }
+        } else if (name == "--threads") {
+            config.threads = std::stoi(value);
+            if (config.threads < 1) {
+                throw std::invalid_argument("--threads doit être >= 1");
+            }
+        } else if (name == "--rate") {
+            config.rate = std::stod(value);
+            if (config.rate < 0) {
+                throw std::invalid_argument("--rate doit être >= 0");
+            }
+        } else if (name == "--duration") {
+            config.durationSeconds = std::stod(value);
+            if (config.durationSeconds <= 0) {
+                throw std::invalid_argument("--duration doit être > 0");
+            }
+        } else if (name == "--drain") {
+            config.drainSeconds = std::stod(value);
+            if (config.drainSeconds < 0) {
+                throw std::invalid_argument("--drain doit être >= 0");
+            }
+        } else if (name == "--mix") {
+            std::istringstream parts(value);
+            std::string part;
+            int index = 0;
+            while (std::getline(parts, part, ':')) {
+                if (index >= OP_COUNT) {
+                    throw std::invalid_argument("--mix attend trois poids U:B:L");
+                }
+                config.mix[index++] = static_cast<unsigned>(std::stoul(part));
+            }
+            if (index != OP_COUNT || config.mix[0] + config.mix[1] + config.mix[2] == 0) {
+                throw std::invalid_argument("--mix attend trois poids U:B:L non tous nuls");
+            }
+        } else if (name == "--wire") {
+            if (value != "1" && value != "2") {
+                throw std::invalid_argument("--wire doit valoir 1 (legacy) ou 2 (compact)");
+            }
+            config.wireFormat = static_cast<WireFormat>(std::stoi(value));
+        } else if (name == "--json") {
+            config.jsonPath = value;
+        } else {
+            throw std::invalid_argument("Option inconnue: " + arg);
+        }
+    }
+
+    if (config.threads > config.users) {
+        config.threads = config.users;
+    }
+    return config;
+}
+
+/* ========================================================================== */
+/*                          PROGRAMME PRINCIPAL                               */
+/* ========================================================================== */
+
+int main(int argc, char* argv[]) {
+    try {
+        g_config = parseArguments(argc, argv);
+        signal(SIGPIPE, SIG_IGN);
+        SocketUtils::initializeWinsock();
+
+        std::vector<std::unique_ptr<ThreadStats>> stats;
+        std::vector<std::thread> threads;
+        std::vector<std::string> failures(g_config.threads);
+        for (int i = 0; i < g_config.threads; ++i) {
+            stats.push_back(std::make_unique<ThreadStats>());
+        }
+        for (int i = 0; i < g_config.threads; ++i) {
+            threads.emplace_back([i, &stats, &failures] {
+                try {
+                    benchThread(i, *stats[i]);
+                } catch (const std::exception& e) {
+                    failures[i] = e.what();
+                    g_readyThreads++;   /* Ne pas bloquer le départ des autres threads */
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        for (const std::string& failure : failures) {
+            if (!failure.empty()) {
+                std::cerr << "Erreur: " << failure << std::endl;
+                return 1;
+            }
+        }
+
+        ThreadStats total;
+        for (const auto& threadStats : stats) {
+            for (int op = 0; op < OP_COUNT; ++op) {
+                total.sent[op] += threadStats->sent[op];
+                total.delivered[op] += threadStats->delivered[op];
+                total.latency[op].merge(threadStats->latency[op]);
+            }
+            total.errors += threadStats->errors;
+            total.maxLagNanos = std::max(total.maxLagNanos, threadStats->maxLagNanos);
+        }
+        report(total);
+
+        SocketUtils::cleanupWinsock();
+
+    } catch (const std::exception& e) {
+        std::cerr << "Erreur: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -26,6 +26,11 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <map>
+#include <cstdlib>
+
+constexpr size_t MAX_SERVER_FRAME_SIZE = 16 * 1024 * 1024;  /* Taille max d'une réponse */
+constexpr int MAX_REDIRECTS = 3;                            /* Redirections suivies    */
 
 /* ========================================================================== */
 /*                      VARIABLES GLOBALES                                    */
@@ -37,12 +42,17 @@ std::atomic<bool> g_isComposing(false);       /* Flag : composition en cours
 std::atomic<bool> g_clientRunning(true);      /* Flag : client actif            */
 SOCKET g_serverSocket = INVALID_SOCKET;       /* Socket de connexion au serveur */
 std::string g_username;                       /* Nom de l'utilisateur           */
+WireFormat g_wireFormat = WireFormat::Legacy; /* Format négocié avec le serveur */
+std::map<uint64_t, std::string> g_pendingSends; /* Envois non acquittés (id → dest.) */
+std::mutex g_pendingMutex;                    /* Protection des envois en vol   */
+uint64_t g_nextSendId = 1;                    /* Prochain identifiant d'envoi   */
 
 /* ========================================================================== */
 /*                      PROTOTYPES DE FONCTIONS                               */
 /* ========================================================================== */
 
 void listenThread();
+void handleServerFrame(const char* data, size_t size);
 void displayMenu();
 void listMessages();
 void readMessage();
@@ -50,26 +60,208 @@ void markAsRead();
 void listOnlineUsers();
 void composeMessage();
 void requestServerLog();
+void requestHistory();
+void requestStats();
 void disconnect();
 void clearInputBuffer();
+bool login(std::string& serverIP, int& port);
 
 /* ========================================================================== */
 /*                       THREAD D'ÉCOUTE                                      */
 /* ========================================================================== */
 
 /*
- * Thread de réception des messages du serveur.
+ * Traitement d'une trame reçue du serveur.
  * 
- * Tourne en arrière-plan et traite les différents types de réponses :
+ * Types de réponses :
  *   - MSG:    Nouveau message reçu
+ *   - MSG_BATCH: Messages reçus pendant l'absence (plusieurs par trame)
  *   - NOTIFY: Notification (ex: échec de livraison)
  *   - OK:     Confirmation d'opération
+ *   - ACK:, NACK: Acquittement des envois, par identifiant
  *   - ERROR:  Erreur
  *   - USERS:  Liste des utilisateurs
- *   - LOG:    Contenu du fichier log
+ *   - LOG_BEGIN:, LOG:, LOG_END: Fichier log, envoyé par portions
+ *   - HIST:, HIST_END: Page de l'historique des messages
+ *   - STATS:  Métriques du serveur (une ligne par métrique)
+ */
+void handleServerFrame(const char* data, size_t size) {
+    std::string response(data, size);
+    
+    /* Traitement selon le type de réponse */
+    if (response.substr(0, 10) == "MSG_BATCH:") {
+        /* Lot de messages : [varint nombre]([varint taille][message])... */
+        const char* cursor = data + 10;
+        const char* end = data + size;
+        uint64_t count;
+        if (!readVarint(cursor, end, count)) {
+            throw std::runtime_error("Lot de messages mal formé");
+        }
+        
+        std::vector<Message> batch;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t length;
+            if (!readVarint(cursor, end, length) || length > static_cast<uint64_t>(end - cursor)) {
+                throw std::runtime_error("Lot de messages tronqué");
+            }
+            batch.push_back(Message::decode(g_wireFormat, cursor, length));
+            cursor += length;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(g_messagesMutex);
+            g_receivedMessages.insert(g_receivedMessages.end(), batch.begin(), batch.end());
+        }
+        
+        if (!g_isComposing) {
+            std::cout << "\n[MESSAGES EN ATTENTE] " << batch.size() << " message(s) reçu(s) pendant votre absence" << std::endl;
+            std::cout << "Tapez votre commande: ";
+            std::cout.flush();
+        }
+        
+    } else if (response.substr(0, 4) == "MSG:") {
+        /* Nouveau message */
+        if (size > 4) {
+            Message msg = Message::decode(g_wireFormat, data + 4, size - 4);
+            
+            {
+                std::lock_guard<std::mutex> lock(g_messagesMutex);
+                g_receivedMessages.push_back(msg);
+            }
+            
+            /* Notification si pas en mode composition */
+            if (!g_isComposing) {
+                std::cout << "\n[NOUVEAU MESSAGE] De: " << msg.from 
+                          << " | Sujet: " << msg.subject << std::endl;
+                std::cout << "Tapez votre commande: ";
+                std::cout.flush();
+            }
+        }
+        
+    } else if (response.substr(0, 7) == "NOTIFY:") {
+        /* Notification du serveur */
+        if (!g_isComposing) {
+            std::cout << "\n[NOTIFICATION] " << response.substr(7) << std::endl;
+            std::cout << "Tapez votre commande: ";
+            std::cout.flush();
+        }
+        
+    } else if (response.substr(0, 3) == "OK:") {
+        /* Confirmation */
+        if (!g_isComposing) {
+            std::cout << "\n[SERVEUR] " << response.substr(3) << std::endl;
+            std::cout << "Tapez votre commande: ";
+            std::cout.flush();
+        }
+        
+    } else if (response.substr(0, 4) == "ACK:") {
+        /* Acquittement : identifiants des messages acceptés, séparés par des virgules */
+        std::string recipients;
+        {
+            std::lock_guard<std::mutex> lock(g_pendingMutex);
+            std::istringstream ids(response.substr(4));
+            std::string id;
+            while (std::getline(ids, id, ',')) {
+                auto it = g_pendingSends.find(std::strtoull(id.c_str(), nullptr, 10));
+                if (it != g_pendingSends.end()) {
+                    recipients += (recipients.empty() ? "" : ", ") + it->second;
+                    g_pendingSends.erase(it);
+                }
+            }
+        }
+        if (!g_isComposing && !recipients.empty()) {
+            std::cout << "\n[SERVEUR] Message(s) en file d'attente pour: " << recipients << std::endl;
+            std::cout << "Tapez votre commande: ";
+            std::cout.flush();
+        }
+        
+    } else if (response.substr(0, 5) == "NACK:") {
+        /* Refus d'un message : NACK:<id>:<raison> */
+        size_t colon = response.find(':', 5);
+        uint64_t id = std::strtoull(response.c_str() + 5, nullptr, 10);
+        std::string recipient;
+        {
+            std::lock_guard<std::mutex> lock(g_pendingMutex);
+            auto it = g_pendingSends.find(id);
+            if (it != g_pendingSends.end()) {
+                recipient = it->second;
+                g_pendingSends.erase(it);
+            }
+        }
+        if (!g_isComposing) {
+            std::cout << "\n[ERREUR] Message pour '" << recipient << "' refusé: "
+                      << (colon == std::string::npos ? "" : response.substr(colon + 1)) << std::endl;
+            std::cout << "Tapez votre commande: ";
+            std::cout.flush();
+        }
+        
+    } else if (response.substr(0, 6) == "ERROR:") {
+        /* Erreur */
+        if (!g_isComposing) {
+            std::cout << "\n[ERREUR] " << response.substr(6) << std::endl;
+            std::cout << "Tapez votre commande: ";
+            std::cout.flush();
+        }
+        
+    } else if (response.substr(0, 6) == "USERS:") {
+        /* Liste des utilisateurs */
+        std::string userList = response.substr(6);
+        std::cout << "\n=== UTILISATEURS EN LIGNE ===" << std::endl;
+        
+        std::stringstream ss(userList);
+        std::string user;
+        int count = 0;
+        while (std::getline(ss, user, ';')) {
+            if (!user.empty()) {
+                std::cout << "- " << user << std::endl;
+                count++;
+            }
+        }
+        std::cout << "Total: " << count << " utilisateur(s)" << std::endl;
+        std::cout << "=============================" << std::endl;
+        
+    } else if (response.substr(0, 6) == "STATS:") {
+        /* Métriques du serveur, déjà mises en forme ligne par ligne */
+        std::cout << "\n=== STATISTIQUES DU SERVEUR ===" << std::endl;
+        std::cout << response.substr(6) << std::endl;
+        std::cout << "===============================" << std::endl;
+        
+    } else if (response.substr(0, 5) == "HIST:") {
+        /* Message de l'historique : HIST:<n°>:<message encodé> */
+        size_t separator = response.find(':', 5);
+        if (separator != std::string::npos) {
+            Message msg = Message::decode(g_wireFormat, data + separator + 1, size - separator - 1);
+            std::cout << "#" << response.substr(5, separator - 5) << " De: " << msg.from
+                      << " | À: " << msg.to << " | Sujet: " << msg.subject << std::endl;
+        }
+        
+    } else if (response.substr(0, 9) == "HIST_END:") {
+        /* Fin de page : numéro à partir duquel demander la suite */
+        std::cout << "=== Suite de l'historique : à partir du n°" << response.substr(9) << " ===" << std::endl;
+        
+    } else if (response.substr(0, 10) == "LOG_BEGIN:") {
+        /* Début du fichier log (taille annoncée) */
+        std::cout << "\n=== FICHIER LOG DU SERVEUR (" << response.substr(10) << " octets) ===" << std::endl;
+        
+    } else if (response.substr(0, 4) == "LOG:") {
+        /* Portion du fichier log, affichée dès réception */
+        std::cout.write(data + 4, static_cast<std::streamsize>(size - 4));
+        
+    } else if (response.substr(0, 8) == "LOG_END:") {
+        /* Fin du fichier log */
+        std::cout << "===============================" << std::endl;
+    }
+}
+
+/*
+ * Thread de réception des messages du serveur.
+ * 
+ * Tourne en arrière-plan. Les trames sont découpées par un FrameReader :
+ * un seul recv() peut ramener plusieurs trames, et une trame n'est plus
+ * limitée à la taille d'un tampon fixe.
  */
 void listenThread() {
-    char buffer[sizeof(Message) + 100];
+    FrameReader reader(MAX_SERVER_FRAME_SIZE);
     
     while (g_clientRunning) {
         try {
@@ -78,9 +270,8 @@ void listenThread() {
                 continue;
             }
             
-            /* Réception avec protocole à préfixe de longueur */
-            size_t received = SocketUtils::receiveWithLength(g_serverSocket, buffer, sizeof(buffer) - 1);
-            if (received == 0) {
+            FrameReader::Status status = reader.fill(g_serverSocket);
+            if (status == FrameReader::Status::Closed || status == FrameReader::Status::Error) {
                 if (g_clientRunning) {
                     std::cout << "\n[SYSTÈME] Connexion au serveur perdue" << std::endl;
                     g_clientRunning = false;
@@ -88,76 +279,10 @@ void listenThread() {
                 break;
             }
             
-            buffer[received] = '\0';
-            std::string response(buffer, received);
-            
-            /* Traitement selon le type de réponse */
-            if (response.substr(0, 4) == "MSG:") {
-                /* Nouveau message */
-                if (received > 4) {
-                    Message msg = Message::deserialize(buffer + 4, received - 4);
-                    
-                    {
-                        std::lock_guard<std::mutex> lock(g_messagesMutex);
-                        g_receivedMessages.push_back(msg);
-                    }
-                    
-                    /* Notification si pas en mode composition */
-                    if (!g_isComposing) {
-                        std::cout << "\n[NOUVEAU MESSAGE] De: " << msg.from 
-                                  << " | Sujet: " << msg.subject << std::endl;
-                        std::cout << "Tapez votre commande: ";
-                        std::cout.flush();
-                    }
-                }
-                
-            } else if (response.substr(0, 7) == "NOTIFY:") {
-                /* Notification du serveur */
-                if (!g_isComposing) {
-                    std::cout << "\n[NOTIFICATION] " << response.substr(7) << std::endl;
-                    std::cout << "Tapez votre commande: ";
-                    std::cout.flush();
-                }
-                
-            } else if (response.substr(0, 3) == "OK:") {
-                /* Confirmation */
-                if (!g_isComposing) {
-                    std::cout << "\n[SERVEUR] " << response.substr(3) << std::endl;
-                    std::cout << "Tapez votre commande: ";
-                    std::cout.flush();
-                }
-                
-            } else if (response.substr(0, 6) == "ERROR:") {
-                /* Erreur */
-                if (!g_isComposing) {
-                    std::cout << "\n[ERREUR] " << response.substr(6) << std::endl;
-                    std::cout << "Tapez votre commande: ";
-                    std::cout.flush();
-                }
-                
-            } else if (response.substr(0, 6) == "USERS:") {
-                /* Liste des utilisateurs */
-                std::string userList = response.substr(6);
-                std::cout << "\n=== UTILISATEURS EN LIGNE ===" << std::endl;
-                
-                std::stringstream ss(userList);
-                std::string user;
-                int count = 0;
-                while (std::getline(ss, user, ';')) {
-                    if (!user.empty()) {
-                        std::cout << "- " << user << std::endl;
-                        count++;
-                    }
-                }
-                std::cout << "Total: " << count << " utilisateur(s)" << std::endl;
-                std::cout << "=============================" << std::endl;
-                
-            } else if (response.substr(0, 4) == "LOG:") {
-                /* Contenu du fichier log */
-                std::string logContent = response.substr(4);
-                std::cout << "\n=== FICHIER LOG DU SERVEUR ===" << std::endl;
-                std::cout << logContent << std::endl;
-                std::cout << "===============================" << std::endl;
+            const char* data;
+            size_t size;
+            while (reader.nextFrame(data, size)) {
+                handleServerFrame(data, size);
             }
             
         } catch (const std::exception& e) {
@@ -186,6 +311,8 @@ void displayMenu() {
     std::cout << "║ 5. Lister les utilisateurs en ligne    ║" << std::endl;
     std::cout << "║ 6. Récupérer le log du serveur         ║" << std::endl;
     std::cout << "║ 7. Se déconnecter                      ║" << std::endl;
+    std::cout << "║ 8. Historique des messages             ║" << std::endl;
+    std::cout << "║ 9. Statistiques du serveur             ║" << std::endl;
     std::cout << "╚════════════════════════════════════════╝" << std::endl;
 }
 
@@ -318,7 +445,7 @@ void composeMessage() {
     
     std::string to, subject, body;
     
-    std::cout << "Destinataire (ou 'all' pour broadcast): ";
+    std::cout << "Destinataire(s), séparés par des virgules (ou 'all' pour broadcast): ";
     std::getline(std::cin, to);
     
     std::cout << "Sujet (max " << MAX_SUBJECT_SIZE - 1 << " caractères): ";
@@ -328,20 +455,53 @@ void composeMessage() {
     std::getline(std::cin, body);
     
     try {
-        /* Construction du message */
-        Message msg(g_username, to, subject, body);
+        /*
+         * Un message par destinataire, tous envoyés dans une seule trame :
+         *   SEND_BATCH:[varint nombre]([varint id][varint taille][message])...
+         * Chaque message porte un identifiant renvoyé dans l'acquittement
+         * (ACK:/NACK:), ce qui permet d'en garder plusieurs en vol.
+         */
+        std::string frame = "SEND_BATCH:";
+        std::string entries;
+        std::vector<std::pair<uint64_t, std::string>> sent;
+        std::istringstream recipients(to);
+        std::string recipient;
         
-        /* Envoi de la commande SEND: */
-        std::string command = "SEND:";
-        SocketUtils::sendWithLength(g_serverSocket, command.c_str(), command.length());
+        while (std::getline(recipients, recipient, ',')) {
+            recipient.erase(0, recipient.find_first_not_of(' '));
+            recipient.erase(recipient.find_last_not_of(' ') + 1);
+            if (recipient.empty()) {
+                continue;
+            }
+            if (sent.size() == SEND_BATCH_MAX) {
+                throw std::invalid_argument("Trop de destinataires (max " + std::to_string(SEND_BATCH_MAX) + ")");
+            }
+            
+            Message msg(g_username, recipient, subject, body);
+            std::string payload;
+            msg.encode(g_wireFormat, payload);
+            
+            uint64_t id = g_nextSendId++;
+            appendVarint(entries, id);
+            appendVarint(entries, payload.size());
+            entries += payload;
+            sent.emplace_back(id, recipient);
+        }
         
-        /* Envoi du message sérialisé */
-        char buffer[sizeof(Message)];
-        size_t size;
-        msg.serialize(buffer, size);
-        SocketUtils::sendWithLength(g_serverSocket, buffer, size);
+        if (sent.empty()) {
+            throw std::invalid_argument("Aucun destinataire");
+        }
         
-        std::cout << "Message envoyé (sera livré dans max 30s)." << std::endl;
+        appendVarint(frame, sent.size());
+        frame += entries;
+        
+        {
+            std::lock_guard<std::mutex> lock(g_pendingMutex);
+            g_pendingSends.insert(sent.begin(), sent.end());
+        }
+        SocketUtils::sendWithLength(g_serverSocket, frame.data(), frame.size());
+        
+        std::cout << sent.size() << " message(s) envoyé(s)." << std::endl;
         
     } catch (const std::exception& e) {
         std::cout << "Erreur: " << e.what() << std::endl;
@@ -351,11 +511,48 @@ void composeMessage() {
 }
 
 /*
- * Demande le téléchargement du fichier de log du serveur.
+ * Demande le téléchargement du fichier de log du serveur
+ * (complet, ou seulement les dernières lignes).
  */
 void requestServerLog() {
+    std::cout << "Nombre de dernières lignes (vide = fichier complet): ";
+    std::string lines;
+    std::getline(std::cin, lines);
+    
     try {
         std::string command = "GET_LOG";
+        if (!lines.empty()) {
+            command += ":TAIL:" + lines;
+        }
+        SocketUtils::sendWithLength(g_serverSocket, command.c_str(), command.length());
+    } catch (const std::exception& e) {
+        std::cout << "Erreur lors de la demande: " << e.what() << std::endl;
+    }
+}
+
+/*
+ * Demande une page de l'historique des messages au serveur.
+ */
+void requestHistory() {
+    std::cout << "À partir du message n° (vide = le plus ancien): ";
+    std::string from;
+    std::getline(std::cin, from);
+    
+    try {
+        std::string command = "GET_HISTORY:" + (from.empty() ? std::string("0") : from) + ":20";
+        std::cout << "\n=== HISTORIQUE DES MESSAGES ===" << std::endl;
+        SocketUtils::sendWithLength(g_serverSocket, command.c_str(), command.length());
+    } catch (const std::exception& e) {
+        std::cout << "Erreur lors de la demande: " << e.what() << std::endl;
+    }
+}
+
+/*
+ * Demande les métriques du serveur (compteurs, latences).
+ */
+void requestStats() {
+    try {
+        std::string command = "STATS";
         SocketUtils::sendWithLength(g_serverSocket, command.c_str(), command.length());
     } catch (const std::exception& e) {
         std::cout << "Erreur lors de la demande: " << e.what() << std::endl;
@@ -377,6 +574,48 @@ void disconnect() {
     std::cout << "\nDéconnexion..." << std::endl;
 }
 
+/*
+ * Identification auprès du serveur et négociation du format de message.
+ * 
+ * Envoie "HELLO:<version>:<nom>" et attend "WELCOME:<version>" : le
+ * serveur retient la version la plus récente connue des deux côtés.
+ * Lève une exception si le serveur refuse (nom déjà pris, ...).
+ * 
+ * Un nœud de grappe qui n'est pas celui de l'utilisateur répond
+ * "REDIRECT:<ip>:<port>" puis ferme la connexion : serverIP et port
+ * reçoivent alors la nouvelle adresse et la fonction retourne false.
+ */
+bool login(std::string& serverIP, int& port) {
+    std::string hello = "HELLO:" + std::to_string(static_cast<int>(WireFormat::Compact)) + ":" + g_username;
+    SocketUtils::sendWithLength(g_serverSocket, hello.c_str(), hello.length());
+    
+    if (!SocketUtils::hasData(g_serverSocket, 5000)) {
+        throw std::runtime_error("Pas de réponse du serveur à l'identification");
+    }
+    
+    char buffer[256];
+    size_t received = SocketUtils::receiveWithLength(g_serverSocket, buffer, sizeof(buffer) - 1);
+    std::string response(buffer, received);
+    
+    if (response.substr(0, 8) == "WELCOME:") {
+        int version = std::atoi(response.substr(8).c_str());
+        g_wireFormat = (version >= static_cast<int>(WireFormat::Compact)) ? WireFormat::Compact : WireFormat::Legacy;
+        return true;
+    } else if (response.substr(0, 9) == "REDIRECT:") {
+        size_t separator = response.rfind(':');
+        if (separator <= 9) {
+            throw std::runtime_error("Redirection mal formée: " + response);
+        }
+        serverIP = response.substr(9, separator - 9);
+        port = std::stoi(response.substr(separator + 1));
+        return false;
+    } else if (response.substr(0, 6) == "ERROR:") {
+        throw std::runtime_error(response.substr(6));
+    } else {
+        throw std::runtime_error("Réponse inattendue du serveur à l'identification");
+    }
+}
+
 /*
  * Vide le buffer d'entrée standard.
  * Nécessaire après un cin >> pour éviter les problèmes avec getline().
@@ -400,7 +639,8 @@ void clearInputBuffer() {
  * Séquence :
  *   1. Initialisation réseau
  *   2. Saisie du nom d'utilisateur
- *   3. Connexion au serveur
+ *   3. Connexion au serveur (en suivant au plus MAX_REDIRECTS
+ *      redirections vers le nœud de l'utilisateur)
  *   4. Démarrage du thread d'écoute
  *   5. Boucle du menu interactif
  *   6. Fermeture propre
@@ -432,13 +672,22 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
-        /* Connexion au serveur */
+        /* Connexion au serveur, identification et négociation du format de message */
         std::cout << "Connexion à " << serverIP << ":" << port << "..." << std::endl;
-        g_serverSocket = SocketUtils::createTCPSocket();
-        SocketUtils::connectToServer(g_serverSocket, serverIP, port);
-        
-        /* Envoi du nom d'utilisateur */
-        SocketUtils::sendWithLength(g_serverSocket, g_username.c_str(), g_username.length());
+        for (int redirects = 0; ; ++redirects) {
+            g_serverSocket = SocketUtils::createTCPSocket();
+            SocketUtils::connectToServer(g_serverSocket, serverIP, port);
+            if (login(serverIP, port)) {
+                break;
+            }
+            
+            SocketUtils::closeSocket(g_serverSocket);
+            g_serverSocket = INVALID_SOCKET;
+            if (redirects == MAX_REDIRECTS) {
+                throw std::runtime_error("Trop de redirections");
+            }
+            std::cout << "Redirection vers " << serverIP << ":" << port << "..." << std::endl;
+        }
         
         std::cout << "Connecté avec succès!" << std::endl;
         
@@ -482,6 +731,14 @@ int main(int argc, char* argv[]) {
                 case 7:
                     disconnect();
                     break;
+                case 8:
+                    requestHistory();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                    break;
+                case 9:
+                    requestStats();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                    break;
                 default:
                     std::cout << "Commande inexistante." << std::endl;
             }
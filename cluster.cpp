@@ -0,0 +1,256 @@
+/*
+ * cluster.cpp
+ *
+ * Implémentation de l'état de la grappe (voir cluster.h).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "cluster.h"
+#include <stdexcept>
+
+/* ========================================================================== */
+/*                            CONFIGURATION                                   */
+/* ========================================================================== */
+
+std::vector<PeerAddress> parsePeerList(const std::string& list) {
+    std::vector<PeerAddress> peers;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        start = (comma == std::string::npos) ? list.size() + 1 : comma + 1;
+
+        size_t at = item.find('@');
+        size_t colon = item.rfind(':');
+        if (at == std::string::npos || at == 0 || colon == std::string::npos || colon < at + 2) {
+            throw std::invalid_argument("Pair invalide (attendu <nœud>@<ip>:<port>): " + item);
+        }
+
+        PeerAddress peer;
+        peer.node = item.substr(0, at);
+        peer.host = item.substr(at + 1, colon - at - 1);
+        peer.port = std::stoi(item.substr(colon + 1));
+        if (peer.port < 1 || peer.port > 65535) {
+            throw std::invalid_argument("Port de pair invalide: " + item);
+        }
+        for (const PeerAddress& other : peers) {
+            if (other.node == peer.node) {
+                throw std::invalid_argument("Pair en double: " + peer.node);
+            }
+        }
+        peers.push_back(peer);
+    }
+    return peers;
+}
+
+void ClusterDirectory::configure(const std::string& self, std::vector<PeerAddress> peers,
+                                 std::string secret, size_t virtualNodes) {
+    if (!peers.empty() && secret.empty()) {
+        throw std::invalid_argument("Grappe sans secret : toute la machine d'un pair pourrait s'y joindre");
+    }
+    m_self = self;
+    m_peers = std::move(peers);
+    m_secret = std::move(secret);
+    m_ring = HashRing(virtualNodes);
+    m_ring.addNode(m_self);
+    for (const PeerAddress& peer : m_peers) {
+        m_ring.addNode(peer.node);
+    }
+}
+
+const PeerAddress* ClusterDirectory::findPeer(const std::string& node) const {
+    for (const PeerAddress& peer : m_peers) {
+        if (peer.node == node) {
+            return &peer;
+        }
+    }
+    return nullptr;
+}
+
+std::string ClusterDirectory::peerHello() const {
+    return "PEER:" + m_self + ":" + m_secret;
+}
+
+/*
+ * Le nom d'un nœud ne contient pas ':' (--node-id) : tout ce qui suit
+ * le premier ':' est le secret. Sa comparaison ne s'arrête pas au
+ * premier octet différent (durée indépendante du contenu).
+ */
+bool ClusterDirectory::authenticatePeer(const std::string& hello, const std::string& address,
+                                        std::string& node) const {
+    size_t colon = hello.find(':');
+    node = hello.substr(0, colon);
+    std::string secret = (colon == std::string::npos) ? std::string() : hello.substr(colon + 1);
+
+    const PeerAddress* peer = findPeer(node);
+    if (peer == nullptr || peer->host != address || m_secret.empty() || secret.size() != m_secret.size()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (size_t i = 0; i < secret.size(); ++i) {
+        difference |= static_cast<unsigned char>(secret[i] ^ m_secret[i]);
+    }
+    return difference == 0;
+}
+
+/* ========================================================================== */
+/*                         LIAISONS SORTANTES                                 */
+/* ========================================================================== */
+
+bool ClusterDirectory::attachLink(const std::string& node, const ConnectionPtr& link, const Greeter& greet) {
+    LockGuard<ClusterMutex> announceLock(m_announceMutex);
+    {
+        LockGuard<ClusterMutex> lock(m_linksMutex);
+        if (m_links.count(node) != 0) {
+            return false;
+        }
+        m_links[node] = link;
+    }
+    greet(*link);
+    return true;
+}
+
+void ClusterDirectory::detachLink(const std::string& node, const ConnectionPtr& link) {
+    LockGuard<ClusterMutex> lock(m_linksMutex);
+    auto it = m_links.find(node);
+    if (it != m_links.end() && it->second == link) {
+        m_links.erase(it);
+    }
+}
+
+bool ClusterDirectory::hasLink(const std::string& node) const {
+    LockGuard<ClusterMutex> lock(m_linksMutex);
+    return m_links.count(node) != 0;
+}
+
+size_t ClusterDirectory::linkCount() const {
+    LockGuard<ClusterMutex> lock(m_linksMutex);
+    return m_links.size();
+}
+
+bool ClusterDirectory::sendTo(const std::string& node, const FrameBuffer& frame) {
+    ConnectionPtr link;
+    {
+        LockGuard<ClusterMutex> lock(m_linksMutex);
+        auto it = m_links.find(node);
+        if (it == m_links.end()) {
+            return false;
+        }
+        link = it->second;
+    }
+    return link->enqueue(frame) == EnqueueResult::Queued;
+}
+
+size_t ClusterDirectory::sendToAll(const FrameBuffer& frame) {
+    std::vector<ConnectionPtr> links;
+    {
+        LockGuard<ClusterMutex> lock(m_linksMutex);
+        for (const auto& [node, link] : m_links) {
+            links.push_back(link);
+        }
+    }
+    size_t accepted = 0;
+    for (const ConnectionPtr& link : links) {
+        if (link->enqueue(frame) == EnqueueResult::Queued) {
+            accepted++;
+        }
+    }
+    return accepted;
+}
+
+void ClusterDirectory::announce(const FrameBuffer& frame) {
+    LockGuard<ClusterMutex> announceLock(m_announceMutex);
+    sendToAll(frame);
+}
+
+std::vector<ClusterDirectory::ConnectionPtr> ClusterDirectory::takeLinks() {
+    std::vector<ConnectionPtr> links;
+    LockGuard<ClusterMutex> lock(m_linksMutex);
+    for (auto& [node, link] : m_links) {
+        links.push_back(std::move(link));
+    }
+    m_links.clear();
+    return links;
+}
+
+/* ========================================================================== */
+/*                            RATTACHEMENT                                    */
+/* ========================================================================== */
+
+/* Anneau fixe après configure() : lecture sans verrou */
+const std::string& ClusterDirectory::homeNode(const std::string& username) const {
+    return m_ring.empty() ? m_self : m_ring.nodeFor(username);
+}
+
+/* ========================================================================== */
+/*                          PRÉSENCE DISTANTE                                 */
+/* ========================================================================== */
+
+/* Une nouvelle liaison repart de zéro : le pair renvoie toute sa présence */
+void ClusterDirectory::beginInbound(const std::string& node, const void* token) {
+    LockGuard<PresenceMutex> lock(m_presenceMutex);
+    m_inbound[node] = token;
+    dropNode(node);
+}
+
+void ClusterDirectory::endInbound(const std::string& node, const void* token) {
+    LockGuard<PresenceMutex> lock(m_presenceMutex);
+    auto it = m_inbound.find(node);
+    if (it != m_inbound.end() && it->second == token) {
+        m_inbound.erase(it);
+        dropNode(node);
+    }
+}
+
+/* Appelée sous m_presenceMutex (exclusif) */
+void ClusterDirectory::dropNode(const std::string& node) {
+    for (auto it = m_remoteUsers.begin(); it != m_remoteUsers.end();) {
+        if (it->second == node) {
+            it = m_remoteUsers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ClusterDirectory::setRemote(const std::string& username, const std::string& node) {
+    LockGuard<PresenceMutex> lock(m_presenceMutex);
+    m_remoteUsers[username] = node;
+}
+
+/* Sans effet si l'utilisateur s'est entre-temps connecté sur un autre nœud */
+void ClusterDirectory::clearRemote(const std::string& username, const std::string& node) {
+    LockGuard<PresenceMutex> lock(m_presenceMutex);
+    auto it = m_remoteUsers.find(username);
+    if (it != m_remoteUsers.end() && it->second == node) {
+        m_remoteUsers.erase(it);
+    }
+}
+
+bool ClusterDirectory::findRemote(const std::string& username, std::string& node) const {
+    SharedLock<PresenceMutex> lock(m_presenceMutex);
+    auto it = m_remoteUsers.find(username);
+    if (it == m_remoteUsers.end()) {
+        return false;
+    }
+    node = it->second;
+    return true;
+}
+
+size_t ClusterDirectory::remoteUserCount() const {
+    SharedLock<PresenceMutex> lock(m_presenceMutex);
+    return m_remoteUsers.size();
+}
+
+/* Le visiteur est appelé hors verrou, sur une copie */
+void ClusterDirectory::forEachRemoteUser(const UserVisitor& visitor) const {
+    std::vector<std::pair<std::string, std::string>> users;
+    {
+        SharedLock<PresenceMutex> lock(m_presenceMutex);
+        users.assign(m_remoteUsers.begin(), m_remoteUsers.end());
+    }
+    for (const auto& [username, node] : users) {
+        visitor(username, node);
+    }
+}
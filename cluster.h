@@ -0,0 +1,196 @@
+/*
+ * cluster.h
+ *
+ * État d'un nœud dans une grappe de serveurs (fédération).
+ *
+ * Plusieurs processus serveur (--node-id, --peers) se partagent les
+ * utilisateurs : chacun garde ses propres connexions et apprend des
+ * autres qui est connecté où. Chaque nœud ouvre une liaison persistante
+ * vers chacun de ses pairs, sur le port client de ce pair, et n'y
+ * envoie que des trames (voir serveur.cpp, "FÉDÉRATION") :
+ *   - PEER:<nœud>:<secret> : première trame, identifie la liaison ;
+ *                          acceptée seulement depuis l'adresse du nœud
+ *                          dans --peers et avec le secret de la grappe
+ *                          (--cluster-secret, obligatoire avec --peers)
+ *   - ONLINE:<nom>       : un utilisateur s'est connecté sur ce nœud
+ *   - OFFLINE:<nom>      : il s'est déconnecté
+ *   - RELAY:<message>    : message (format compact) à livrer chez le pair,
+ *                          unicast ou une seule trame par nœud pour "all"
+ *   - NOTIFY:<nom>\n<texte> : notification pour un utilisateur du pair
+ *
+ * Une paire de nœuds est donc reliée par deux connexions TCP, une par
+ * sens : la liaison sortante d'un nœud est la liaison entrante de
+ * l'autre. La présence reçue sur une liaison entrante est oubliée
+ * quand elle se ferme ; le pair renvoie tout à la reconnexion.
+ *
+ * Chaque utilisateur a un nœud de rattachement, donné par un anneau de
+ * hachage cohérent (voir hash_ring.h) construit une fois pour toutes à
+ * partir de --node-id et --peers : tous les nœuds configurés de la même
+ * façon calculent le même anneau, quel que soit l'état de leurs
+ * liaisons. Un client qui se présente ailleurs y est redirigé, et sa
+ * boîte de réception y est tenue ; l'ajout ou le retrait d'un nœud dans
+ * la configuration ne change le rattachement que d'environ 1/N des
+ * utilisateurs. Un nœud injoignable n'est pas remplacé : ses
+ * utilisateurs sont refusés jusqu'à son retour, aucun autre nœud ne
+ * tient leur boîte entre-temps (voir serveur.cpp, handleLogin).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "connection.h"
+#include "lock_profiler.h"
+#include "hash_ring.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+/* Pair d'une grappe : identifiant et adresse de son port client */
+struct PeerAddress {
+    std::string node;
+    std::string host;
+    int port = 0;
+};
+
+/*
+ * Liste de pairs "<nœud>@<ip>:<port>,..." (option --peers) ; lève
+ * std::invalid_argument si un élément est mal formé ou en double.
+ */
+std::vector<PeerAddress> parsePeerList(const std::string& list);
+
+/*
+ * Classe ClusterDirectory
+ *
+ * Liaisons sortantes (une par pair) et présence des utilisateurs des
+ * autres nœuds. Toutes les méthodes sont appelables depuis n'importe
+ * quel thread ; les envois ne se font jamais sous le verrou des
+ * liaisons (copie du pointeur, puis dépôt dans la file de sortie).
+ */
+class ClusterDirectory {
+public:
+    using ConnectionPtr = std::shared_ptr<Connection>;
+    using Greeter = std::function<void(Connection& link)>;
+    using UserVisitor = std::function<void(const std::string& username, const std::string& node)>;
+
+    ClusterDirectory() = default;
+
+    ClusterDirectory(const ClusterDirectory&) = delete;
+    ClusterDirectory& operator=(const ClusterDirectory&) = delete;
+
+    /*
+     * Identité du nœud, pairs, secret partagé (obligatoire avec des
+     * pairs : std::invalid_argument sinon) et nœuds
+     * virtuels de l'anneau (avant le démarrage des threads). L'anneau est
+     * construit ici, de ce nœud et de tous les pairs, et ne change plus.
+     */
+    void configure(const std::string& self, std::vector<PeerAddress> peers, std::string secret,
+                   size_t virtualNodes = DEFAULT_VIRTUAL_NODES);
+
+    bool enabled() const { return !m_peers.empty(); }
+    const std::string& self() const { return m_self; }
+    const std::vector<PeerAddress>& peers() const { return m_peers; }
+
+    /* Adresse d'un pair ; nullptr si node n'est pas dans --peers */
+    const PeerAddress* findPeer(const std::string& node) const;
+
+    /* Première trame d'une liaison sortante : "PEER:<ce nœud>:<secret>" */
+    std::string peerHello() const;
+
+    /*
+     * Vérification d'une liaison entrante : hello est la trame reçue
+     * sans "PEER:", address l'adresse d'origine de la connexion. Le nœud
+     * doit figurer dans --peers avec cette adresse et présenter le
+     * secret de la grappe. node reçoit le nom annoncé (journal), même
+     * en cas de refus.
+     */
+    bool authenticatePeer(const std::string& hello, const std::string& address, std::string& node) const;
+
+    /* ---- Liaisons sortantes ---- */
+
+    /*
+     * Publication de la liaison vers node ; greet(link) est appelé
+     * ensuite sous le verrou des annonces (instantané de présence, voir
+     * announce). false si une liaison vers ce nœud existe déjà.
+     */
+    bool attachLink(const std::string& node, const ConnectionPtr& link, const Greeter& greet);
+
+    /* Retrait de la liaison, si c'est bien celle publiée */
+    void detachLink(const std::string& node, const ConnectionPtr& link);
+
+    bool hasLink(const std::string& node) const;
+    size_t linkCount() const;
+
+    /* Dépôt d'une trame vers un nœud ; false sans liaison ou si refusée */
+    bool sendTo(const std::string& node, const FrameBuffer& frame);
+
+    /* Dépôt d'une trame vers chaque nœud relié ; nombre de dépôts acceptés */
+    size_t sendToAll(const FrameBuffer& frame);
+
+    /*
+     * Annonce de présence à tous les nœuds reliés. Sérialisée avec
+     * l'instantané d'attachLink : un changement du registre fait avant
+     * l'instantané y figure, un changement fait après est annoncé sur
+     * la nouvelle liaison. Aucun pair ne garde donc d'état périmé.
+     */
+    void announce(const FrameBuffer& frame);
+
+    /* Fermeture des liaisons sortantes encore ouvertes (arrêt) */
+    std::vector<ConnectionPtr> takeLinks();
+
+    /* ---- Rattachement (anneau de hachage) ---- */
+
+    /*
+     * Nœud de rattachement d'un utilisateur (self() hors grappe). Ne
+     * dépend que de la configuration : tous les nœuds donnent le même,
+     * joignable ou non (voir hasLink).
+     */
+    const std::string& homeNode(const std::string& username) const;
+
+    /* Nœuds de l'anneau (ce nœud compris) */
+    size_t ringSize() const { return m_ring.nodes().size(); }
+
+    /* ---- Présence distante (liaisons entrantes) ---- */
+
+    /*
+     * Début / fin d'une liaison entrante de node. token identifie la
+     * liaison : seule la fin de la liaison courante efface la présence
+     * du nœud (une reconnexion peut précéder la fermeture de l'ancienne).
+     */
+    void beginInbound(const std::string& node, const void* token);
+    void endInbound(const std::string& node, const void* token);
+
+    void setRemote(const std::string& username, const std::string& node);
+    void clearRemote(const std::string& username, const std::string& node);
+
+    /* Nœud d'un utilisateur distant ; false s'il n'est connecté sur aucun pair */
+    bool findRemote(const std::string& username, std::string& node) const;
+
+    size_t remoteUserCount() const;
+    void forEachRemoteUser(const UserVisitor& visitor) const;
+
+private:
+    using ClusterMutex = ProfiledMutex<LockClass::Cluster>;
+    using PresenceMutex = ProfiledSharedMutex<LockClass::Cluster>;
+
+    void dropNode(const std::string& node);
+
+    std::string m_self;
+    std::vector<PeerAddress> m_peers;
+    std::string m_secret;                                       /* Secret de la grappe  */
+
+    HashRing m_ring;                                            /* Ce nœud + --peers (fixe) */
+
+    mutable ClusterMutex m_linksMutex;                          /* Protège m_links      */
+    std::unordered_map<std::string, ConnectionPtr> m_links;     /* Nœud -> liaison      */
+    ClusterMutex m_announceMutex;                               /* Annonces / instantané */
+
+    mutable PresenceMutex m_presenceMutex;                      /* Protège la présence  */
+    std::unordered_map<std::string, std::string> m_remoteUsers; /* Nom -> nœud          */
+    std::unordered_map<std::string, const void*> m_inbound;     /* Nœud -> liaison entrante */
+};
+
+#endif /* CLUSTER_H */
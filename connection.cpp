@@ -0,0 +1,361 @@
+/*
+ * connection.cpp
+ *
+ * File de sortie bornée et envois non bloquants d'une connexion.
+ * Envoi de fichiers par portions (sendfile).
+ * Opérations attendues par la session (readFrame, write).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "connection.h"
+#include "server_stats.h"
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+/* ========================================================================== */
+/*                            CONSTRUCTION                                    */
+/* ========================================================================== */
+
+Connection::Connection(SOCKET sock, const std::string& ip, EventLoop* owner,
+                       size_t maxOutbound, SlowConsumerPolicy policy)
+    : socket(sock), clientIP(ip), loop(owner), reader(MAX_FRAME_SIZE, READ_CHUNK_SIZE),
+      wireFormat(WireFormat::Legacy), inputPending(false),
+      outOffset(0), outBytes(0), maxOutboundBytes(maxOutbound),
+      slowPolicy(policy), closed(false), mailboxDraining(false) {
+}
+
+/* ========================================================================== */
+/*                          ENCODAGE DES TRAMES                               */
+/* ========================================================================== */
+
+/*
+ * Encode une trame dans un tampon unique.
+ *
+ * Format identique à SocketUtils::sendWithLength :
+ *   [4 octets : longueur en network byte order][préfixe][données]
+ *
+ * Le préfixe ("MSG:", ...) est copié directement dans le tampon final,
+ * sans chaîne ni vecteur intermédiaire.
+ */
+FrameBuffer makeFrame(const std::string& prefix, const char* data, size_t size) {
+    uint32_t netLength = htonl(static_cast<uint32_t>(prefix.size() + size));
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(sizeof(netLength) + prefix.size() + size);
+    frame->append(reinterpret_cast<const char*>(&netLength), sizeof(netLength));
+    frame->append(prefix);
+    frame->append(data, size);
+    return frame;
+}
+
+/*
+ * En-tête seul d'une trame dont les payloadSize octets de données
+ * sont envoyés à part (portion de fichier).
+ */
+FrameBuffer makeFrameHeader(const std::string& prefix, size_t payloadSize) {
+    uint32_t netLength = htonl(static_cast<uint32_t>(prefix.size() + payloadSize));
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(sizeof(netLength) + prefix.size());
+    frame->append(reinterpret_cast<const char*>(&netLength), sizeof(netLength));
+    frame->append(prefix);
+    return frame;
+}
+
+SharedFile::~SharedFile() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+/* ========================================================================== */
+/*                          FILE DE SORTIE                                    */
+/* ========================================================================== */
+
+/*
+ * Dépose une trame encodée dans la file de sortie.
+ *
+ * Si la file était vide, on tente immédiatement un envoi non bloquant :
+ * dans le cas courant (client qui suit), la trame part sans passer par
+ * la boucle. Sinon elle attend l'événement EPOLLOUT.
+ *
+ * Une trame plus grande que la limite est acceptée si la file est vide,
+ * pour ne pas rendre impossible l'envoi d'une grosse réponse unique.
+ */
+EnqueueResult Connection::enqueue(const FrameBuffer& frame) {
+    return enqueueItem(OutboundItem{frame, nullptr, 0, 0});
+}
+
+EnqueueResult Connection::enqueueFile(const FrameBuffer& header, const SharedFilePtr& file,
+                                      off_t offset, size_t length) {
+    return enqueueItem(OutboundItem{header, file, offset, length});
+}
+
+EnqueueResult Connection::enqueueItem(OutboundItem item) {
+    LockGuard<ConnectionMutex> lock(writeMutex);
+
+    if (closed) {
+        return EnqueueResult::Closed;
+    }
+
+    size_t itemSize = item.size();
+    if (outBytes > 0 && outBytes + itemSize > maxOutboundBytes) {
+        if (slowPolicy == SlowConsumerPolicy::DropMessages) {
+            return EnqueueResult::Dropped;
+        }
+
+        /* Coupure : la boucle verra la fermeture et libérera la connexion */
+        closed = true;
+        outQueue.clear();
+        outBytes = 0;
+        outOffset = 0;
+        shutdown(socket, SHUT_RDWR);
+        return EnqueueResult::Disconnected;
+    }
+
+    bool wasEmpty = outQueue.empty();
+    outBytes += itemSize;
+    outQueue.push_back(std::move(item));
+    serverStats().add(StatCounter::FramesOut);
+    serverStats().add(StatCounter::BytesOut, itemSize);
+
+    if (wasEmpty && !flushLocked()) {
+        return EnqueueResult::Closed;
+    }
+    return EnqueueResult::Queued;
+}
+
+/*
+ * Appelée par la boucle sur EPOLLOUT : reprend le vidage de la file.
+ */
+void Connection::onWritable() {
+    LockGuard<ConnectionMutex> lock(writeMutex);
+    if (!closed) {
+        flushLocked();
+    }
+}
+
+/*
+ * Envoie le contenu de la file jusqu'à la vider ou jusqu'à EAGAIN.
+ *
+ * Les trames en attente sont regroupées (jusqu'à MAX_WRITE_BATCH) dans
+ * un seul sendmsg() : un client qui a pris du retard est rattrapé en
+ * quelques appels système au lieu d'un par trame. Un regroupement
+ * s'arrête à l'en-tête d'un élément fichier, dont les données partent
+ * ensuite par sendfile().
+ *
+ * En cas d'erreur fatale (client parti), la file est abandonnée et le
+ * socket coupé : la boucle propriétaire se charge de la fermeture.
+ */
+bool Connection::flushLocked() {
+    struct iovec iov[MAX_WRITE_BATCH];
+
+    while (!outQueue.empty()) {
+        const OutboundItem& front = outQueue.front();
+        size_t frameSize = front.frame->size();
+        ssize_t sent;
+
+        if (front.file && outOffset >= frameSize) {
+            /* Données de fichier : copie directe fichier -> socket */
+            size_t done = outOffset - frameSize;
+            off_t offset = front.fileOffset + static_cast<off_t>(done);
+            sent = sendfile(socket, front.file->fd(), &offset, front.fileLength - done);
+            if (sent == 0) {
+                errno = EIO;        /* Fichier raccourci : trame impossible à terminer */
+                sent = -1;
+            }
+        } else {
+            size_t count = 0;
+            for (auto it = outQueue.begin(); it != outQueue.end() && count < MAX_WRITE_BATCH; ++it) {
+                const std::string& frame = *it->frame;
+                size_t skip = (count == 0) ? outOffset : 0;
+                iov[count].iov_base = const_cast<char*>(frame.data() + skip);
+                iov[count].iov_len = frame.size() - skip;
+                ++count;
+                if (it->file) {
+                    break;
+                }
+            }
+
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+
+            sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+        }
+
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            closed = true;
+            outQueue.clear();
+            outBytes = 0;
+            outOffset = 0;
+            shutdown(socket, SHUT_RDWR);
+            return false;
+        }
+
+        /* Retrait des éléments entièrement envoyés */
+        size_t remaining = static_cast<size_t>(sent);
+        outBytes -= remaining;
+        while (remaining > 0) {
+            size_t left = outQueue.front().size() - outOffset;
+            if (remaining < left) {
+                outOffset += remaining;
+                break;
+            }
+            remaining -= left;
+            outQueue.pop_front();
+            outOffset = 0;
+        }
+    }
+    return true;
+}
+
+/* ========================================================================== */
+/*                      OPÉRATIONS DE LA SESSION                              */
+/* ========================================================================== */
+
+/*
+ * Une trame déjà présente dans le tampon est remise sans suspendre la
+ * session : après une lecture, la session traite toutes les trames
+ * reçues d'une traite avant de rendre la main à la boucle.
+ */
+bool Connection::FrameAwaiter::await_ready() {
+    if (conn.closed) {
+        conn.frame = FrameView();
+        return true;
+    }
+    return conn.reader.nextFrame(conn.frame.data, conn.frame.size);
+}
+
+/* Trame remise à la session, comptée avec son préfixe de longueur */
+FrameView Connection::FrameAwaiter::await_resume() const {
+    if (conn.frame) {
+        serverStats().add(StatCounter::FramesIn);
+        serverStats().add(StatCounter::BytesIn, conn.frame.size + sizeof(uint32_t));
+    }
+    return conn.frame;
+}
+
+/*
+ * Le dépôt ne bloque jamais (voir enqueue) ; la session n'est suspendue
+ * que si la file dépasse STREAM_WINDOW_BYTES, ce qui borne ce qu'une
+ * réponse longue (historique) accumule pour un client qui ne lit pas.
+ */
+bool Connection::WriteAwaiter::await_ready() {
+    result = conn.enqueue(frame);
+    return result != EnqueueResult::Queued || conn.hasOutboundRoom(0);
+}
+
+void Connection::resumeReader() {
+    if (!frameWaiter) {
+        return;
+    }
+    if (!reader.nextFrame(frame.data, frame.size)) {
+        return;
+    }
+    std::exchange(frameWaiter, nullptr).resume();
+}
+
+void Connection::resumeWriter() {
+    if (writeWaiter && (closed || hasOutboundRoom(0))) {
+        std::exchange(writeWaiter, nullptr).resume();
+    }
+}
+
+/*
+ * La session attend soit une trame (elle reçoit une trame vide), soit
+ * de la place (son dépôt a déjà échoué ou sera le dernier) : dans les
+ * deux cas elle se termine d'elle-même.
+ */
+void Connection::endSession() {
+    if (frameWaiter) {
+        frame = FrameView();
+        std::exchange(frameWaiter, nullptr).resume();
+    } else if (writeWaiter) {
+        std::exchange(writeWaiter, nullptr).resume();
+    }
+}
+
+/* ========================================================================== */
+/*                          ENVOI DE FICHIER                                  */
+/* ========================================================================== */
+
+/*
+ * Une file vide accepte toujours une trame ; sinon la file ne doit pas
+ * dépasser STREAM_WINDOW_BYTES ni la limite de la connexion.
+ */
+bool Connection::hasOutboundRoom(size_t bytes) {
+    LockGuard<ConnectionMutex> lock(writeMutex);
+    size_t window = std::min(STREAM_WINDOW_BYTES, maxOutboundBytes);
+    return outBytes == 0 || outBytes + bytes <= window;
+}
+
+/*
+ * Dépose les trames suivantes de l'envoi en cours tant que la file
+ * contient moins de STREAM_WINDOW_BYTES (et reste sous la limite de la
+ * connexion). Appelée par la boucle au démarrage de l'envoi puis à
+ * chaque EPOLLOUT : la mémoire utilisée ne dépend pas de la taille du
+ * fichier.
+ */
+void Connection::pumpStream() {
+    while (stream) {
+        size_t length = static_cast<size_t>(std::min<off_t>(stream->end - stream->next,
+                                                             static_cast<off_t>(STREAM_CHUNK_SIZE)));
+        if (closed) {
+            stream.reset();
+            return;
+        }
+        if (!hasOutboundRoom(length + stream->prefix.size() + sizeof(uint32_t))) {
+            return;
+        }
+
+        if (length == 0) {
+            enqueue(stream->trailer);
+            stream.reset();
+            return;
+        }
+
+        EnqueueResult result = enqueueFile(makeFrameHeader(stream->prefix, length),
+                                           stream->file, stream->next, length);
+        if (result == EnqueueResult::Dropped) {
+            return;     /* File pleine (autres trames) : nouvel essai au prochain EPOLLOUT */
+        }
+        if (result != EnqueueResult::Queued) {
+            stream.reset();
+            return;
+        }
+        stream->next += static_cast<off_t>(length);
+    }
+}
+
+/* ========================================================================== */
+/*                              FERMETURE                                     */
+/* ========================================================================== */
+
+/*
+ * Ferme le socket et abandonne les trames en attente.
+ * Appelée une seule fois par la boucle propriétaire, après le retrait
+ * de la connexion du registre.
+ */
+void Connection::close() {
+    LockGuard<ConnectionMutex> lock(writeMutex);
+    closed = true;
+    outQueue.clear();
+    outBytes = 0;
+    outOffset = 0;
+    stream.reset();
+    if (socket != INVALID_SOCKET) {
+        SocketUtils::closeSocket(socket);
+        socket = INVALID_SOCKET;
+    }
+}
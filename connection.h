@@ -0,0 +1,235 @@
+/*
+ * connection.h
+ *
+ * État d'une connexion client côté serveur.
+ * Une connexion appartient à une seule boucle d'événements qui
+ * effectue toutes ses lectures.
+ *
+ * Les écritures passent par une file de sortie bornée propre à la
+ * connexion : n'importe quel thread (réponses, livraison) y dépose
+ * des trames, vidées par des send() non bloquants, soit directement
+ * par le thread qui dépose, soit par la boucle quand le socket
+ * redevient inscriptible (EPOLLOUT). Aucun envoi ne bloque et aucun
+ * envoi n'a lieu sous un verrou global.
+ *
+ * Les trames sont des tampons immuables partagés (FrameBuffer) : une
+ * diffusion encode le message une seule fois et chaque file de sortie
+ * ne stocke qu'un pointeur vers ce tampon.
+ *
+ * Le traitement des trames reçues est une coroutine (voir session.h) :
+ * readFrame() et write() sont des opérations attendues par co_await,
+ * la boucle reprenant la session quand une trame est arrivée ou quand
+ * la file de sortie est repassée sous STREAM_WINDOW_BYTES.
+ *
+ * Un élément de la file peut aussi désigner une portion de fichier,
+ * envoyée par sendfile() sans copie en espace utilisateur (GET_LOG).
+ * Un envoi de fichier (FileStream) est découpé en trames bornées,
+ * déposées au fur et à mesure que la file se vide.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "socket_utils.h"
+#include "message.h"
+#include "lock_profiler.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <coroutine>
+#include <sys/types.h>
+
+class EventLoop;
+
+/* Trame encodée (préfixe de longueur inclus), immuable et partagée */
+using FrameBuffer = std::shared_ptr<const std::string>;
+
+/* Encodage d'une trame : [longueur][préfixe][données] */
+FrameBuffer makeFrame(const std::string& prefix, const char* data, size_t size);
+
+/* En-tête d'une trame dont les données suivent à part : [longueur][préfixe] */
+FrameBuffer makeFrameHeader(const std::string& prefix, size_t payloadSize);
+
+/* Verrou de la file de sortie d'une connexion */
+using ConnectionMutex = ProfiledMutex<LockClass::Connection>;
+
+/* Taille par défaut de la file de sortie au-delà de laquelle le client est lent */
+constexpr size_t DEFAULT_MAX_OUTBOUND_BYTES = 1024 * 1024;
+
+constexpr size_t MAX_FRAME_SIZE = 64 * 1024;      /* Taille max d'une trame reçue      */
+constexpr size_t READ_CHUNK_SIZE = 16 * 1024;     /* Place libre minimale par recv()   */
+constexpr size_t MAX_WRITE_BATCH = 64;            /* Trames max par écriture groupée   */
+constexpr size_t STREAM_CHUNK_SIZE = 64 * 1024;   /* Données max par trame de fichier  */
+constexpr size_t STREAM_WINDOW_BYTES = 256 * 1024; /* File max alimentée par un envoi  */
+
+/*
+ * Descripteur de fichier ouvert en lecture, partagé par les portions
+ * d'un même envoi et fermé avec la dernière d'entre elles.
+ */
+class SharedFile {
+public:
+    explicit SharedFile(int fd) : m_fd(fd) {}
+    ~SharedFile();
+
+    SharedFile(const SharedFile&) = delete;
+    SharedFile& operator=(const SharedFile&) = delete;
+
+    int fd() const { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+using SharedFilePtr = std::shared_ptr<SharedFile>;
+
+/*
+ * Élément de la file de sortie : une trame en mémoire, éventuellement
+ * suivie d'une portion de fichier (données de la trame).
+ */
+struct OutboundItem {
+    FrameBuffer frame;              /* Trame complète ou en-tête seul         */
+    SharedFilePtr file;             /* nullptr : trame entièrement en mémoire */
+    off_t fileOffset;               /* Début de la portion de fichier         */
+    size_t fileLength;              /* Taille de la portion de fichier        */
+
+    size_t size() const { return frame->size() + fileLength; }
+};
+
+/*
+ * Envoi d'une portion de fichier [next, end) en trames "<prefix><données>"
+ * d'au plus STREAM_CHUNK_SIZE octets, suivies de la trame trailer.
+ */
+struct FileStream {
+    SharedFilePtr file;
+    off_t next;
+    off_t end;
+    std::string prefix;
+    FrameBuffer trailer;
+};
+
+/*
+ * Comportement quand un client dépasse la limite de sa file de sortie.
+ *   - Disconnect   : la connexion est coupée
+ *   - DropMessages : les nouvelles trames sont ignorées jusqu'à ce que
+ *                    la file se vide
+ */
+enum class SlowConsumerPolicy {
+    Disconnect,
+    DropMessages
+};
+
+/* Résultat d'un dépôt de trame dans la file de sortie */
+enum class EnqueueResult {
+    Queued,         /* Trame acceptée (envoyée ou en attente)         */
+    Dropped,        /* Trame ignorée : file pleine (DropMessages)     */
+    Disconnected,   /* File pleine : connexion coupée (Disconnect)    */
+    Closed          /* Connexion déjà fermée                          */
+};
+
+/*
+ * Trame reçue, lue directement dans le tampon de la connexion.
+ * Valide jusqu'au co_await suivant de la session ; data == nullptr
+ * signale la fin de la connexion.
+ */
+struct FrameView {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    explicit operator bool() const { return data != nullptr; }
+};
+
+struct Connection : std::enable_shared_from_this<Connection> {
+    SOCKET socket;                  /* Socket non bloquant du client          */
+    std::string clientIP;           /* Adresse IP (pour le log)               */
+    std::string username;           /* Vide tant que le nom n'est pas reçu    */
+    EventLoop* loop;                /* Boucle propriétaire de la connexion    */
+    FrameReader reader;             /* Tampon de lecture (trames entrantes)   */
+    WireFormat wireFormat;          /* Format des messages négocié au login   */
+
+    /* Session (thread de la boucle uniquement) */
+    std::coroutine_handle<> frameWaiter; /* Session en attente d'une trame     */
+    std::coroutine_handle<> writeWaiter; /* Session en attente de place        */
+    FrameView frame;                /* Trame remise à la session              */
+    bool inputPending;              /* Lecture suspendue (session occupée)    */
+
+    /* File de sortie (protégée par writeMutex) */
+    ConnectionMutex writeMutex;     /* Protège la file et la fermeture        */
+    std::deque<OutboundItem> outQueue; /* Trames encodées (longueur incluse)  */
+    size_t outOffset;               /* Octets déjà envoyés de la 1re trame    */
+    size_t outBytes;                /* Octets en attente dans la file         */
+    size_t maxOutboundBytes;        /* Limite haute de la file                */
+    SlowConsumerPolicy slowPolicy;  /* Action en cas de dépassement           */
+    std::atomic<bool> closed;       /* Socket fermé ou en cours de coupure    */
+
+    std::unique_ptr<FileStream> stream; /* Envoi de fichier en cours (boucle)  */
+    std::atomic<bool> mailboxDraining;  /* Boîte de réception en cours de vidage */
+
+    Connection(SOCKET sock, const std::string& ip, EventLoop* owner,
+               size_t maxOutbound = DEFAULT_MAX_OUTBOUND_BYTES,
+               SlowConsumerPolicy policy = SlowConsumerPolicy::Disconnect);
+
+    /* co_await conn.readFrame() : trame suivante, vide si la connexion est fermée */
+    struct FrameAwaiter {
+        Connection& conn;
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> session) { conn.frameWaiter = session; }
+        FrameView await_resume() const;
+    };
+
+    /* co_await conn.write(frame) : dépôt, puis attente si la file dépasse la fenêtre */
+    struct WriteAwaiter {
+        Connection& conn;
+        FrameBuffer frame;
+        EnqueueResult result;
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> session) { conn.writeWaiter = session; }
+        EnqueueResult await_resume() const { return result; }
+    };
+
+    FrameAwaiter readFrame() { return FrameAwaiter{*this}; }
+    WriteAwaiter write(FrameBuffer frame) { return WriteAwaiter{*this, std::move(frame), EnqueueResult::Closed}; }
+
+    /* Reprise de la session si elle attend une trame et qu'une trame est complète (boucle) */
+    void resumeReader();
+
+    /* Reprise de la session si elle attend de la place et que la file s'est vidée (boucle) */
+    void resumeWriter();
+
+    /* Reprise de la session en attente après la fermeture : elle se termine (boucle) */
+    void endSession();
+
+    /* Dépôt d'une trame encodée (éventuellement partagée) depuis n'importe quel thread */
+    EnqueueResult enqueue(const FrameBuffer& frame);
+
+    /* Dépôt d'un en-tête suivi d'une portion de fichier (sendfile) */
+    EnqueueResult enqueueFile(const FrameBuffer& header, const SharedFilePtr& file,
+                              off_t offset, size_t length);
+
+    /* Dépôt des trames suivantes de l'envoi en cours (boucle propriétaire) */
+    void pumpStream();
+
+    /* Place pour bytes octets dans la fenêtre d'un envoi par portions */
+    bool hasOutboundRoom(size_t bytes);
+
+    /* Vidage de la file quand le socket redevient inscriptible (boucle) */
+    void onWritable();
+
+    /* Fermeture définitive du socket (boucle propriétaire) */
+    void close();
+
+private:
+    /* Dépôt d'un élément (writeMutex non tenu) */
+    EnqueueResult enqueueItem(OutboundItem item);
+
+    /* Envoi non bloquant de la file ; false si erreur fatale (writeMutex tenu) */
+    bool flushLocked();
+};
+
+#endif /* CONNECTION_H */
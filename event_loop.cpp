@@ -0,0 +1,258 @@
+/*
+ * event_loop.cpp
+ *
+ * Partie commune des boucles d'événements et implémentation epoll.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "event_loop.h"
+#include "uring_event_loop.h"
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/* Nombre maximal d'événements traités par appel à epoll_wait() */
+constexpr int MAX_EVENTS = 256;
+
+/* ========================================================================== */
+/*                      CONSTRUCTION / DESTRUCTION                            */
+/* ========================================================================== */
+
+/*
+ * Crée l'eventfd utilisé pour réveiller la boucle (arrêt ou tâche
+ * postée depuis un autre thread) ; chaque implémentation le surveille
+ * avec son propre mécanisme. Le descripteur de réserve est pris tant
+ * qu'il en reste (voir shedConnection).
+ */
+EventLoop::EventLoop() : m_wakeFd(-1), m_reserveFd(-1), m_running(false) {
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0) {
+        throw std::runtime_error("Échec de eventfd: " + std::string(strerror(errno)));
+    }
+    m_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+EventLoop::~EventLoop() {
+    close(m_wakeFd);
+    if (m_reserveFd >= 0) {
+        close(m_reserveFd);
+    }
+}
+
+std::unique_ptr<EventLoop> EventLoop::create(IoBackend backend) {
+    if (backend == IoBackend::IoUring) {
+        return std::make_unique<UringEventLoop>();
+    }
+    return std::make_unique<EpollEventLoop>();
+}
+
+/*
+ * Crée l'instance epoll et y enregistre l'eventfd de réveil.
+ */
+EpollEventLoop::EpollEventLoop() : m_epollFd(-1) {
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0) {
+        throw std::runtime_error("Échec de epoll_create1: " + std::string(strerror(errno)));
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeFd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev) < 0) {
+        close(m_epollFd);
+        throw std::runtime_error("Échec de l'enregistrement de l'eventfd");
+    }
+}
+
+EpollEventLoop::~EpollEventLoop() {
+    close(m_epollFd);
+}
+
+/* ========================================================================== */
+/*                   ENREGISTREMENT DES DESCRIPTEURS                          */
+/* ========================================================================== */
+
+/*
+ * Socket d'écoute en level-triggered : à chaque réveil, la file du
+ * noyau est vidée jusqu'à EAGAIN (au plus ACCEPT_BATCH_MAX connexions
+ * pour ne pas affamer les clients déjà connectés ; le reste est signalé
+ * au tour suivant).
+ */
+void EpollEventLoop::addListener(SOCKET fd, bool exclusive, AcceptHandler handler) {
+    add(fd, exclusive ? (EPOLLIN | EPOLLEXCLUSIVE) : EPOLLIN, [this, fd, handler](uint32_t) {
+        for (size_t accepted = 0; accepted < ACCEPT_BATCH_MAX; ++accepted) {
+            std::string clientIP;
+            SOCKET clientSocket;
+            try {
+                clientSocket = SocketUtils::acceptConnection(fd, clientIP, true);
+            } catch (const std::exception& e) {
+                int error = errno;
+                handler(INVALID_SOCKET, e.what());
+                if (error == EMFILE || error == ENFILE) {
+                    shedConnection(fd);
+                }
+                return;
+            }
+            if (clientSocket == INVALID_SOCKET) {
+                return;     /* File vide, ou connexion prise par une autre boucle */
+            }
+            handler(clientSocket, clientIP);
+        }
+    });
+}
+
+/* EPOLLOUT en edge-triggered : signalé à chaque fois que de la place se libère */
+void EpollEventLoop::addStream(SOCKET fd, Handler handler, DataHandler) {
+    add(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, std::move(handler));
+}
+
+void EpollEventLoop::add(SOCKET fd, uint32_t events, Handler handler) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error("Échec de epoll_ctl(ADD): " + std::string(strerror(errno)));
+    }
+    m_handlers[fd] = std::move(handler);
+}
+
+void EpollEventLoop::modify(SOCKET fd, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        throw std::runtime_error("Échec de epoll_ctl(MOD): " + std::string(strerror(errno)));
+    }
+}
+
+void EpollEventLoop::remove(SOCKET fd) {
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    m_handlers.erase(fd);
+}
+
+/* ========================================================================== */
+/*                          BOUCLE PRINCIPALE                                 */
+/* ========================================================================== */
+
+/*
+ * Attend les événements sans timeout : une boucle sans activité
+ * reste bloquée dans epoll_wait() et ne consomme aucun CPU.
+ *
+ * Le gestionnaire est copié avant l'appel car il peut se
+ * désenregistrer lui-même (fermeture de connexion). Une exception qu'il
+ * lève ne concerne que son descripteur (voir setErrorHandler).
+ */
+void EpollEventLoop::run() {
+    struct epoll_event events[MAX_EVENTS];
+    m_running = true;
+
+    while (m_running) {
+        int count = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Échec de epoll_wait: " + std::string(strerror(errno)));
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+
+            if (fd == m_wakeFd) {
+                drainWakeup();
+                continue;
+            }
+
+            auto it = m_handlers.find(fd);
+            if (it == m_handlers.end()) {
+                continue;
+            }
+            Handler handler = it->second;
+            uint32_t mask = events[i].events;
+            dispatch(fd, [&handler, mask]() { handler(mask); });
+        }
+
+        runPendingTasks();
+    }
+}
+
+void EventLoop::stop() {
+    m_running = false;
+    wakeup();
+}
+
+/* ========================================================================== */
+/*                     TÂCHES INTER-THREADS                                   */
+/* ========================================================================== */
+
+void EventLoop::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        m_tasks.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+void EventLoop::wakeup() {
+    uint64_t one = 1;
+    ssize_t written = write(m_wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+void EventLoop::drainWakeup() {
+    uint64_t value;
+    while (read(m_wakeFd, &value, sizeof(value)) > 0) {
+    }
+}
+
+void EventLoop::runPendingTasks() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        tasks.swap(m_tasks);
+    }
+    for (auto& task : tasks) {
+        dispatch(INVALID_SOCKET, task);
+    }
+}
+
+/*
+ * Le gestionnaire d'erreurs ne doit pas lever à son tour : une seconde
+ * exception est ignorée, la boucle ne s'arrête pas pour un client.
+ */
+void EventLoop::reportError(SOCKET fd, const std::string& what) {
+    try {
+        if (m_errorHandler) {
+            m_errorHandler(fd, what);
+        } else if (fd != INVALID_SOCKET) {
+            remove(fd);
+        }
+    } catch (...) {
+    }
+}
+
+/*
+ * La réserve libère un descripteur le temps d'un accept() : le client
+ * voit une fermeture immédiate au lieu d'attendre dans la file. Si la
+ * réserve n'a pu être reprise (ENFILE : un autre processus a pris la
+ * place), elle le sera au prochain refus.
+ */
+void EventLoop::shedConnection(SOCKET listener) {
+    if (m_reserveFd >= 0) {
+        close(m_reserveFd);
+        m_reserveFd = -1;
+    }
+    int sock = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (sock >= 0) {
+        close(sock);
+    }
+    m_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
@@ -0,0 +1,197 @@
+/*
+ * event_loop.h
+ *
+ * Boucle d'événements (réacteur) du serveur.
+ * Chaque instance tourne dans un thread dédié : le serveur en crée une
+ * par cœur.
+ *
+ * Deux implémentations, choisies au démarrage :
+ *   - epoll    : notification de disponibilité, le serveur fait lui-même
+ *                accept() et recv() (EpollEventLoop, défaut)
+ *   - io_uring : accept et recv « multishot » exécutés par le noyau dans
+ *                des tampons fournis (voir uring_event_loop.h) ; les
+ *                soumissions et l'attente des complétions sont groupées
+ *                en un seul appel système par tour de boucle
+ *
+ * Linux uniquement (epoll, io_uring, eventfd).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "socket_utils.h"
+#include <sys/epoll.h>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+
+constexpr size_t ACCEPT_BATCH_MAX = 256;   /* Connexions acceptées par réveil (epoll) */
+
+/* Mécanisme d'entrées/sorties d'une boucle */
+enum class IoBackend {
+    Epoll,
+    IoUring
+};
+
+/*
+ * Classe EventLoop
+ *
+ * Associe à chaque descripteur surveillé un gestionnaire appelé
+ * avec un masque d'événements epoll (EPOLLIN, EPOLLOUT, ...), quelle
+ * que soit l'implémentation.
+ *
+ * Les méthodes add*(), modify() et remove() doivent être appelées
+ * depuis le thread de la boucle (ou avant run()). Pour agir depuis un
+ * autre thread, passer par post() qui exécute une tâche dans la boucle.
+ */
+class EventLoop {
+public:
+    using Handler = std::function<void(uint32_t events)>;
+    using DataHandler = std::function<void(const char* data, size_t size)>;
+    using AcceptHandler = std::function<void(SOCKET fd, const std::string& clientIP)>;
+    using Task = std::function<void()>;
+    using ErrorHandler = std::function<void(SOCKET fd, const std::string& what)>;
+
+    /* Création d'une boucle ; lève std::runtime_error si le mécanisme est indisponible */
+    static std::unique_ptr<EventLoop> create(IoBackend backend);
+
+    virtual ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /*
+     * Socket d'écoute non bloquant : handler reçoit chaque connexion
+     * acceptée (socket déjà non bloquant). exclusive : socket partagé
+     * entre plusieurs boucles, une seule est réveillée par connexion.
+     * Un échec d'accept() est signalé par fd == INVALID_SOCKET, le
+     * second argument contenant alors le message d'erreur ; faute de
+     * descripteur, la connexion refusée est en plus fermée par la boucle.
+     */
+    virtual void addListener(SOCKET fd, bool exclusive, AcceptHandler handler) = 0;
+
+    /*
+     * Connexion non bloquante, surveillée en lecture, en écriture
+     * (EPOLLOUT à chaque fois que de la place se libère) et en fermeture.
+     * Si receivesData() est vrai, les données reçues sont passées à
+     * onData et EPOLLIN n'est jamais signalé ; sinon handler reçoit
+     * EPOLLIN et lit lui-même le socket jusqu'à EAGAIN.
+     */
+    virtual void addStream(SOCKET fd, Handler handler, DataHandler onData) = 0;
+
+    /* Enregistrement d'un descripteur quelconque avec son masque d'événements */
+    virtual void add(SOCKET fd, uint32_t events, Handler handler) = 0;
+
+    /* Modification du masque d'un descripteur enregistré par add() */
+    virtual void modify(SOCKET fd, uint32_t events) = 0;
+
+    /* Désenregistrement (le descripteur n'est pas fermé) */
+    virtual void remove(SOCKET fd) = 0;
+
+    /* Boucle principale : tourne jusqu'à l'appel de stop() */
+    virtual void run() = 0;
+
+    /* Les données reçues sont-elles lues par la boucle (addStream) ? */
+    virtual bool receivesData() const = 0;
+
+    /*
+     * Suspension / reprise de la réception d'une connexion (addStream)
+     * quand receivesData() est vrai : seules les données déjà en vol
+     * sont encore passées à onData, puis TCP freine l'émetteur. Sans
+     * effet avec epoll, où le gestionnaire cesse simplement de lire.
+     */
+    virtual void pauseInput(SOCKET) {}
+    virtual void resumeInput(SOCKET) {}
+
+    /* Nom du mécanisme (journal) */
+    virtual const char* backendName() const = 0;
+
+    /* Demande d'arrêt (thread-safe) */
+    void stop();
+
+    /* Exécution différée d'une tâche dans le thread de la boucle (thread-safe) */
+    void post(Task task);
+
+    /*
+     * Gestionnaire des exceptions levées par les gestionnaires et les
+     * tâches (avant run()). Il reçoit le descripteur concerné
+     * (INVALID_SOCKET pour une tâche) et doit fermer la connexion ; la
+     * boucle continue de servir les autres. Sans gestionnaire, le
+     * descripteur est simplement désenregistré.
+     */
+    void setErrorHandler(ErrorHandler handler) { m_errorHandler = std::move(handler); }
+
+protected:
+    EventLoop();
+
+    /* Vidage du compteur de l'eventfd après un réveil */
+    void drainWakeup();
+
+    /* Exécution des tâches postées depuis d'autres threads */
+    void runPendingTasks();
+
+    /* Appel d'un gestionnaire du descripteur fd ; une exception est signalée à reportError */
+    template <typename Call>
+    void dispatch(SOCKET fd, Call&& call) {
+        try {
+            call();
+        } catch (const std::exception& e) {
+            reportError(fd, e.what());
+        }
+    }
+
+    void reportError(SOCKET fd, const std::string& what);
+
+    /*
+     * accept() en échec faute de descripteur (EMFILE, ENFILE) : la
+     * connexion en attente est acceptée puis fermée aussitôt grâce au
+     * descripteur de réserve, sans quoi le socket d'écoute resterait
+     * signalé et la boucle tournerait à vide.
+     */
+    void shedConnection(SOCKET listener);
+
+    int m_wakeFd;                                   /* eventfd de réveil           */
+    int m_reserveFd;                                /* Réserve (voir shedConnection) */
+    std::atomic<bool> m_running;                    /* Flag d'arrêt                */
+
+private:
+    /* Réveil de la boucle via l'eventfd */
+    void wakeup();
+
+    std::mutex m_tasksMutex;                        /* Protection de m_tasks       */
+    std::vector<Task> m_tasks;                      /* Tâches en attente           */
+    ErrorHandler m_errorHandler;                    /* Voir setErrorHandler()      */
+};
+
+/*
+ * Classe EpollEventLoop
+ *
+ * Réacteur epoll : les connexions sont en edge-triggered, le socket
+ * d'écoute en level-triggered (vidé par rafales de ACCEPT_BATCH_MAX).
+ */
+class EpollEventLoop : public EventLoop {
+public:
+    EpollEventLoop();
+    ~EpollEventLoop() override;
+
+    void addListener(SOCKET fd, bool exclusive, AcceptHandler handler) override;
+    void addStream(SOCKET fd, Handler handler, DataHandler onData) override;
+    void add(SOCKET fd, uint32_t events, Handler handler) override;
+    void modify(SOCKET fd, uint32_t events) override;
+    void remove(SOCKET fd) override;
+    void run() override;
+    bool receivesData() const override { return false; }
+    const char* backendName() const override { return "epoll"; }
+
+private:
+    int m_epollFd;                                  /* Instance epoll              */
+    std::unordered_map<int, Handler> m_handlers;    /* Gestionnaires par fd        */
+};
+
+#endif /* EVENT_LOOP_H */
@@ -0,0 +1,72 @@
+/*
+ * hash_ring.cpp
+ *
+ * Implémentation de l'anneau de hachage cohérent (voir hash_ring.h).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "hash_ring.h"
+#include <algorithm>
+
+uint64_t ringHash(const std::string& key) {
+    /* FNV-1a 64 bits */
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    /* Finalisation splitmix64 : des clés voisines ("a#1", "a#2") s'étalent sur l'anneau */
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+HashRing::HashRing(size_t virtualNodes)
+    : m_virtualNodes(std::max<size_t>(1, virtualNodes)) {
+}
+
+void HashRing::addNode(const std::string& node) {
+    auto it = std::lower_bound(m_nodes.begin(), m_nodes.end(), node);
+    if (it != m_nodes.end() && *it == node) {
+        return;
+    }
+    m_nodes.insert(it, node);
+    rebuild();
+}
+
+/*
+ * Points recalculés à chaque ajout (N x V hachages, au démarrage). À hachage égal, le nom du nœud départage : l'ordre ne dépend
+ * pas de l'ordre d'arrivée des membres.
+ */
+void HashRing::rebuild() {
+    m_points.clear();
+    m_points.reserve(m_nodes.size() * m_virtualNodes);
+    for (uint32_t node = 0; node < m_nodes.size(); ++node) {
+        for (size_t i = 0; i < m_virtualNodes; ++i) {
+            m_points.push_back(Point{ringHash(m_nodes[node] + "#" + std::to_string(i)), node});
+        }
+    }
+    std::sort(m_points.begin(), m_points.end(), [](const Point& a, const Point& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.node < b.node;
+    });
+}
+
+/* Premier point à partir du hachage de la clé, en repartant du début après le dernier */
+const std::string& HashRing::nodeFor(const std::string& key) const {
+    static const std::string none;
+    if (m_points.empty()) {
+        return none;
+    }
+    uint64_t hash = ringHash(key);
+    auto it = std::lower_bound(m_points.begin(), m_points.end(), hash,
+                               [](const Point& point, uint64_t value) { return point.hash < value; });
+    if (it == m_points.end()) {
+        it = m_points.begin();
+    }
+    return m_nodes[it->node];
+}
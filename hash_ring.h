@@ -0,0 +1,67 @@
+/*
+ * hash_ring.h
+ *
+ * Anneau de hachage cohérent : associe chaque nom d'utilisateur à son
+ * nœud de rattachement dans une grappe.
+ *
+ * Chaque nœud occupe plusieurs points de l'anneau (nœuds virtuels,
+ * hachage de "<nœud>#<i>") ; un nom appartient au nœud du premier
+ * point qui suit son propre hachage. Avec V nœuds virtuels par nœud,
+ * la charge de chacun est proche de 1/N, et l'arrivée ou le départ
+ * d'un nœud ne déplace que les noms des arcs qu'il prend ou rend :
+ * environ 1/N des utilisateurs, les autres gardent leur nœud.
+ *
+ * Le hachage (FNV-1a suivi d'un mélange splitmix64) ne dépend ni du
+ * compilateur ni du processus : tous les nœuds qui ont la même liste
+ * de membres calculent le même anneau.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef HASH_RING_H
+#define HASH_RING_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+constexpr size_t DEFAULT_VIRTUAL_NODES = 128;   /* Points par nœud sur l'anneau */
+
+/* Hachage 64 bits stable d'une chaîne */
+uint64_t ringHash(const std::string& key);
+
+/*
+ * Classe HashRing
+ *
+ * Non synchronisée : la grappe la construit avant le démarrage des
+ * threads, puis ne fait que la lire (voir ClusterDirectory). Une
+ * recherche est une dichotomie sur les points.
+ */
+class HashRing {
+public:
+    explicit HashRing(size_t virtualNodes = DEFAULT_VIRTUAL_NODES);
+
+    /* Ajout d'un membre ; sans effet s'il est déjà présent */
+    void addNode(const std::string& node);
+
+    bool empty() const { return m_nodes.empty(); }
+    const std::vector<std::string>& nodes() const { return m_nodes; }
+
+    /* Nœud de rattachement d'une clé ; vide si l'anneau est vide */
+    const std::string& nodeFor(const std::string& key) const;
+
+private:
+    struct Point {
+        uint64_t hash;
+        uint32_t node;      /* Index dans m_nodes */
+    };
+
+    void rebuild();
+
+    size_t m_virtualNodes;
+    std::vector<std::string> m_nodes;   /* Membres, triés par nom */
+    std::vector<Point> m_points;        /* Triés par hachage      */
+};
+
+#endif /* HASH_RING_H */
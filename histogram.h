@@ -0,0 +1,143 @@
+/*
+ * histogram.h
+ *
+ * Histogramme log-linéaire (à la HdrHistogram) de valeurs entières,
+ * typiquement des durées en nanosecondes.
+ *
+ * Les valeurs inférieures à 128 ont chacune leur case ; au-delà, chaque
+ * puissance de deux est découpée en 64 cases de même largeur. L'erreur
+ * relative d'un percentile est donc inférieure à 1/64 (~1,6 %) sur toute
+ * la plage de uint64_t, pour un tableau fixe de HISTOGRAM_BUCKETS cases
+ * (aucune allocation pendant l'enregistrement).
+ *
+ * Un seul thread écrit dans un histogramme (record) ; n'importe quel
+ * thread peut le lire en même temps (merge, percentile) sans verrou :
+ * les compteurs sont des atomiques lus et écrits en relaxed, sans
+ * instruction verrouillée côté écriture. Une lecture concurrente voit
+ * un état éventuellement décalé de quelques valeurs, jamais incohérent
+ * case par case.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+constexpr unsigned HISTOGRAM_SUB_BITS = 6;   /* 64 cases par puissance de deux */
+constexpr size_t HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS;
+
+class Histogram {
+public:
+    Histogram() {
+        reset();
+    }
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    /* Enregistrement d'une valeur (thread propriétaire uniquement) */
+    void record(uint64_t value) {
+        bump(m_counts[bucketOf(value)], 1);
+        bump(m_total, 1);
+        if (value > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /* Ajout du contenu d'un autre histogramme (le thread qui écrit dans celui-ci) */
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            uint64_t count = other.m_counts[i].load(std::memory_order_relaxed);
+            if (count != 0) {
+                bump(m_counts[i], count);
+            }
+        }
+        bump(m_total, other.m_total.load(std::memory_order_relaxed));
+        uint64_t otherMax = other.m_max.load(std::memory_order_relaxed);
+        if (otherMax > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(otherMax, std::memory_order_relaxed);
+        }
+    }
+
+    void reset() {
+        for (auto& count : m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        m_total.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return m_total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    /*
+     * Valeur au percentile donné (0 à 100) : borne haute de la case qui
+     * contient la valeur de ce rang, plafonnée au maximum observé.
+     * 0 si l'histogramme est vide.
+     */
+    uint64_t percentile(double percent) const {
+        uint64_t total = 0;
+        for (const auto& count : m_counts) {
+            total += count.load(std::memory_order_relaxed);
+        }
+        if (total == 0) {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(total) + 0.5);
+        if (rank < 1) {
+            rank = 1;
+        }
+        if (rank > total) {
+            rank = total;
+        }
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            seen += m_counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t upper = upperBound(i);
+                uint64_t observed = max();
+                return (observed != 0 && upper > observed) ? observed : upper;
+            }
+        }
+        return max();
+    }
+
+    /* Case d'une valeur */
+    static size_t bucketOf(uint64_t value) {
+        if (value < (uint64_t(1) << (HISTOGRAM_SUB_BITS + 1))) {
+            return static_cast<size_t>(value);
+        }
+        unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(value));
+        unsigned shift = msb - HISTOGRAM_SUB_BITS;
+        return (static_cast<size_t>(shift) << HISTOGRAM_SUB_BITS) + static_cast<size_t>(value >> shift);
+    }
+
+    /* Plus grande valeur d'une case */
+    static uint64_t upperBound(size_t bucket) {
+        if (bucket < (size_t(1) << (HISTOGRAM_SUB_BITS + 1))) {
+            return bucket;
+        }
+        unsigned shift = static_cast<unsigned>(bucket >> HISTOGRAM_SUB_BITS) - 1;
+        uint64_t sub = (bucket & ((size_t(1) << HISTOGRAM_SUB_BITS) - 1)) + (uint64_t(1) << HISTOGRAM_SUB_BITS);
+        return ((sub + 1) << shift) - 1;
+    }
+
+private:
+    /* Incrément sans instruction verrouillée (un seul écrivain) */
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> m_counts;
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_max;
+};
+
+#endif /* HISTOGRAM_H */
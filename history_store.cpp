@@ -0,0 +1,474 @@
+/*
+ * history_store.cpp
+ *
+ * Implémentation de l'historique segmenté sur disque.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "history_store.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* ========================================================================== */
+/*                         OUTILS FICHIERS                                    */
+/* ========================================================================== */
+
+namespace {
+
+constexpr int SEGMENT_NAME_DIGITS = 20;   /* Numéro de séquence sur 20 chiffres */
+
+/* Descripteur fermé automatiquement */
+struct FileDescriptor {
+    int fd;
+    explicit FileDescriptor(int value) : fd(value) {}
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+};
+
+/* Projection en lecture seule libérée automatiquement */
+struct ReadOnlyMapping {
+    void* address;
+    size_t size;
+    ReadOnlyMapping(int fd, size_t bytes) : address(MAP_FAILED), size(bytes) {
+        if (bytes > 0) {
+            address = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        }
+    }
+    ~ReadOnlyMapping() {
+        if (address != MAP_FAILED) {
+            munmap(address, size);
+        }
+    }
+    ReadOnlyMapping(const ReadOnlyMapping&) = delete;
+    ReadOnlyMapping& operator=(const ReadOnlyMapping&) = delete;
+};
+
+/* pread() complet ; false si le fichier est plus court */
+bool readFully(int fd, char* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t got = pread(fd, buffer, size, offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        buffer += got;
+        size -= static_cast<size_t>(got);
+        offset += got;
+    }
+    return true;
+}
+
+/* pwrite() complet ; lève une exception en cas d'erreur */
+void writeFully(int fd, const char* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, buffer, size, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            throw std::runtime_error("Erreur d'écriture de l'historique");
+        }
+        buffer += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+}
+
+} // namespace
+
+/* ========================================================================== */
+/*                            CONSTRUCTION                                    */
+/* ========================================================================== */
+
+HistoryStore::HistoryStore()
+    : m_nextSeq(1), m_lastTimestamp(0), m_dataFd(-1), m_indexFd(-1),
+      m_index(nullptr), m_indexCapacity(0), m_dataSize(0) {
+}
+
+HistoryStore::~HistoryStore() {
+    close();
+}
+
+std::string HistoryStore::segmentPath(uint64_t firstSeq, const char* extension) const {
+    char name[SEGMENT_NAME_DIGITS + 1];
+    snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(firstSeq));
+    return m_options.directory + "/" + name + extension;
+}
+
+/*
+ * Ouvre l'historique : les segments existants sont relus (seul leur
+ * index est parcouru) et le plus récent redevient le segment actif.
+ */
+void HistoryStore::open(const HistoryOptions& options) {
+    LockGuard<HistoryMutex> lock(m_mutex);
+    m_options = options;
+
+    if (mkdir(m_options.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Impossible de créer le répertoire " + m_options.directory);
+    }
+
+    /* Recherche des index "<20 chiffres>.idx" */
+    std::vector<uint64_t> segments;
+    DIR* dir = opendir(m_options.directory.c_str());
+    if (dir == nullptr) {
+        throw std::runtime_error("Impossible d'ouvrir le répertoire " + m_options.directory);
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() == SEGMENT_NAME_DIGITS + 4 && name.compare(SEGMENT_NAME_DIGITS, 4, ".idx") == 0
+                && std::all_of(name.begin(), name.begin() + SEGMENT_NAME_DIGITS, ::isdigit)) {
+            segments.push_back(std::stoull(name.substr(0, SEGMENT_NAME_DIGITS)));
+        }
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+
+    for (size_t i = 0; i < segments.size(); ++i) {
+        recoverSegment(segments[i], i + 1 == segments.size());
+    }
+    if (m_segments.empty()) {
+        createSegment(m_nextSeq);
+    }
+    applyRetention();
+}
+
+void HistoryStore::close() {
+    LockGuard<HistoryMutex> lock(m_mutex);
+    closeActive();
+    m_segments.clear();
+}
+
+/* ========================================================================== */
+/*                              SEGMENTS                                      */
+/* ========================================================================== */
+
+/*
+ * Relit l'index d'un segment existant. Les entrées valides sont
+ * contiguës depuis le début : la première entrée incomplète (arrêt
+ * brutal pendant un ajout) marque la fin du segment. Il en va de même
+ * d'une entrée dont la longueur dépasse MAX_COMPACT_SIZE ou qui sort du
+ * .dat (index corrompu, .dat tronqué) : lue telle quelle, elle ferait
+ * allouer jusqu'à 4 Gio à chaque GET_HISTORY.
+ *
+ * Un index vide ou plus court qu'une entrée (arrêt brutal dans
+ * createSegment, avant son dimensionnement) est un segment vide ; s'il
+ * est le plus récent, il est recréé comme segment actif.
+ */
+void HistoryStore::recoverSegment(uint64_t firstSeq, bool active) {
+    int fd = ::open(segmentPath(firstSeq, ".idx").c_str(), (active ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Impossible d'ouvrir l'index du segment " + std::to_string(firstSeq));
+    }
+
+    struct stat info;
+    fstat(fd, &info);
+    uint64_t capacity = static_cast<uint64_t>(info.st_size) / sizeof(IndexEntry);
+    if (capacity == 0) {
+        ::close(fd);
+        m_nextSeq = firstSeq;
+        if (active) {
+            createSegment(firstSeq);
+        } else {
+            m_segments.push_back({firstSeq, 0, 0, 0});
+        }
+        return;
+    }
+
+    void* map = mmap(nullptr, capacity * sizeof(IndexEntry), PROT_READ | (active ? PROT_WRITE : 0),
+                     MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("Impossible de projeter l'index du segment " + std::to_string(firstSeq));
+    }
+
+    struct stat dataInfo;
+    uint64_t dataBytes = ::stat(segmentPath(firstSeq, ".dat").c_str(), &dataInfo) == 0
+                         ? static_cast<uint64_t>(dataInfo.st_size) : 0;
+    auto fits = [dataBytes](const IndexEntry& entry) {
+        return entry.length <= MAX_COMPACT_SIZE && entry.offset <= dataBytes
+               && entry.length <= dataBytes - entry.offset;
+    };
+
+    const IndexEntry* entries = static_cast<const IndexEntry*>(map);
+    Segment segment = {firstSeq, 0, 0, 0};
+    while (segment.count < capacity && entries[segment.count].valid == 1
+           && entries[segment.count].seq == firstSeq + segment.count && fits(entries[segment.count])) {
+        segment.count++;
+    }
+    if (segment.count > 0) {
+        segment.firstTimestamp = entries[0].timestamp;
+        segment.lastTimestamp = entries[segment.count - 1].timestamp;
+        m_lastTimestamp = std::max(m_lastTimestamp, segment.lastTimestamp);
+    }
+    m_segments.push_back(segment);
+    m_nextSeq = firstSeq + segment.count;
+
+    if (!active) {
+        munmap(map, capacity * sizeof(IndexEntry));
+        ::close(fd);
+        return;
+    }
+
+    m_indexFd = fd;
+    m_index = static_cast<IndexEntry*>(map);
+    m_indexCapacity = capacity;
+    m_dataFd = ::open(segmentPath(firstSeq, ".dat").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_dataFd < 0) {
+        throw std::runtime_error("Impossible d'ouvrir le segment " + std::to_string(firstSeq));
+    }
+
+    /* Les octets écrits après la dernière entrée valide sont abandonnés */
+    m_dataSize = segment.count > 0 ? entries[segment.count - 1].offset + entries[segment.count - 1].length : 0;
+    if (ftruncate(m_dataFd, static_cast<off_t>(m_dataSize)) != 0) {
+        throw std::runtime_error("Impossible de tronquer le segment " + std::to_string(firstSeq));
+    }
+    for (uint64_t i = segment.count; i < capacity && m_index[i].valid != 0; ++i) {
+        m_index[i].valid = 0;
+    }
+}
+
+/*
+ * Crée un segment vide : l'index est dimensionné d'emblée (fichier
+ * creux) et projeté en lecture/écriture.
+ */
+void HistoryStore::createSegment(uint64_t firstSeq) {
+    m_dataFd = ::open(segmentPath(firstSeq, ".dat").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    m_indexFd = ::open(segmentPath(firstSeq, ".idx").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_dataFd < 0 || m_indexFd < 0) {
+        throw std::runtime_error("Impossible de créer le segment " + std::to_string(firstSeq));
+    }
+
+    m_indexCapacity = std::max<uint32_t>(1, m_options.segmentMaxEntries);
+    size_t indexBytes = m_indexCapacity * sizeof(IndexEntry);
+    if (ftruncate(m_indexFd, static_cast<off_t>(indexBytes)) != 0) {
+        throw std::runtime_error("Impossible de dimensionner l'index du segment " + std::to_string(firstSeq));
+    }
+    void* map = mmap(nullptr, indexBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_indexFd, 0);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Impossible de projeter l'index du segment " + std::to_string(firstSeq));
+    }
+    m_index = static_cast<IndexEntry*>(map);
+    m_dataSize = 0;
+    m_segments.push_back({firstSeq, 0, 0, 0});
+}
+
+void HistoryStore::closeActive() {
+    if (m_index != nullptr) {
+        munmap(m_index, m_indexCapacity * sizeof(IndexEntry));
+        m_index = nullptr;
+    }
+    if (m_indexFd >= 0) {
+        ::close(m_indexFd);
+        m_indexFd = -1;
+    }
+    if (m_dataFd >= 0) {
+        ::close(m_dataFd);
+        m_dataFd = -1;
+    }
+}
+
+void HistoryStore::rollSegment() {
+    closeActive();
+    createSegment(m_nextSeq);
+    applyRetention();
+}
+
+/*
+ * Supprime les segments les plus anciens (jamais le segment actif) :
+ * au-delà de maxSegments, ou dont le dernier message dépasse maxAge.
+ * Un lecteur qui a déjà ouvert les fichiers continue de les lire.
+ */
+void HistoryStore::applyRetention() {
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+
+    while (m_segments.size() > 1) {
+        const Segment& oldest = m_segments.front();
+        bool tooMany = m_options.maxSegments > 0 && m_segments.size() > m_options.maxSegments;
+        bool tooOld = m_options.maxAgeSeconds > 0 && oldest.lastTimestamp < now - m_options.maxAgeSeconds;
+        if (!tooMany && !tooOld && oldest.count > 0) {
+            break;
+        }
+        unlink(segmentPath(oldest.firstSeq, ".dat").c_str());
+        unlink(segmentPath(oldest.firstSeq, ".idx").c_str());
+        m_segments.pop_front();
+    }
+}
+
+/* ========================================================================== */
+/*                               AJOUT                                        */
+/* ========================================================================== */
+
+/*
+ * Ajoute un message en fin d'historique.
+ * Le message est d'abord écrit dans le .dat, puis son entrée d'index
+ * est remplie ; le champ valid est écrit en dernier.
+ * Les horodatages de l'index sont rendus croissants (recherche par date).
+ */
+uint64_t HistoryStore::append(const Message& msg) {
+    std::string encoded;
+    msg.serializeCompact(encoded);
+
+    LockGuard<HistoryMutex> lock(m_mutex);
+
+    if (m_index == nullptr) {
+        throw std::runtime_error("Historique non ouvert");
+    }
+    if (m_segments.back().count > 0 && (m_segments.back().count >= m_indexCapacity
+                                        || m_dataSize + encoded.size() > m_options.segmentMaxBytes)) {
+        rollSegment();
+    }
+
+    Segment& active = m_segments.back();
+    writeFully(m_dataFd, encoded.data(), encoded.size(), static_cast<off_t>(m_dataSize));
+
+    int64_t timestamp = std::max(m_lastTimestamp, static_cast<int64_t>(msg.receivedAt));
+    IndexEntry& entry = m_index[active.count];
+    entry.seq = m_nextSeq;
+    entry.timestamp = timestamp;
+    entry.offset = m_dataSize;
+    entry.length = static_cast<uint32_t>(encoded.size());
+    entry.valid = 1;
+
+    if (active.count == 0) {
+        active.firstTimestamp = timestamp;
+    }
+    active.lastTimestamp = timestamp;
+    active.count++;
+    m_dataSize += encoded.size();
+    m_lastTimestamp = timestamp;
+    return m_nextSeq++;
+}
+
+/* ========================================================================== */
+/*                              LECTURE                                       */
+/* ========================================================================== */
+
+/*
+ * Parcourt les segments à partir de fromSeq. La liste des segments est
+ * copiée sous verrou, les lectures se font ensuite sans verrou : seules
+ * les entrées déjà publiées (count) sont lues. Un enregistrement illisible
+ * (.dat abîmé) est sauté : la lecture continue au suivant.
+ */
+std::vector<HistoryEntry> HistoryStore::read(uint64_t fromSeq, size_t maxCount, size_t maxScan,
+                                             const Filter& filter, uint64_t& nextSeq) const {
+    std::vector<Segment> segments;
+    {
+        LockGuard<HistoryMutex> lock(m_mutex);
+        segments.assign(m_segments.begin(), m_segments.end());
+    }
+
+    std::vector<HistoryEntry> result;
+    size_t scanned = 0;
+    nextSeq = fromSeq;
+    std::vector<char> buffer;
+
+    for (const Segment& segment : segments) {
+        if (result.size() >= maxCount || scanned >= maxScan) {
+            break;
+        }
+        if (nextSeq >= segment.firstSeq + segment.count) {
+            continue;
+        }
+        nextSeq = std::max(nextSeq, segment.firstSeq);   /* Messages supprimés par la rétention */
+
+        FileDescriptor indexFile(::open(segmentPath(segment.firstSeq, ".idx").c_str(), O_RDONLY | O_CLOEXEC));
+        FileDescriptor dataFile(::open(segmentPath(segment.firstSeq, ".dat").c_str(), O_RDONLY | O_CLOEXEC));
+        if (indexFile.fd < 0 || dataFile.fd < 0) {
+            continue;   /* Segment supprimé entre-temps */
+        }
+        ReadOnlyMapping mapping(indexFile.fd, segment.count * sizeof(IndexEntry));
+        if (mapping.address == MAP_FAILED) {
+            continue;
+        }
+        const IndexEntry* entries = static_cast<const IndexEntry*>(mapping.address);
+
+        for (uint64_t i = nextSeq - segment.firstSeq;
+             i < segment.count && result.size() < maxCount && scanned < maxScan; ++i) {
+            const IndexEntry& entry = entries[i];
+            scanned++;
+            nextSeq = segment.firstSeq + i + 1;
+
+            if (entry.length > MAX_COMPACT_SIZE) {
+                continue;   /* Index modifié depuis la reprise : pas d'allocation démesurée */
+            }
+            buffer.resize(entry.length);
+
+            if (!readFully(dataFile.fd, buffer.data(), entry.length, static_cast<off_t>(entry.offset))) {
+                continue;
+            }
+            Message msg;
+            try {
+                msg = Message::deserializeCompact(buffer.data(), buffer.size());
+            } catch (const std::exception&) {
+                continue;
+            }
+            if (!filter || filter(msg)) {
+                result.push_back({entry.seq, msg});
+            }
+        }
+    }
+    return result;
+}
+
+/*
+ * Recherche par date : segment par segment via les bornes gardées en
+ * mémoire, puis dichotomie dans l'index du segment trouvé.
+ */
+uint64_t HistoryStore::seqAtTime(time_t timestamp) const {
+    std::vector<Segment> segments;
+    uint64_t next;
+    {
+        LockGuard<HistoryMutex> lock(m_mutex);
+        segments.assign(m_segments.begin(), m_segments.end());
+        next = m_nextSeq;
+    }
+
+    for (const Segment& segment : segments) {
+        if (segment.count == 0 || segment.lastTimestamp < timestamp) {
+            continue;
+        }
+        if (segment.firstTimestamp >= timestamp) {
+            return segment.firstSeq;
+        }
+
+        FileDescriptor indexFile(::open(segmentPath(segment.firstSeq, ".idx").c_str(), O_RDONLY | O_CLOEXEC));
+        if (indexFile.fd < 0) {
+            continue;
+        }
+        ReadOnlyMapping mapping(indexFile.fd, segment.count * sizeof(IndexEntry));
+        if (mapping.address == MAP_FAILED) {
+            continue;
+        }
+        const IndexEntry* entries = static_cast<const IndexEntry*>(mapping.address);
+        const IndexEntry* found = std::lower_bound(entries, entries + segment.count, timestamp,
+            [](const IndexEntry& entry, time_t value) { return entry.timestamp < value; });
+        return segment.firstSeq + static_cast<uint64_t>(found - entries);
+    }
+    return next;
+}
+
+uint64_t HistoryStore::firstSeq() const {
+    LockGuard<HistoryMutex> lock(m_mutex);
+    return m_segments.empty() ? m_nextSeq : m_segments.front().firstSeq;
+}
+
+uint64_t HistoryStore::nextSeq() const {
+    LockGuard<HistoryMutex> lock(m_mutex);
+    return m_nextSeq;
+}
@@ -0,0 +1,133 @@
+/*
+ * history_store.h
+ *
+ * Historique persistant des messages livrés.
+ *
+ * L'historique est un journal en ajout seul découpé en segments, dans
+ * un répertoire dédié. Chaque segment est formé de deux fichiers :
+ *   - <premier n°>.dat : messages encodés au format compact, bout à bout
+ *   - <premier n°>.idx : index à entrées de taille fixe (n° de séquence,
+ *                        horodatage, position dans le .dat), projeté en
+ *                        mémoire (mmap)
+ *
+ * Chaque message reçoit un numéro de séquence croissant. Les lectures
+ * (par numéro ou par date) passent par l'index puis lisent uniquement
+ * les messages demandés avec pread() : un segment n'est jamais chargé
+ * en entier, et la mémoire utilisée ne dépend pas de la taille de
+ * l'historique.
+ *
+ * Rétention : les segments les plus anciens sont supprimés au-delà de
+ * maxSegments segments ou quand tous leurs messages dépassent maxAge.
+ * Elle s'applique segment par segment, à chaque changement de segment.
+ *
+ * Linux uniquement (mmap, pread).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include "message.h"
+#include "lock_profiler.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+struct HistoryOptions {
+    std::string directory = "history";            /* Répertoire des segments      */
+    uint64_t segmentMaxBytes = 16 * 1024 * 1024;  /* Taille max d'un .dat         */
+    uint32_t segmentMaxEntries = 65536;           /* Messages max par segment     */
+    size_t maxSegments = 16;                      /* Segments gardés (0 = tous)   */
+    int64_t maxAgeSeconds = 0;                    /* Âge max (0 = illimité)       */
+};
+
+/* Message de l'historique avec son numéro de séquence */
+struct HistoryEntry {
+    uint64_t seq;
+    Message message;
+};
+
+/*
+ * Classe HistoryStore
+ *
+ * append() est appelée par le thread de livraison, les lectures par
+ * les boucles d'événements ; un mutex protège la liste des segments
+ * et le segment actif, les lectures de messages se font hors verrou.
+ */
+class HistoryStore {
+public:
+    using Filter = std::function<bool(const Message&)>;
+
+    HistoryStore();
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    /* Ouverture (ou création) du répertoire ; lève std::runtime_error */
+    void open(const HistoryOptions& options);
+    void close();
+
+    /* Ajout d'un message ; retourne son numéro de séquence */
+    uint64_t append(const Message& msg);
+
+    /*
+     * Lecture à partir du numéro fromSeq : au plus maxScan messages sont
+     * examinés et au plus maxCount acceptés par le filtre sont retournés.
+     * nextSeq reçoit le numéro à partir duquel reprendre la lecture.
+     */
+    std::vector<HistoryEntry> read(uint64_t fromSeq, size_t maxCount, size_t maxScan,
+                                   const Filter& filter, uint64_t& nextSeq) const;
+
+    /* Numéro du premier message horodaté à timestamp ou après */
+    uint64_t seqAtTime(time_t timestamp) const;
+
+    /* Premier numéro encore disponible / numéro du prochain message */
+    uint64_t firstSeq() const;
+    uint64_t nextSeq() const;
+
+private:
+    /* Entrée de l'index (.idx), 32 octets */
+    struct IndexEntry {
+        uint64_t seq;
+        int64_t timestamp;
+        uint64_t offset;            /* Position dans le .dat                  */
+        uint32_t length;            /* Taille du message encodé               */
+        uint32_t valid;             /* 1 une fois l'entrée complète           */
+    };
+
+    struct Segment {
+        uint64_t firstSeq;
+        uint64_t count;
+        int64_t firstTimestamp;
+        int64_t lastTimestamp;
+    };
+
+    using HistoryMutex = ProfiledMutex<LockClass::History>;
+
+    std::string segmentPath(uint64_t firstSeq, const char* extension) const;
+    void recoverSegment(uint64_t firstSeq, bool active);
+    void createSegment(uint64_t firstSeq);
+    void closeActive();
+    void rollSegment();
+    void applyRetention();
+
+    HistoryOptions m_options;
+    mutable HistoryMutex m_mutex;
+    std::deque<Segment> m_segments;     /* Du plus ancien au segment actif    */
+    uint64_t m_nextSeq;
+    int64_t m_lastTimestamp;            /* Horodatages de l'index croissants  */
+
+    /* Segment actif (en écriture) */
+    int m_dataFd;
+    int m_indexFd;
+    IndexEntry* m_index;                /* Projection de l'index actif        */
+    uint64_t m_indexCapacity;           /* Entrées disponibles dans l'index   */
+    uint64_t m_dataSize;
+};
+
+#endif /* HISTORY_STORE_H */
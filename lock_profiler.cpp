@@ -0,0 +1,332 @@
+/*
+ * lock_profiler.cpp
+ *
+ * Implémentation de la mesure de contention des verrous (voir
+ * lock_profiler.h). Sans LOCK_PROFILING, seuls les noms et un rapport
+ * vide sont compilés.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "lock_profiler.h"
+
+#ifdef LOCK_PROFILING
+#include "histogram.h"
+#include <vector>
+#include <map>
+#include <tuple>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+constexpr size_t LOCK_SITE_SLOTS = 128;   /* Sites distincts suivis par thread  */
+constexpr size_t LOCK_SHARED_DEPTH = 8;   /* Prises partagées imbriquées suivies */
+constexpr size_t LOCK_TOP_SITES = 5;      /* Détenteurs affichés par famille     */
+#endif
+
+const char* lockClassName(LockClass lockClass) {
+    switch (lockClass) {
+        case LockClass::Users:      return "users";
+        case LockClass::Queue:      return "queue";
+        case LockClass::History:    return "history";
+        case LockClass::Log:        return "log";
+        case LockClass::Mailbox:    return "mailbox";
+        case LockClass::Connection: return "connection";
+        case LockClass::Pool:       return "pool";
+        case LockClass::Cluster:    return "cluster";
+        case LockClass::Count:      break;
+    }
+    return "?";
+}
+
+#ifndef LOCK_PROFILING
+
+std::string lockProfileReport() {
+    return std::string();
+}
+
+#else
+
+/* ========================================================================== */
+/*                        BLOCS PAR THREAD                                    */
+/* ========================================================================== */
+
+namespace {
+
+/* Incrément sans instruction verrouillée (un seul écrivain) */
+void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/* Totaux d'une famille de verrous */
+struct ClassSlot {
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<Histogram*> wait{nullptr};
+    std::atomic<Histogram*> hold{nullptr};
+};
+
+/*
+ * Totaux d'un site d'appel. file est publié (release) en dernier :
+ * un lecteur qui le voit non nul voit aussi line, function et lockClass.
+ */
+struct SiteSlot {
+    std::atomic<const char*> file{nullptr};
+    uint32_t line = 0;
+    const char* function = nullptr;
+    LockClass lockClass = LockClass::Count;
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> waitNanos{0};
+    std::atomic<uint64_t> holdNanos{0};
+};
+
+struct alignas(64) Block {
+    ClassSlot classes[LOCK_CLASSES];
+    SiteSlot sites[LOCK_SITE_SLOTS];
+    std::atomic<uint64_t> droppedSites{0};    /* Prises hors table (pleine)   */
+};
+
+/*
+ * Blocs inscrits. Jamais détruits : un verrou peut encore être pris
+ * pendant la destruction des objets globaux (journal, historique).
+ */
+struct Registry {
+    std::mutex mutex;                         /* Inscription et lecture        */
+    std::vector<Block*> blocks;
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+Block& localBlock() {
+    thread_local Block* block = nullptr;
+    if (block == nullptr) {
+        block = new Block();
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.blocks.push_back(block);
+    }
+    return *block;
+}
+
+/* Histogramme créé à la première valeur, publié entièrement initialisé */
+Histogram& histogramOf(std::atomic<Histogram*>& slot) {
+    Histogram* histogram = slot.load(std::memory_order_relaxed);
+    if (histogram == nullptr) {
+        histogram = new Histogram();
+        slot.store(histogram, std::memory_order_release);
+    }
+    return *histogram;
+}
+
+/* Case d'un site dans la table du thread (sondage linéaire), nullptr si pleine */
+SiteSlot* findSite(Block& block, LockClass lockClass, const LockSite& site) {
+    const char* file = site.file_name();
+    size_t hash = (reinterpret_cast<uintptr_t>(file) >> 3) ^ (site.line() * 0x9E3779B1u)
+                  ^ static_cast<size_t>(lockClass);
+    for (size_t probe = 0; probe < LOCK_SITE_SLOTS; ++probe) {
+        SiteSlot& slot = block.sites[(hash + probe) % LOCK_SITE_SLOTS];
+        const char* slotFile = slot.file.load(std::memory_order_relaxed);
+        if (slotFile == nullptr) {
+            slot.line = site.line();
+            slot.function = site.function_name();
+            slot.lockClass = lockClass;
+            slot.file.store(file, std::memory_order_release);
+            return &slot;
+        }
+        if (slotFile == file && slot.line == site.line() && slot.lockClass == lockClass) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+/* Prises partagées en cours du thread */
+struct SharedHold {
+    const void* mutex;
+    LockClass lockClass;
+    LockSite site;
+    uint64_t acquiredAt;
+};
+
+thread_local SharedHold t_sharedHolds[LOCK_SHARED_DEPTH];
+thread_local size_t t_sharedDepth = 0;
+
+} /* namespace */
+
+/* ========================================================================== */
+/*                           ENREGISTREMENT                                   */
+/* ========================================================================== */
+
+uint64_t lockClockNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void recordLockAcquired(LockClass lockClass, const LockSite& site, uint64_t waitNanos, bool contended) {
+    Block& block = localBlock();
+    ClassSlot& totals = block.classes[static_cast<size_t>(lockClass)];
+    bump(totals.acquisitions, 1);
+    if (contended) {
+        bump(totals.contended, 1);
+    }
+    histogramOf(totals.wait).record(waitNanos);
+
+    SiteSlot* slot = findSite(block, lockClass, site);
+    if (slot == nullptr) {
+        bump(block.droppedSites, 1);
+        return;
+    }
+    bump(slot->acquisitions, 1);
+    if (contended) {
+        bump(slot->contended, 1);
+    }
+    bump(slot->waitNanos, waitNanos);
+}
+
+void recordLockReleased(LockClass lockClass, const LockSite& site, uint64_t holdNanos) {
+    Block& block = localBlock();
+    histogramOf(block.classes[static_cast<size_t>(lockClass)].hold).record(holdNanos);
+
+    SiteSlot* slot = findSite(block, lockClass, site);
+    if (slot != nullptr) {
+        bump(slot->holdNanos, holdNanos);
+    }
+}
+
+/* Au-delà de LOCK_SHARED_DEPTH prises imbriquées, la possession n'est pas mesurée */
+void beginSharedHold(const void* mutex, LockClass lockClass, const LockSite& site, uint64_t acquiredAt) {
+    if (t_sharedDepth < LOCK_SHARED_DEPTH) {
+        t_sharedHolds[t_sharedDepth++] = SharedHold{mutex, lockClass, site, acquiredAt};
+    }
+}
+
+void endSharedHold(const void* mutex) {
+    for (size_t i = t_sharedDepth; i > 0; --i) {
+        SharedHold& hold = t_sharedHolds[i - 1];
+        if (hold.mutex == mutex) {
+            recordLockReleased(hold.lockClass, hold.site, lockClockNanos() - hold.acquiredAt);
+            hold = t_sharedHolds[--t_sharedDepth];
+            return;
+        }
+    }
+}
+
+/* ========================================================================== */
+/*                               RAPPORT                                      */
+/* ========================================================================== */
+
+namespace {
+
+std::string micros(uint64_t nanos) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f", static_cast<double>(nanos) / 1000.0);
+    return text;
+}
+
+/* Totaux d'un site, tous threads confondus */
+struct SiteTotals {
+    const char* function = nullptr;
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0;
+    uint64_t waitNanos = 0;
+    uint64_t holdNanos = 0;
+};
+
+} /* namespace */
+
+/*
+ * Une ligne par famille :
+ *   lock_<famille> acquisitions=<n> contended=<n> wait_us p50=... p99=... max=...
+ *                  hold_us p50=... p99=... max=...
+ * puis jusqu'à LOCK_TOP_SITES sites, du plus long temps de possession
+ * cumulé au plus court :
+ *   lock_<famille>_top<k> site=<fichier>:<ligne> acquisitions=<n> contended=<n>
+ *                         wait_us=<total> hold_us=<total> function=<signature>
+ */
+std::string lockProfileReport() {
+    uint64_t acquisitions[LOCK_CLASSES] = {};
+    uint64_t contended[LOCK_CLASSES] = {};
+    std::vector<std::unique_ptr<Histogram>> waits;
+    std::vector<std::unique_ptr<Histogram>> holds;
+    for (size_t i = 0; i < LOCK_CLASSES; ++i) {
+        waits.push_back(std::make_unique<Histogram>());
+        holds.push_back(std::make_unique<Histogram>());
+    }
+    std::map<std::tuple<size_t, std::string, uint32_t>, SiteTotals> sites;
+    uint64_t dropped = 0;
+
+    Registry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (Block* block : reg.blocks) {
+            for (size_t i = 0; i < LOCK_CLASSES; ++i) {
+                const ClassSlot& totals = block->classes[i];
+                acquisitions[i] += totals.acquisitions.load(std::memory_order_relaxed);
+                contended[i] += totals.contended.load(std::memory_order_relaxed);
+                if (const Histogram* wait = totals.wait.load(std::memory_order_acquire)) {
+                    waits[i]->merge(*wait);
+                }
+                if (const Histogram* hold = totals.hold.load(std::memory_order_acquire)) {
+                    holds[i]->merge(*hold);
+                }
+            }
+            for (const SiteSlot& slot : block->sites) {
+                const char* file = slot.file.load(std::memory_order_acquire);
+                if (file == nullptr) {
+                    continue;
+                }
+                const char* base = std::strrchr(file, '/');
+                SiteTotals& site = sites[{static_cast<size_t>(slot.lockClass), base ? base + 1 : file, slot.line}];
+                site.function = slot.function;
+                site.acquisitions += slot.acquisitions.load(std::memory_order_relaxed);
+                site.contended += slot.contended.load(std::memory_order_relaxed);
+                site.waitNanos += slot.waitNanos.load(std::memory_order_relaxed);
+                site.holdNanos += slot.holdNanos.load(std::memory_order_relaxed);
+            }
+            dropped += block->droppedSites.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::string report;
+    for (size_t i = 0; i < LOCK_CLASSES; ++i) {
+        std::string name = std::string("lock_") + lockClassName(static_cast<LockClass>(i));
+        report += name + " acquisitions=" + std::to_string(acquisitions[i])
+                  + " contended=" + std::to_string(contended[i])
+                  + " wait_us p50=" + micros(waits[i]->percentile(50.0))
+                  + " p99=" + micros(waits[i]->percentile(99.0))
+                  + " max=" + micros(waits[i]->max())
+                  + " hold_us p50=" + micros(holds[i]->percentile(50.0))
+                  + " p99=" + micros(holds[i]->percentile(99.0))
+                  + " max=" + micros(holds[i]->max()) + "\n";
+
+        std::vector<std::pair<std::string, const SiteTotals*>> top;
+        for (const auto& [key, totals] : sites) {
+            if (std::get<0>(key) == i) {
+                top.emplace_back(std::get<1>(key) + ":" + std::to_string(std::get<2>(key)), &totals);
+            }
+        }
+        std::sort(top.begin(), top.end(), [](const auto& a, const auto& b) {
+            return a.second->holdNanos > b.second->holdNanos;
+        });
+        for (size_t k = 0; k < top.size() && k < LOCK_TOP_SITES; ++k) {
+            const SiteTotals& site = *top[k].second;
+            report += name + "_top" + std::to_string(k + 1) + " site=" + top[k].first
+                      + " acquisitions=" + std::to_string(site.acquisitions)
+                      + " contended=" + std::to_string(site.contended)
+                      + " wait_us=" + micros(site.waitNanos)
+                      + " hold_us=" + micros(site.holdNanos)
+                      + " function=" + site.function + "\n";
+        }
+    }
+    report += "lock_sites_dropped=" + std::to_string(dropped);
+    return report;
+}
+
+#endif /* LOCK_PROFILING */
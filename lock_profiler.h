@@ -0,0 +1,254 @@
+/*
+ * lock_profiler.h
+ *
+ * Mesure de la contention des verrous du serveur, activée à la
+ * compilation (make LOCK_PROFILING=1, qui définit LOCK_PROFILING).
+ *
+ * Les verrous instrumentés sont déclarés avec les types de ce fichier
+ * et pris avec ses gardes :
+ *
+ *     ProfiledMutex<LockClass::History> m_mutex;
+ *     LockGuard<ProfiledMutex<LockClass::History>> lock(m_mutex);
+ *
+ * Sans LOCK_PROFILING, ProfiledMutex est exactement std::mutex (et
+ * ProfiledSharedMutex std::shared_mutex) et les gardes se réduisent à
+ * lock() / unlock() : aucun coût.
+ *
+ * Avec LOCK_PROFILING, chaque prise enregistre, par classe de verrou :
+ *   - le nombre de prises et de prises contendues (verrou déjà tenu)
+ *   - la distribution de l'attente (demande -> obtention)
+ *   - la distribution de la durée de possession (obtention -> libération)
+ * et, par site d'appel (fichier:ligne de la garde, std::source_location),
+ * les mêmes totaux, pour classer les plus gros détenteurs. Les mesures
+ * sont écrites dans des blocs par thread (comme ServerStats) et lues
+ * par lockProfileReport(), affiché par la commande STATS.
+ *
+ * Une reprise après une attente sur variable de condition est attribuée
+ * au site de la bibliothèque standard qui reprend le verrou.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef LOCK_PROFILER_H
+#define LOCK_PROFILER_H
+
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#ifdef LOCK_PROFILING
+#include <source_location>
+#endif
+
+/* Familles de verrous, mesurées séparément */
+enum class LockClass {
+    Users,          /* Shards du registre des utilisateurs        */
+    Queue,          /* Sommeil des files de livraison             */
+    History,        /* Liste des segments et ajout (historique)   */
+    Log,            /* Réveil / flush / inscription du journal    */
+    Mailbox,        /* Shards des boîtes de réception             */
+    Connection,     /* File de sortie d'une connexion             */
+    Pool,           /* Files et sommeil du pool des commandes     */
+    Cluster,        /* Liaisons et présence des autres nœuds      */
+    Count
+};
+
+constexpr size_t LOCK_CLASSES = static_cast<size_t>(LockClass::Count);
+
+/* Nom d'une famille dans les rapports (ex. "users") */
+const char* lockClassName(LockClass lockClass);
+
+/*
+ * Rapport de contention, une ligne par famille puis les plus gros
+ * détenteurs (voir lock_profiler.cpp) ; vide sans LOCK_PROFILING.
+ */
+std::string lockProfileReport();
+
+#ifdef LOCK_PROFILING
+
+using LockSite = std::source_location;
+
+/* Enregistrement d'une prise et d'une libération (lock_profiler.cpp) */
+void recordLockAcquired(LockClass lockClass, const LockSite& site, uint64_t waitNanos, bool contended);
+void recordLockReleased(LockClass lockClass, const LockSite& site, uint64_t holdNanos);
+
+/* Prise partagée : le thread garde la date et le site jusqu'à la libération */
+void beginSharedHold(const void* mutex, LockClass lockClass, const LockSite& site, uint64_t acquiredAt);
+void endSharedHold(const void* mutex);
+
+uint64_t lockClockNanos();
+
+/*
+ * Classe ProfiledMutex
+ *
+ * std::mutex mesuré. La date et le site de la prise sont gardés dans
+ * le verrou lui-même (un seul détenteur à la fois).
+ */
+template <LockClass Class>
+class ProfiledMutex {
+public:
+    ProfiledMutex() = default;
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock(LockSite site = LockSite::current()) {
+        uint64_t start = lockClockNanos();
+        bool contended = !m_mutex.try_lock();
+        if (contended) {
+            m_mutex.lock();
+        }
+        acquired(site, start, contended);
+    }
+
+    bool try_lock(LockSite site = LockSite::current()) {
+        uint64_t start = lockClockNanos();
+        if (!m_mutex.try_lock()) {
+            return false;
+        }
+        acquired(site, start, false);
+        return true;
+    }
+
+    void unlock() {
+        recordLockReleased(Class, m_site, lockClockNanos() - m_acquiredAt);
+        m_mutex.unlock();
+    }
+
+private:
+    void acquired(const LockSite& site, uint64_t start, bool contended) {
+        m_acquiredAt = lockClockNanos();
+        m_site = site;
+        recordLockAcquired(Class, site, m_acquiredAt - start, contended);
+    }
+
+    std::mutex m_mutex;
+    uint64_t m_acquiredAt = 0;      /* Détenteur courant uniquement */
+    LockSite m_site;
+};
+
+/*
+ * Classe ProfiledSharedMutex
+ *
+ * std::shared_mutex mesuré, en mode exclusif comme en mode partagé.
+ */
+template <LockClass Class>
+class ProfiledSharedMutex {
+public:
+    ProfiledSharedMutex() = default;
+    ProfiledSharedMutex(const ProfiledSharedMutex&) = delete;
+    ProfiledSharedMutex& operator=(const ProfiledSharedMutex&) = delete;
+
+    void lock(LockSite site = LockSite::current()) {
+        uint64_t start = lockClockNanos();
+        bool contended = !m_mutex.try_lock();
+        if (contended) {
+            m_mutex.lock();
+        }
+        m_acquiredAt = lockClockNanos();
+        m_site = site;
+        recordLockAcquired(Class, site, m_acquiredAt - start, contended);
+    }
+
+    void unlock() {
+        recordLockReleased(Class, m_site, lockClockNanos() - m_acquiredAt);
+        m_mutex.unlock();
+    }
+
+    void lock_shared(LockSite site = LockSite::current()) {
+        uint64_t start = lockClockNanos();
+        bool contended = !m_mutex.try_lock_shared();
+        if (contended) {
+            m_mutex.lock_shared();
+        }
+        uint64_t acquiredAt = lockClockNanos();
+        recordLockAcquired(Class, site, acquiredAt - start, contended);
+        beginSharedHold(this, Class, site, acquiredAt);
+    }
+
+    void unlock_shared() {
+        endSharedHold(this);
+        m_mutex.unlock_shared();
+    }
+
+private:
+    std::shared_mutex m_mutex;
+    uint64_t m_acquiredAt = 0;      /* Détenteur exclusif uniquement */
+    LockSite m_site;
+};
+
+/* Attente sur un verrou mesuré : la variable de condition générique */
+using LockCondition = std::condition_variable_any;
+
+#else /* !LOCK_PROFILING */
+
+/* Site d'appel ignoré : construit et passé sans coût */
+struct LockSite {
+    static constexpr LockSite current() noexcept { return LockSite(); }
+};
+
+template <LockClass Class>
+using ProfiledMutex = std::mutex;
+
+template <LockClass Class>
+using ProfiledSharedMutex = std::shared_mutex;
+
+using LockCondition = std::condition_variable;
+
+#endif /* LOCK_PROFILING */
+
+/* Prise d'un verrou avec son site si le verrou le mesure */
+template <typename Mutex>
+Mutex& lockAt(Mutex& mutex, [[maybe_unused]] const LockSite& site) {
+    if constexpr (requires { mutex.lock(site); }) {
+        mutex.lock(site);
+    } else {
+        mutex.lock();
+    }
+    return mutex;
+}
+
+template <typename Mutex>
+Mutex& lockSharedAt(Mutex& mutex, [[maybe_unused]] const LockSite& site) {
+    if constexpr (requires { mutex.lock_shared(site); }) {
+        mutex.lock_shared(site);
+    } else {
+        mutex.lock_shared();
+    }
+    return mutex;
+}
+
+/*
+ * Gardes : équivalents de std::lock_guard, std::unique_lock et
+ * std::shared_lock qui transmettent leur site d'appel au verrou.
+ * UniqueLock reste un std::unique_lock (variables de condition).
+ */
+template <typename Mutex>
+class LockGuard {
+public:
+    explicit LockGuard(Mutex& mutex, const LockSite& site = LockSite::current()) : m_mutex(lockAt(mutex, site)) {}
+    ~LockGuard() { m_mutex.unlock(); }
+
+    LockGuard(const LockGuard&) = delete;
+    LockGuard& operator=(const LockGuard&) = delete;
+
+private:
+    Mutex& m_mutex;
+};
+
+template <typename Mutex>
+class UniqueLock : public std::unique_lock<Mutex> {
+public:
+    explicit UniqueLock(Mutex& mutex, const LockSite& site = LockSite::current())
+        : std::unique_lock<Mutex>(lockAt(mutex, site), std::adopt_lock) {}
+};
+
+template <typename Mutex>
+class SharedLock : public std::shared_lock<Mutex> {
+public:
+    explicit SharedLock(Mutex& mutex, const LockSite& site = LockSite::current())
+        : std::shared_lock<Mutex>(lockSharedAt(mutex, site), std::adopt_lock) {}
+};
+
+#endif /* LOCK_PROFILER_H */
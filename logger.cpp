@@ -0,0 +1,446 @@
+/*
+ * logger.cpp
+ *
+ * Implémentation de la journalisation asynchrone par lots.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "logger.h"
+#include <iostream>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+
+/* ========================================================================== */
+/*                             HORODATAGE                                     */
+/* ========================================================================== */
+
+/*
+ * Retourne l'heure actuelle formatée (YYYY-MM-DD HH:MM:SS).
+ * La chaîne n'est reformatée que lorsque la seconde change.
+ */
+const std::string& cachedTimestamp() {
+    thread_local time_t cachedSecond = -1;
+    thread_local std::string text;
+
+    time_t now = time(nullptr);
+    if (now != cachedSecond) {
+        struct tm local;
+        localtime_r(&now, &local);
+        char buffer[32];
+        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+        text = buffer;
+        cachedSecond = now;
+    }
+    return text;
+}
+
+/* ========================================================================== */
+/*                            CONSTRUCTION                                    */
+/* ========================================================================== */
+
+Logger::Logger()
+    : m_fileSize(0), m_writerIdle(false), m_flushRequested(0), m_flushCompleted(0), m_stopping(false) {
+}
+
+Logger::~Logger() {
+    close();
+}
+
+bool Logger::open(const std::string& path, const LoggerOptions& options) {
+    m_file.open(path, std::ios::app);
+    if (!m_file) {
+        return false;
+    }
+    m_file.seekp(0, std::ios::end);
+    m_fileSize = static_cast<uint64_t>(m_file.tellp());
+    m_path = path;
+    m_options = options;
+    m_stopping = false;
+    m_writer = std::thread(&Logger::writerLoop, this);
+    return true;
+}
+
+/*
+ * Arrête le thread d'écriture après un dernier vidage des anneaux.
+ * Les entrées déposées après close() ne sont plus écrites.
+ */
+void Logger::close() {
+    if (m_writer.joinable()) {
+        {
+            LockGuard<LogMutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeCond.notify_one();
+        m_writer.join();
+    }
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+}
+
+/* ========================================================================== */
+/*                        DÉPÔT DES ENTRÉES                                   */
+/* ========================================================================== */
+
+/*
+ * Anneau du thread appelant, créé et inscrit au premier appel.
+ * L'anneau est partagé avec le logger : il survit à la fin du thread
+ * jusqu'à ce que le thread d'écriture l'ait vidé.
+ */
+Logger::Ring& Logger::localRing() {
+    thread_local Logger* owner = nullptr;
+    thread_local std::shared_ptr<Ring> ring;
+
+    if (owner != this) {
+        ring = std::make_shared<Ring>();
+        owner = this;
+        LockGuard<LogMutex> lock(m_ringsMutex);
+        m_rings.push_back(ring);
+    }
+    return *ring;
+}
+
+/*
+ * Dépose une entrée "[horodatage] message" dans l'anneau du thread.
+ *
+ * Le texte est construit directement dans la case de l'anneau, dont la
+ * capacité est réutilisée d'un tour à l'autre : pas d'allocation une
+ * fois l'anneau « chaud », pas de verrou, pas d'appel système (sauf pour
+ * réveiller un thread d'écriture endormi).
+ */
+void Logger::log(const std::string& message) {
+    Ring& ring = localRing();
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+
+    /* Anneau plein : on laisse le thread d'écriture rattraper son retard */
+    while (tail - ring.head.load(std::memory_order_acquire) >= LOG_RING_CAPACITY) {
+        wakeWriter();
+        std::this_thread::yield();
+    }
+
+    std::string& slot = ring.slots[tail % LOG_RING_CAPACITY];
+    slot.clear();
+    slot += '[';
+    slot += cachedTimestamp();
+    slot += "] ";
+    slot += message;
+    slot += '\n';
+    ring.stamps[tail % LOG_RING_CAPACITY] = static_cast<uint64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+    ring.tail.store(tail + 1, std::memory_order_release);
+
+    /* Couplé à la barrière de writerLoop() : pas de réveil perdu */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_writerIdle.load(std::memory_order_relaxed)) {
+        wakeWriter();
+    }
+}
+
+void Logger::wakeWriter() {
+    if (m_writerIdle.exchange(false)) {
+        LockGuard<LogMutex> lock(m_mutex);
+        m_wakeCond.notify_one();
+    }
+}
+
+/*
+ * Demande un vidage sur disque et attend sa fin.
+ * Utilisé avant de relire le fichier de log (GET_LOG).
+ */
+void Logger::flush() {
+    UniqueLock<LogMutex> lock(m_mutex);
+    if (!m_writer.joinable() || m_stopping) {
+        return;
+    }
+    uint64_t target = ++m_flushRequested;
+    m_writerIdle = false;
+    m_wakeCond.notify_one();
+    m_flushedCond.wait(lock, [this, target]() { return m_flushCompleted >= target || m_stopping; });
+}
+
+/* ========================================================================== */
+/*                         THREAD D'ÉCRITURE                                  */
+/* ========================================================================== */
+
+/*
+ * Concatène dans batch toutes les entrées en attente.
+ *
+ * Chaque anneau est déjà dans l'ordre de dépôt : une fusion selon
+ * l'instant de dépôt suffit à intercaler les entrées des différents
+ * threads. Les anneaux des threads terminés sont retirés une fois vides.
+ * Retourne true si au moins une entrée a été lue.
+ */
+bool Logger::drainRings(std::string& batch) {
+    struct Pending {
+        Ring* ring;
+        size_t head;
+        size_t tail;
+    };
+    std::vector<Pending> pending;
+
+    LockGuard<LogMutex> lock(m_ringsMutex);
+
+    for (auto it = m_rings.begin(); it != m_rings.end();) {
+        Ring& ring = **it;
+        size_t head = ring.head.load(std::memory_order_relaxed);
+        size_t tail = ring.tail.load(std::memory_order_acquire);
+
+        if (head != tail) {
+            pending.push_back({&ring, head, tail});
+            ++it;
+        } else if (it->use_count() == 1) {
+            it = m_rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    /* Fusion : à chaque tour, l'entrée la plus ancienne parmi les anneaux */
+    while (true) {
+        Pending* oldest = nullptr;
+        for (auto& p : pending) {
+            if (p.head != p.tail && (oldest == nullptr
+                    || p.ring->stamps[p.head % LOG_RING_CAPACITY]
+                       < oldest->ring->stamps[oldest->head % LOG_RING_CAPACITY])) {
+                oldest = &p;
+            }
+        }
+        if (oldest == nullptr) {
+            break;
+        }
+        batch += oldest->ring->slots[oldest->head % LOG_RING_CAPACITY];
+        oldest->head++;
+    }
+
+    for (const auto& p : pending) {
+        p.ring->head.store(p.tail, std::memory_order_release);
+    }
+    return !pending.empty();
+}
+
+/*
+ * Boucle du thread d'écriture.
+ *
+ * Tant que des entrées arrivent, les anneaux sont vidés au plus toutes
+ * les LOG_COMMIT_INTERVAL_MS millisecondes, sans aucun réveil de la
+ * part des producteurs. Quand un passage ne trouve rien, le thread
+ * s'endort sans délai (m_writerIdle) et le prochain log() le réveille.
+ */
+void Logger::writerLoop() {
+    using Clock = std::chrono::steady_clock;
+    std::string batch;
+    bool dirty = false;
+    Clock::time_point lastFlush = Clock::now();
+
+    while (true) {
+        uint64_t flushTarget;
+        bool stopping;
+        {
+            LockGuard<LogMutex> lock(m_mutex);
+            flushTarget = m_flushRequested;
+            stopping = m_stopping;
+        }
+
+        batch.clear();
+        bool wrote = drainRings(batch);
+        if (wrote) {
+            m_file.write(batch.data(), batch.size());
+            m_fileSize += batch.size();
+            dirty = true;
+            if (m_options.echo) {
+                std::cout.write(batch.data(), batch.size());
+                std::cout.flush();
+            }
+        }
+
+        /* Vidage du fichier selon la politique choisie */
+        Clock::time_point now = Clock::now();
+        bool intervalElapsed = now - lastFlush >= std::chrono::milliseconds(m_options.flushIntervalMs);
+        if (dirty && (m_options.flushPolicy == LogFlushPolicy::Batch || intervalElapsed
+                      || flushTarget > m_flushCompleted || stopping)) {
+            m_file.flush();
+            dirty = false;
+            lastFlush = now;
+        }
+
+        if (m_options.maxFileSize > 0 && m_fileSize >= m_options.maxFileSize) {
+            rotate();
+            dirty = false;
+        }
+
+        UniqueLock<LogMutex> lock(m_mutex);
+        if (flushTarget > m_flushCompleted) {
+            m_flushCompleted = flushTarget;
+            m_flushedCond.notify_all();
+        }
+        if (stopping) {
+            break;
+        }
+
+        auto pending = [this]() { return m_stopping || m_flushRequested > m_flushCompleted; };
+
+        if (wrote) {
+            m_wakeCond.wait_for(lock, std::chrono::milliseconds(LOG_COMMIT_INTERVAL_MS), pending);
+            continue;
+        }
+
+        /* Rien à écrire : endormissement jusqu'au prochain log() */
+        m_writerIdle = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool empty;
+        {
+            LockGuard<LogMutex> ringsLock(m_ringsMutex);
+            empty = true;
+            for (const auto& ring : m_rings) {
+                if (ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_acquire)) {
+                    empty = false;
+                    break;
+                }
+            }
+        }
+        if (!empty) {
+            m_writerIdle = false;
+            continue;
+        }
+
+        auto woken = [this, &pending]() { return !m_writerIdle || pending(); };
+        if (dirty) {
+            m_wakeCond.wait_for(lock, std::chrono::milliseconds(m_options.flushIntervalMs), woken);
+        } else {
+            m_wakeCond.wait(lock, woken);
+        }
+        m_writerIdle = false;
+    }
+}
+
+/*
+ * Rotation : <fichier>.N-1 -> <fichier>.N, ..., <fichier> -> <fichier>.1,
+ * puis ouverture d'un nouveau fichier vide. Au-delà de keepFiles, le
+ * plus ancien est écrasé par le renommage.
+ */
+void Logger::rotate() {
+    m_file.close();
+
+    if (m_options.keepFiles > 0) {
+        for (int i = m_options.keepFiles - 1; i >= 1; --i) {
+            std::string from = m_path + "." + std::to_string(i);
+            std::string to = m_path + "." + std::to_string(i + 1);
+            std::rename(from.c_str(), to.c_str());
+        }
+        std::rename(m_path.c_str(), (m_path + ".1").c_str());
+        m_file.open(m_path, std::ios::app);
+    } else {
+        m_file.open(m_path, std::ios::trunc);
+    }
+    m_fileSize = 0;
+}
+
+/* ========================================================================== */
+/*                        LECTURE DU FICHIER DE LOG                           */
+/* ========================================================================== */
+
+constexpr size_t LOG_SCAN_BLOCK = 64 * 1024;      /* Taille d'une lecture pread()   */
+constexpr size_t LOG_TIMESTAMP_SIZE = 19;         /* "YYYY-MM-DD HH:MM:SS"          */
+
+/*
+ * Parcourt le fichier à rebours par blocs jusqu'à avoir compté lines
+ * fins de ligne. Le saut de ligne final éventuel ne compte pas.
+ */
+off_t findLogTail(int fd, off_t size, size_t lines) {
+    if (lines == 0 || size == 0) {
+        return size;
+    }
+
+    char block[LOG_SCAN_BLOCK];
+    off_t end = size;
+    size_t found = 0;
+
+    /* Le dernier octet termine la dernière ligne */
+    char last;
+    if (pread(fd, &last, 1, size - 1) == 1 && last == '\n') {
+        end = size - 1;
+    }
+
+    while (end > 0) {
+        off_t start = std::max<off_t>(0, end - static_cast<off_t>(LOG_SCAN_BLOCK));
+        ssize_t got = pread(fd, block, static_cast<size_t>(end - start), start);
+        if (got <= 0) {
+            break;
+        }
+        for (ssize_t i = got - 1; i >= 0; --i) {
+            if (block[i] == '\n' && ++found == lines) {
+                return start + i + 1;
+            }
+        }
+        end = start;
+    }
+    return 0;
+}
+
+/* Début de la première ligne qui commence à pos ou après */
+static off_t lineStartAtOrAfter(int fd, off_t size, off_t pos) {
+    if (pos <= 0) {
+        return 0;
+    }
+
+    char block[LOG_SCAN_BLOCK];
+    off_t scan = pos - 1;
+    while (scan < size) {
+        ssize_t got = pread(fd, block, std::min<size_t>(LOG_SCAN_BLOCK, static_cast<size_t>(size - scan)), scan);
+        if (got <= 0) {
+            break;
+        }
+        const char* newline = static_cast<const char*>(memchr(block, '\n', static_cast<size_t>(got)));
+        if (newline != nullptr) {
+            return scan + (newline - block) + 1;
+        }
+        scan += got;
+    }
+    return size;
+}
+
+/*
+ * Horodatage de la première entrée qui commence à pos ou après.
+ * Les lignes sans horodatage (suite d'une entrée) sont sautées ;
+ * retourne une chaîne vide en fin de fichier.
+ */
+static std::string timestampAtOrAfter(int fd, off_t size, off_t pos) {
+    char header[LOG_TIMESTAMP_SIZE + 2];
+    off_t line = lineStartAtOrAfter(fd, size, pos);
+
+    while (line < size) {
+        if (pread(fd, header, sizeof(header), line) == static_cast<ssize_t>(sizeof(header))
+                && header[0] == '[' && header[LOG_TIMESTAMP_SIZE + 1] == ']') {
+            return std::string(header + 1, LOG_TIMESTAMP_SIZE);
+        }
+        line = lineStartAtOrAfter(fd, size, line + 1);
+    }
+    return "";
+}
+
+/*
+ * Les entrées sont écrites dans l'ordre chronologique et le format de
+ * l'horodatage est triable lexicographiquement : la propriété « la
+ * première entrée à partir de pos est >= timestamp » est monotone en
+ * pos, d'où une recherche dichotomique sur les décalages.
+ */
+off_t findLogTime(int fd, off_t size, const std::string& timestamp) {
+    off_t low = 0;
+    off_t high = size;
+
+    while (low < high) {
+        off_t mid = low + (high - low) / 2;
+        std::string found = timestampAtOrAfter(fd, size, mid);
+        if (found.empty() || found >= timestamp) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return lineStartAtOrAfter(fd, size, low);
+}
@@ -0,0 +1,140 @@
+/*
+ * logger.h
+ *
+ * Journalisation asynchrone du serveur.
+ *
+ * Les threads qui journalisent (boucles d'événements, livraison) ne
+ * touchent ni au fichier ni à la console : chaque entrée est déposée
+ * dans un anneau propre au thread appelant (un seul producteur, un seul
+ * consommateur, sans verrou). Un thread d'écriture dédié vide tous les
+ * anneaux et écrit les entrées par lots (« group commit ») : un seul
+ * write() et au plus un flush() pour plusieurs entrées.
+ *
+ * L'horodatage est mis en cache par thread et recalculé une fois par
+ * seconde au plus.
+ *
+ * Rotation par taille : au-delà de maxFileSize octets, le fichier est
+ * renommé en <fichier>.1 (les anciens décalés jusqu'à keepFiles) et un
+ * nouveau fichier est commencé. Les lecteurs qui ont déjà ouvert
+ * l'ancien fichier (GET_LOG) continuent de le lire sans interruption.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "lock_profiler.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+
+/*
+ * Politique de vidage du fichier de log.
+ *   - Batch    : flush() après chaque lot écrit (défaut)
+ *   - Interval : flush() au plus toutes les flushIntervalMs millisecondes
+ */
+enum class LogFlushPolicy {
+    Batch,
+    Interval
+};
+
+struct LoggerOptions {
+    bool echo = true;                                 /* Copie sur la console    */
+    LogFlushPolicy flushPolicy = LogFlushPolicy::Batch;
+    int flushIntervalMs = 1000;                       /* Politique Interval      */
+    uint64_t maxFileSize = 0;                         /* Rotation (0 = jamais)   */
+    int keepFiles = 5;                                /* Anciens fichiers gardés */
+};
+
+constexpr size_t LOG_RING_CAPACITY = 4096;    /* Entrées en attente par thread  */
+constexpr int LOG_COMMIT_INTERVAL_MS = 5;     /* Attente max entre deux lots    */
+
+/*
+ * Classe Logger
+ *
+ * log() est appelable depuis n'importe quel thread, avant ou après
+ * open() ; les entrées déposées avant open() sont écrites au démarrage
+ * du thread d'écriture.
+ */
+class Logger {
+public:
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /* Ouverture du fichier (mode ajout) et démarrage du thread d'écriture */
+    bool open(const std::string& path, const LoggerOptions& options);
+
+    /* Dépôt d'une entrée horodatée (non bloquant sauf anneau plein) */
+    void log(const std::string& message);
+
+    /* Attend que toutes les entrées déjà déposées soient écrites sur disque */
+    void flush();
+
+    /* Vidage final et arrêt du thread d'écriture */
+    void close();
+
+    /* Chemin du fichier de log courant */
+    const std::string& path() const { return m_path; }
+
+private:
+    /* Anneau SPSC d'un thread producteur */
+    struct Ring {
+        std::string slots[LOG_RING_CAPACITY];
+        uint64_t stamps[LOG_RING_CAPACITY];       /* Ordre global des entrées    */
+        alignas(64) std::atomic<size_t> head{0};  /* Lecture (thread d'écriture) */
+        alignas(64) std::atomic<size_t> tail{0};  /* Écriture (thread producteur) */
+    };
+
+    Ring& localRing();
+    void wakeWriter();
+    bool drainRings(std::string& batch);
+    void writerLoop();
+    void rotate();
+
+    std::string m_path;
+    std::ofstream m_file;
+    uint64_t m_fileSize;                          /* Taille du fichier courant     */
+    LoggerOptions m_options;
+
+    using LogMutex = ProfiledMutex<LockClass::Log>;
+
+    LogMutex m_ringsMutex;                        /* Protège m_rings (inscription) */
+    std::vector<std::shared_ptr<Ring>> m_rings;
+
+    LogMutex m_mutex;                             /* Réveil / flush / arrêt       */
+    LockCondition m_wakeCond;                     /* Réveil du thread d'écriture  */
+    LockCondition m_flushedCond;                  /* Fin d'un flush demandé       */
+    std::atomic<bool> m_writerIdle;               /* Écrivain endormi sans délai  */
+    uint64_t m_flushRequested;
+    uint64_t m_flushCompleted;
+    bool m_stopping;
+    std::thread m_writer;
+};
+
+/* Horodatage courant, format YYYY-MM-DD HH:MM:SS (cache par thread) */
+const std::string& cachedTimestamp();
+
+/*
+ * Recherche dans un fichier de log (entrées "[YYYY-MM-DD HH:MM:SS] ...")
+ * ouvert en lecture, limité à ses size premiers octets.
+ * Les deux fonctions retournent un décalage de début de ligne.
+ */
+
+/* Début des lines dernières lignes */
+off_t findLogTail(int fd, off_t size, size_t lines);
+
+/* Première entrée horodatée à timestamp ou après (recherche dichotomique) */
+off_t findLogTime(int fd, off_t size, const std::string& timestamp);
+
+#endif /* LOGGER_H */
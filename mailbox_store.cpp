@@ -0,0 +1,246 @@
+/*
+ * mailbox_store.cpp
+ *
+ * Implémentation des boîtes de réception avec débordement sur disque.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "mailbox_store.h"
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* ========================================================================== */
+/*                            CONSTRUCTION                                    */
+/* ========================================================================== */
+
+MailboxStore::MailboxStore(size_t shardCount)
+    : m_shardCount(shardCount == 0 ? 1 : shardCount),
+      m_shards(new Shard[m_shardCount]),
+      m_totalCount(0), m_memoryCount(0) {
+}
+
+MailboxStore::~MailboxStore() {
+    for (size_t i = 0; i < m_shardCount; ++i) {
+        for (auto& entry : m_shards[i].boxes) {
+            if (entry.second.spillFd >= 0) {
+                ::close(entry.second.spillFd);
+                unlink(spillPath(entry.first).c_str());
+            }
+        }
+    }
+}
+
+void MailboxStore::open(const MailboxOptions& options) {
+    m_options = options;
+
+    if (mkdir(m_options.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Impossible de créer le répertoire " + m_options.directory);
+    }
+
+    /* Débordements d'une exécution précédente : boîtes perdues au redémarrage */
+    DIR* dir = opendir(m_options.directory.c_str());
+    if (dir == nullptr) {
+        throw std::runtime_error("Impossible d'ouvrir le répertoire " + m_options.directory);
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, ".spill") == 0) {
+            unlink((m_options.directory + "/" + name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+/* ========================================================================== */
+/*                               VERROUS                                      */
+/* ========================================================================== */
+
+MailboxStore::Shard& MailboxStore::shardFor(const std::string& username) {
+    return m_shards[std::hash<std::string>{}(username) % m_shardCount];
+}
+
+MailboxStore::Lock MailboxStore::lockUser(const std::string& username, const LockSite& site) {
+    return Lock(shardFor(username).mutex, site);
+}
+
+/* ========================================================================== */
+/*                          DÉPÔT / RETRAIT                                   */
+/* ========================================================================== */
+
+/*
+ * Ajoute un message en fin de boîte.
+ *
+ * Tant qu'aucun débordement n'est en cours et que les budgets le
+ * permettent, le message reste en mémoire ; sinon il est ajouté au
+ * fichier de débordement. Les messages en mémoire sont toujours plus
+ * anciens que ceux du fichier : l'ordre d'arrivée est conservé.
+ */
+MailboxResult MailboxStore::store(const std::string& username, const Message& msg) {
+    Shard& shard = shardFor(username);
+    Mailbox& box = shard.boxes[username];
+
+    if (box.count >= m_options.maxPerUser || m_totalCount >= m_options.maxTotal) {
+        if (box.count == 0) {
+            shard.boxes.erase(username);
+        }
+        return MailboxResult::Full;
+    }
+
+    std::string encoded;
+    msg.serializeCompact(encoded);
+
+    if (box.spillFd < 0 && box.memory.size() < m_options.memoryPerUser
+            && m_memoryCount < m_options.memoryTotal) {
+        box.memory.push_back(std::move(encoded));
+        m_memoryCount++;
+    } else if (!spill(username, box, encoded)) {
+        if (box.count == 0) {
+            shard.boxes.erase(username);
+        }
+        return MailboxResult::Error;
+    }
+
+    box.count++;
+    m_totalCount++;
+    return MailboxResult::Stored;
+}
+
+size_t MailboxStore::take(const std::string& username, size_t maxMessages, std::vector<Message>& out) {
+    Shard& shard = shardFor(username);
+    auto it = shard.boxes.find(username);
+    if (it == shard.boxes.end()) {
+        return 0;
+    }
+    Mailbox& box = it->second;
+
+    size_t taken = 0;
+    std::string encoded;
+    while (taken < maxMessages && box.count > 0) {
+        if (!box.memory.empty()) {
+            encoded = std::move(box.memory.front());
+            box.memory.pop_front();
+            m_memoryCount--;
+        } else if (!unspill(username, box, encoded)) {
+            /* Débordement illisible : le reste de la boîte est perdu */
+            m_totalCount -= box.count;
+            box.count = 0;
+            break;
+        }
+
+        box.count--;
+        m_totalCount--;
+        try {
+            out.push_back(Message::deserializeCompact(encoded.data(), encoded.size()));
+            taken++;
+        } catch (const std::exception&) {
+            /* Enregistrement corrompu : ignoré */
+        }
+    }
+
+    if (box.count == 0) {
+        if (box.spillFd >= 0) {
+            ::close(box.spillFd);
+            unlink(spillPath(username).c_str());
+        }
+        m_memoryCount -= box.memory.size();
+        shard.boxes.erase(it);
+    }
+    return taken;
+}
+
+size_t MailboxStore::pending(const std::string& username) {
+    Shard& shard = shardFor(username);
+    auto it = shard.boxes.find(username);
+    return it == shard.boxes.end() ? 0 : it->second.count;
+}
+
+/* ========================================================================== */
+/*                            DÉBORDEMENT                                     */
+/* ========================================================================== */
+
+/* Le nom est écrit en hexadécimal : aucun caractère interdit dans un chemin */
+std::string MailboxStore::spillPath(const std::string& username) const {
+    static const char digits[] = "0123456789abcdef";
+    std::string path = m_options.directory + "/";
+    for (unsigned char c : username) {
+        path += digits[c >> 4];
+        path += digits[c & 0x0F];
+    }
+    return path + ".spill";
+}
+
+/*
+ * Ajoute un enregistrement [varint longueur][message compact] en fin
+ * de fichier de débordement (créé au premier débordement).
+ */
+bool MailboxStore::spill(const std::string& username, Mailbox& box, const std::string& encoded) {
+    if (box.spillFd < 0) {
+        box.spillFd = ::open(spillPath(username).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (box.spillFd < 0) {
+            return false;
+        }
+        box.spillRead = 0;
+        box.spillWrite = 0;
+    }
+
+    std::string record;
+    appendVarint(record, encoded.size());
+    record += encoded;
+
+    const char* data = record.data();
+    size_t remaining = record.size();
+    off_t offset = box.spillWrite;
+    while (remaining > 0) {
+        ssize_t written = pwrite(box.spillFd, data, remaining, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+        offset += written;
+    }
+    box.spillWrite = offset;
+    return true;
+}
+
+/*
+ * Relit l'enregistrement suivant du fichier de débordement.
+ * Le fichier est supprimé dès qu'il a été entièrement relu.
+ */
+bool MailboxStore::unspill(const std::string& username, Mailbox& box, std::string& encoded) {
+    if (box.spillFd < 0 || box.spillRead >= box.spillWrite) {
+        return false;
+    }
+
+    char header[10];
+    ssize_t got = pread(box.spillFd, header, sizeof(header), box.spillRead);
+    const char* cursor = header;
+    uint64_t length;
+    if (got <= 0 || !readVarint(cursor, header + got, length) || length > MAX_COMPACT_SIZE) {
+        return false;
+    }
+
+    off_t offset = box.spillRead + (cursor - header);
+    encoded.resize(length);
+    if (pread(box.spillFd, &encoded[0], length, offset) != static_cast<ssize_t>(length)) {
+        return false;
+    }
+    box.spillRead = offset + static_cast<off_t>(length);
+
+    if (box.spillRead >= box.spillWrite) {
+        ::close(box.spillFd);
+        unlink(spillPath(username).c_str());
+        box.spillFd = -1;
+        box.spillRead = 0;
+        box.spillWrite = 0;
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+/*
+ * mailbox_store.h
+ *
+ * Boîtes de réception des utilisateurs non connectés.
+ *
+ * Un message adressé à un utilisateur absent est conservé dans sa
+ * boîte, puis livré dans l'ordre à sa prochaine connexion.
+ *
+ * Les messages sont gardés encodés au format compact. Les plus anciens
+ * restent en mémoire dans la limite d'un budget par boîte et d'un
+ * budget global ; au-delà, ils sont ajoutés à un fichier de
+ * débordement propre à la boîte (<répertoire>/<nom en hexadécimal>.spill),
+ * relu au fil du vidage. La mémoire utilisée reste donc bornée quel que
+ * soit le nombre de messages en attente.
+ *
+ * Les boîtes ne survivent pas à un redémarrage : les fichiers de
+ * débordement restants sont supprimés à l'ouverture.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef MAILBOX_STORE_H
+#define MAILBOX_STORE_H
+
+#include "message.h"
+#include "lock_profiler.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <sys/types.h>
+
+struct MailboxOptions {
+    std::string directory = "mailboxes";  /* Répertoire des fichiers de débordement */
+    size_t maxPerUser = 1000;             /* Messages max par boîte                 */
+    size_t maxTotal = 100000;             /* Messages max toutes boîtes confondues  */
+    size_t memoryPerUser = 32;            /* Messages gardés en mémoire par boîte   */
+    size_t memoryTotal = 10000;           /* Messages en mémoire, toutes boîtes     */
+};
+
+constexpr size_t DEFAULT_MAILBOX_SHARDS = 64;    /* Nombre de verrous de boîtes */
+
+/* Résultat d'un dépôt dans une boîte */
+enum class MailboxResult {
+    Stored,         /* Message conservé                        */
+    Full,           /* Boîte (ou ensemble des boîtes) pleine   */
+    Error           /* Erreur d'écriture du débordement        */
+};
+
+/*
+ * Classe MailboxStore
+ *
+ * Chaque nom est associé à un verrou (un par shard). Ce verrou doit
+ * être tenu pour store(), take() et pending() ; le serveur le tient
+ * aussi pendant l'inscription du nom dans le registre, ce qui ordonne
+ * dépôts, connexion et vidage de la boîte sans verrou global.
+ */
+class MailboxStore {
+public:
+    explicit MailboxStore(size_t shardCount = DEFAULT_MAILBOX_SHARDS);
+    ~MailboxStore();
+
+    MailboxStore(const MailboxStore&) = delete;
+    MailboxStore& operator=(const MailboxStore&) = delete;
+
+    /* Création du répertoire et nettoyage des débordements ; lève std::runtime_error */
+    void open(const MailboxOptions& options);
+
+    /* Verrou associé à un nom (site : appelant, pour la mesure de contention) */
+    using Lock = UniqueLock<ProfiledMutex<LockClass::Mailbox>>;
+    Lock lockUser(const std::string& username, const LockSite& site = LockSite::current());
+
+    /* Dépôt d'un message en fin de boîte (verrou du nom tenu) */
+    MailboxResult store(const std::string& username, const Message& msg);
+
+    /* Retrait d'au plus maxMessages messages, du plus ancien au plus récent (verrou tenu) */
+    size_t take(const std::string& username, size_t maxMessages, std::vector<Message>& out);
+
+    /* Nombre de messages en attente pour ce nom (verrou tenu) */
+    size_t pending(const std::string& username);
+
+    /* Nombre total de messages en attente */
+    size_t totalPending() const { return m_totalCount.load(); }
+
+private:
+    struct Mailbox {
+        std::deque<std::string> memory;   /* Plus anciens messages (encodés)    */
+        int spillFd = -1;                 /* Fichier de débordement (ou -1)     */
+        off_t spillRead = 0;              /* Prochain enregistrement à relire   */
+        off_t spillWrite = 0;             /* Fin du fichier de débordement      */
+        size_t count = 0;                 /* Messages en attente (total)        */
+    };
+
+    /* Shard aligné sur une ligne de cache pour éviter le faux partage */
+    struct alignas(64) Shard {
+        ProfiledMutex<LockClass::Mailbox> mutex;
+        std::unordered_map<std::string, Mailbox> boxes;
+    };
+
+    Shard& shardFor(const std::string& username);
+    std::string spillPath(const std::string& username) const;
+    bool spill(const std::string& username, Mailbox& box, const std::string& encoded);
+    bool unspill(const std::string& username, Mailbox& box, std::string& encoded);
+
+    MailboxOptions m_options;
+    size_t m_shardCount;
+    std::unique_ptr<Shard[]> m_shards;
+    std::atomic<size_t> m_totalCount;     /* Messages en attente                */
+    std::atomic<size_t> m_memoryCount;    /* Dont messages gardés en mémoire    */
+};
+
+#endif /* MAILBOX_STORE_H */
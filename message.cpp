@@ -101,6 +101,169 @@ Message Message::deserialize(const char* buffer, size_t size) {
     return msg;
 }
 
+/* ========================================================================== */
+/*                           FORMAT COMPACT                                   */
+/* ========================================================================== */
+
+/*
+ * Ajoute un entier non signé encodé en varint (LEB128) :
+ * 7 bits de données par octet, bit de poids fort = octet suivant présent.
+ * Une longueur inférieure à 128 tient sur un seul octet.
+ */
+void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/*
+ * Lit un varint et avance le curseur.
+ * Retourne false si les données sont tronquées ou trop longues.
+ */
+bool readVarint(const char*& cursor, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (cursor >= end) {
+            return false;
+        }
+        uint8_t byte = static_cast<uint8_t>(*cursor++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Ajoute un champ texte : [varint longueur][octets utilisés].
+ */
+static void appendField(std::string& out, const char* field, size_t maxSize) {
+    size_t length = strnlen(field, maxSize - 1);
+    appendVarint(out, length);
+    out.append(field, length);
+}
+
+/*
+ * Lit un champ texte dans un tableau de taille fixe : la fin du tableau
+ * est remplie de '\0', chaque octet du champ est donc écrit une fois.
+ */
+static void readField(const char*& cursor, const char* end, char* field, size_t maxSize, const char* fieldName) {
+    uint64_t length;
+    if (!readVarint(cursor, end, length)) {
+        throw std::runtime_error(std::string("Champ ") + fieldName + " tronqué");
+    }
+    if (length > maxSize - 1 || length > static_cast<uint64_t>(end - cursor)) {
+        throw std::runtime_error(std::string("Champ ") + fieldName + " invalide");
+    }
+    memcpy(field, cursor, length);
+    memset(field + length, 0, maxSize - length);
+    cursor += length;
+}
+
+/*
+ * Encodage compact d'un message.
+ * 
+ * Format (version 2) :
+ *   [1 octet  : version = 2]
+ *   [1 octet  : drapeaux (bit 0 = isRead)]
+ *   [varint   : receivedAt (secondes depuis l'epoch)]
+ *   [varint longueur][from] [varint longueur][to]
+ *   [varint longueur][subject] [varint longueur][body]
+ * 
+ * Un "hi" occupe une vingtaine d'octets au lieu de sizeof(Message).
+ */
+void Message::serializeCompact(std::string& out) const {
+    out.push_back(static_cast<char>(WireFormat::Compact));
+    out.push_back(static_cast<char>(isRead ? 1 : 0));
+    appendVarint(out, static_cast<uint64_t>(receivedAt));
+    appendField(out, from, MAX_FROM_SIZE);
+    appendField(out, to, MAX_TO_SIZE);
+    appendField(out, subject, MAX_SUBJECT_SIZE);
+    appendField(out, body, MAX_BODY_SIZE);
+}
+
+/*
+ * Décodage compact d'un message.
+ * Les tailles sont vérifiées comme dans le constructeur avec paramètres.
+ */
+Message Message::deserializeCompact(const char* buffer, size_t size) {
+    Message msg;
+    decodeInto(WireFormat::Compact, buffer, size, msg);
+    return msg;
+}
+
+/*
+ * Décodage selon le format négocié avec le pair.
+ */
+Message Message::decode(WireFormat format, const char* buffer, size_t size) {
+    Message msg;
+    decodeInto(format, buffer, size, msg);
+    return msg;
+}
+
+/*
+ * Décodage en place : utilisé par le pool de messages du serveur, dont
+ * les emplacements sont réutilisés sans repasser par le constructeur.
+ */
+void Message::decodeInto(WireFormat format, const char* buffer, size_t size, Message& msg) {
+    if (format != WireFormat::Compact) {
+        if (size != sizeof(Message)) {
+            throw std::runtime_error("Taille de message invalide lors de la désérialisation");
+        }
+        memcpy(&msg, buffer, size);
+        
+        /* Champs toujours terminés, même si l'émetteur ne l'a pas fait */
+        msg.from[MAX_FROM_SIZE - 1] = '\0';
+        msg.to[MAX_TO_SIZE - 1] = '\0';
+        msg.subject[MAX_SUBJECT_SIZE - 1] = '\0';
+        msg.body[MAX_BODY_SIZE - 1] = '\0';
+        return;
+    }
+    
+    const char* cursor = buffer;
+    const char* end = buffer + size;
+    
+    if (size < 2 || static_cast<uint8_t>(cursor[0]) != static_cast<uint8_t>(WireFormat::Compact)) {
+        throw std::runtime_error("Version de message compact non supportée");
+    }
+    
+    msg.isRead = (cursor[1] & 1) != 0;
+    cursor += 2;
+    
+    uint64_t timestamp;
+    if (!readVarint(cursor, end, timestamp)) {
+        throw std::runtime_error("Horodatage tronqué");
+    }
+    msg.receivedAt = static_cast<time_t>(timestamp);
+    
+    readField(cursor, end, msg.from, MAX_FROM_SIZE, "From");
+    readField(cursor, end, msg.to, MAX_TO_SIZE, "To");
+    readField(cursor, end, msg.subject, MAX_SUBJECT_SIZE, "Subject");
+    readField(cursor, end, msg.body, MAX_BODY_SIZE, "Body");
+    
+    if (cursor != end) {
+        throw std::runtime_error("Octets en trop dans le message compact");
+    }
+}
+
+/*
+ * Encodage selon le format négocié avec le pair.
+ */
+void Message::encode(WireFormat format, std::string& out) const {
+    if (format == WireFormat::Compact) {
+        serializeCompact(out);
+        return;
+    }
+    
+    char buffer[sizeof(Message)];
+    size_t size;
+    serialize(buffer, size);
+    out.append(buffer, size);
+}
+
 /* ========================================================================== */
 /*                            AFFICHAGE                                       */
 /* ========================================================================== */
@@ -4,6 +4,11 @@
  * Définition de la structure Message pour la communication client/serveur.
  * Structure à taille fixe (POD) pour faciliter la sérialisation binaire.
  * 
+ * Deux formats de transmission coexistent (négociés à la connexion) :
+ *   - Legacy  : copie mémoire de la structure (sizeof(Message) octets)
+ *   - Compact : champs préfixés par leur longueur (varint), seuls les
+ *               octets utilisés sont transmis, indépendant du compilateur
+ * 
  * Projet R3.05 - Programmation Système
  */
 
@@ -14,6 +19,7 @@
 #include <cstring>
 #include <stdexcept>
 #include <ctime>
+#include <cstdint>
 
 /* Constantes définissant les tailles maximales des champs */
 constexpr size_t MAX_FROM_SIZE = 50;      /* Taille max du nom expéditeur    */
@@ -21,6 +27,28 @@ constexpr size_t MAX_TO_SIZE = 50;        /* Taille max du nom destinataire  */
 constexpr size_t MAX_SUBJECT_SIZE = 100;  /* Taille max du sujet             */
 constexpr size_t MAX_BODY_SIZE = 500;     /* Taille max du corps du message  */
 
+/*
+ * Formats de transmission d'un Message.
+ * La valeur numérique est le numéro de version annoncé lors de la
+ * négociation ("HELLO:<version>:<nom>") et, pour Compact, le premier
+ * octet de chaque message encodé.
+ */
+enum class WireFormat : uint8_t {
+    Legacy = 1,     /* Copie binaire de la structure              */
+    Compact = 2     /* Champs à longueur variable (varint)        */
+};
+
+/* Taille maximale d'un message au format compact */
+constexpr size_t MAX_COMPACT_SIZE = 2 + 10 + 4 * 2 + MAX_FROM_SIZE + MAX_TO_SIZE
+                                    + MAX_SUBJECT_SIZE + MAX_BODY_SIZE;
+
+/* Messages max par trame SEND_BATCH (tient dans une trame de 64 Kio, format Legacy compris) */
+constexpr size_t SEND_BATCH_MAX = 64;
+
+/* Encodage / décodage d'entiers à longueur variable (LEB128, 7 bits par octet) */
+void appendVarint(std::string& out, uint64_t value);
+bool readVarint(const char*& cursor, const char* end, uint64_t& value);
+
 /*
  * Structure Message
  * 
@@ -55,6 +83,23 @@ struct Message {
     /* Désérialisation : reconstruit la structure depuis un tableau d'octets */
     static Message deserialize(const char* buffer, size_t size);
     
+    /* Encodage compact : ajoute le message encodé à la fin de out */
+    void serializeCompact(std::string& out) const;
+    
+    /* Décodage compact (lève std::runtime_error si mal formé) */
+    static Message deserializeCompact(const char* buffer, size_t size);
+    
+    /* Encodage / décodage selon le format négocié */
+    void encode(WireFormat format, std::string& out) const;
+    static Message decode(WireFormat format, const char* buffer, size_t size);
+    
+    /*
+     * Décodage dans un message existant, dont tous les champs sont
+     * réécrits (pas de remise à zéro préalable) ; out est indéfini si
+     * une exception est levée.
+     */
+    static void decodeInto(WireFormat format, const char* buffer, size_t size, Message& out);
+    
     /* Formatage pour affichage complet */
     std::string toString() const;
     
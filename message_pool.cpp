@@ -0,0 +1,133 @@
+/*
+ * message_pool.cpp
+ *
+ * Implémentation du pool de messages partagés.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "message_pool.h"
+
+/* ========================================================================== */
+/*                              POIGNÉES                                      */
+/* ========================================================================== */
+
+MessageRef::MessageRef(const MessageRef& other) noexcept : m_slot(other.m_slot) {
+    if (m_slot != nullptr) {
+        m_slot->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+MessageRef& MessageRef::operator=(const MessageRef& other) noexcept {
+    if (this != &other) {
+        if (other.m_slot != nullptr) {
+            other.m_slot->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        release();
+        m_slot = other.m_slot;
+    }
+    return *this;
+}
+
+MessageRef& MessageRef::operator=(MessageRef&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_slot = other.m_slot;
+        other.m_slot = nullptr;
+    }
+    return *this;
+}
+
+/*
+ * Libération d'une référence. acq_rel : les lectures faites par les
+ * autres détenteurs sont terminées avant que l'emplacement soit réutilisé.
+ */
+void MessageRef::release() noexcept {
+    if (m_slot != nullptr && m_slot->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_slot->pool->free(m_slot);
+    }
+    m_slot = nullptr;
+}
+
+/* ========================================================================== */
+/*                               POOL                                         */
+/* ========================================================================== */
+
+MessagePool::MessagePool(size_t shardCount)
+    : m_shardCount(shardCount == 0 ? 1 : shardCount),
+      m_shards(new Shard[m_shardCount]),
+      m_nextShard(0), m_slabs(0), m_inUse(0), m_peakInUse(0), m_allocations(0) {
+}
+
+/*
+ * Prend un emplacement libre dans le shard du thread appelant, en
+ * ajoutant un bloc si la liste libre est vide. Les messages d'un bloc
+ * neuf sont construits (mis à zéro) une seule fois : un emplacement
+ * recyclé est ensuite entièrement réécrit par Message::decodeInto().
+ */
+PooledMessage* MessagePool::allocate() {
+    thread_local size_t threadShard = SIZE_MAX;
+    if (threadShard == SIZE_MAX) {
+        threadShard = m_nextShard.fetch_add(1, std::memory_order_relaxed);
+    }
+    size_t index = threadShard % m_shardCount;
+    Shard& shard = m_shards[index];
+
+    PooledMessage* slot;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.freeList == nullptr) {
+            std::unique_ptr<PooledMessage[]> slab(new PooledMessage[MESSAGE_SLAB_SIZE]);
+            for (size_t i = 0; i < MESSAGE_SLAB_SIZE; ++i) {
+                slab[i].shard = static_cast<uint32_t>(index);
+                slab[i].pool = this;
+                slab[i].nextFree = (i + 1 < MESSAGE_SLAB_SIZE) ? &slab[i + 1] : nullptr;
+            }
+            shard.freeList = &slab[0];
+            shard.slabs.push_back(std::move(slab));
+            m_slabs.fetch_add(1, std::memory_order_relaxed);
+        }
+        slot = shard.freeList;
+        shard.freeList = slot->nextFree;
+    }
+
+    size_t inUse = m_inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t peak = m_peakInUse.load(std::memory_order_relaxed);
+    while (inUse > peak && !m_peakInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+    }
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+void MessagePool::free(PooledMessage* slot) {
+    Shard& shard = m_shards[slot->shard];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        slot->nextFree = shard.freeList;
+        shard.freeList = slot;
+    }
+    m_inUse.fetch_sub(1, std::memory_order_relaxed);
+}
+
+MessageRef MessagePool::decode(WireFormat format, const char* data, size_t size, time_t receivedAt) {
+    PooledMessage* slot = allocate();
+    try {
+        Message::decodeInto(format, data, size, slot->message);
+    } catch (...) {
+        free(slot);
+        throw;
+    }
+    slot->message.receivedAt = receivedAt;
+    slot->refs.store(1, std::memory_order_relaxed);
+    return MessageRef(slot);
+}
+
+MessagePoolStats MessagePool::stats() const {
+    MessagePoolStats stats;
+    stats.slabs = m_slabs.load(std::memory_order_relaxed);
+    stats.capacity = stats.slabs * MESSAGE_SLAB_SIZE;
+    stats.inUse = m_inUse.load(std::memory_order_relaxed);
+    stats.peakInUse = m_peakInUse.load(std::memory_order_relaxed);
+    stats.allocations = m_allocations.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,133 @@
+/*
+ * message_pool.h
+ *
+ * Pool de messages partagés du serveur.
+ *
+ * Un message reçu est décodé une seule fois, directement dans un
+ * emplacement du pool, puis circule par poignée (MessageRef) : file de
+ * livraison, workers (une poignée par worker pour un broadcast),
+ * historique. Aucune copie de la structure Message (≈ 720 octets) n'est
+ * faite entre la réception et la livraison.
+ *
+ * Les emplacements sont alloués par blocs (« slabs ») de taille fixe et
+ * recyclés via des listes libres ; le compteur de références est inclus
+ * dans l'emplacement. Un message publié n'est plus modifiable : les
+ * poignées ne donnent qu'un accès en lecture, ce qui permet de les
+ * partager entre threads sans verrou.
+ *
+ * Les listes libres sont réparties en shards : chaque thread alloue
+ * dans son shard, et un emplacement libéré retourne toujours dans le
+ * shard qui l'a créé. Les blocs ne sont jamais rendus au système : la
+ * mémoire du pool suit le pic d'occupation.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include "message.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+constexpr size_t MESSAGE_SLAB_SIZE = 256;         /* Emplacements par bloc          */
+constexpr size_t DEFAULT_MESSAGE_POOL_SHARDS = 16; /* Listes libres indépendantes   */
+
+class MessagePool;
+
+/* Emplacement du pool : message et compteur de références */
+struct PooledMessage {
+    Message message;
+    std::atomic<uint32_t> refs{0};
+    uint32_t shard = 0;                 /* Shard propriétaire                 */
+    MessagePool* pool = nullptr;
+    PooledMessage* nextFree = nullptr;  /* Chaînage de la liste libre         */
+};
+
+/*
+ * Classe MessageRef
+ *
+ * Poignée à compteur de références intrusif sur un message du pool.
+ * Copier une poignée incrémente le compteur ; la dernière poignée
+ * détruite rend l'emplacement au pool.
+ */
+class MessageRef {
+public:
+    MessageRef() noexcept : m_slot(nullptr) {}
+    MessageRef(const MessageRef& other) noexcept;
+    MessageRef(MessageRef&& other) noexcept : m_slot(other.m_slot) { other.m_slot = nullptr; }
+    MessageRef& operator=(const MessageRef& other) noexcept;
+    MessageRef& operator=(MessageRef&& other) noexcept;
+    ~MessageRef() { release(); }
+
+    const Message& operator*() const { return m_slot->message; }
+    const Message* operator->() const { return &m_slot->message; }
+    explicit operator bool() const { return m_slot != nullptr; }
+
+private:
+    friend class MessagePool;
+    explicit MessageRef(PooledMessage* slot) noexcept : m_slot(slot) {}
+    void release() noexcept;
+
+    PooledMessage* m_slot;
+};
+
+/* Occupation du pool */
+struct MessagePoolStats {
+    size_t slabs;           /* Blocs alloués                              */
+    size_t capacity;        /* Emplacements existants                     */
+    size_t inUse;           /* Emplacements référencés                    */
+    size_t peakInUse;       /* Maximum de inUse depuis le démarrage       */
+    uint64_t allocations;   /* Messages créés depuis le démarrage         */
+};
+
+/*
+ * Classe MessagePool
+ *
+ * decode() peut être appelée par n'importe quel thread ; la libération
+ * a lieu dans le thread qui détruit la dernière poignée. Le pool doit
+ * survivre à toutes ses poignées.
+ */
+class MessagePool {
+public:
+    explicit MessagePool(size_t shardCount = DEFAULT_MESSAGE_POOL_SHARDS);
+
+    MessagePool(const MessagePool&) = delete;
+    MessagePool& operator=(const MessagePool&) = delete;
+
+    /*
+     * Décode un message reçu directement dans un emplacement du pool et
+     * fixe son horodatage de réception. Lève std::runtime_error si le
+     * message est mal formé (l'emplacement est alors rendu au pool).
+     */
+    MessageRef decode(WireFormat format, const char* data, size_t size, time_t receivedAt);
+
+    MessagePoolStats stats() const;
+
+private:
+    friend class MessageRef;
+
+    /* Shard aligné sur une ligne de cache pour éviter le faux partage */
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        PooledMessage* freeList = nullptr;
+        std::vector<std::unique_ptr<PooledMessage[]>> slabs;
+    };
+
+    PooledMessage* allocate();
+    void free(PooledMessage* slot);
+
+    size_t m_shardCount;
+    std::unique_ptr<Shard[]> m_shards;
+    std::atomic<size_t> m_nextShard;    /* Attribution des shards aux threads */
+    std::atomic<size_t> m_slabs;
+    std::atomic<size_t> m_inUse;
+    std::atomic<size_t> m_peakInUse;
+    std::atomic<uint64_t> m_allocations;
+};
+
+#endif /* MESSAGE_POOL_H */
@@ -0,0 +1,555 @@
+/*
+ * microbench.cpp
+ *
+ * Microbenchmarks des chemins critiques de Message et de SocketUtils :
+ *   - construction d'un Message (memset + validateField + strncpy)
+ *   - validateField seul
+ *   - serialize / deserialize (format legacy)
+ *   - encode / decodeInto (format compact)
+ *   - toShortString
+ *   - sendWithLength / receiveWithLength sur une paire de sockets locale
+ *   - HashRing::nodeFor (rattachement d'un nom dans une grappe)
+ *
+ * S'y ajoute un contrôle de l'anneau de rattachement (hash_ring_moves) :
+ * un nœud est ajouté à un anneau de 4 et l'on compte les noms qui
+ * changent de nœud. Environ 1/5 doivent passer au nouveau nœud, et
+ * aucun d'un ancien nœud à un autre ; sinon, code de sortie 2.
+ *
+ * Chaque benchmark a un nombre d'itérations fixe (multiplié par
+ * --scale) et est répété --repeat fois ; on retient le minimum et la
+ * médiane du temps par opération. Les résultats sont comparables d'une
+ * exécution à l'autre à machine égale, surtout avec --cpu (épinglage du
+ * processus sur un cœur).
+ *
+ * Comparaison : --save-baseline écrit les médianes dans un fichier de
+ * référence ; --baseline relit ce fichier et signale chaque benchmark
+ * dont la médiane dépasse la référence de plus de --threshold pour
+ * cent (code de sortie 2).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "message.h"
+#include "socket_utils.h"
+#include "hash_ring.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <sched.h>
+#include <sys/socket.h>
+
+/* ========================================================================== */
+/*                          CONFIGURATION                                     */
+/* ========================================================================== */
+
+/*
+ * Options de lancement (forme --nom=valeur) :
+ *   --filter=TEXTE        : seulement les benchmarks dont le nom contient TEXTE
+ *   --repeat=N            : répétitions de chaque benchmark (défaut : 7)
+ *   --scale=F             : facteur sur les itérations (défaut : 1)
+ *   --cpu=N               : épingle le processus sur le cœur N
+ *   --format=FORMAT       : text (défaut), json ou csv
+ *   --output=FICHIER      : résultats dans un fichier au lieu de la sortie standard
+ *   --save-baseline=FICHIER : écrit les médianes comme référence
+ *   --baseline=FICHIER    : compare les médianes à la référence
+ *   --threshold=P         : régression au-delà de P % (défaut : 10)
+ */
+struct MicroConfig {
+    std::string filter;
+    int repeat;
+    double scale;
+    int cpu;
+    std::string format;
+    std::string outputPath;
+    std::string saveBaselinePath;
+    std::string baselinePath;
+    double thresholdPercent;
+};
+
+/* Résultat d'un benchmark */
+struct MicroResult {
+    std::string name;
+    uint64_t iterations;
+    double minNanos;            /* ns par opération, meilleure répétition */
+    double medianNanos;         /* ns par opération, répétition médiane   */
+    double baselineNanos;       /* Référence (0 : absente)                */
+    bool regression;
+};
+
+/* Un benchmark : nom, itérations de base et corps (exécuté iterations fois) */
+struct MicroBenchmark {
+    std::string name;
+    uint64_t iterations;
+    std::function<void(uint64_t iterations)> run;
+};
+
+/*
+ * Empêche le compilateur d'éliminer un calcul dont le résultat n'est
+ * pas utilisé : la valeur est réputée lue par du code opaque.
+ */
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/* ========================================================================== */
+/*                          BENCHMARKS                                        */
+/* ========================================================================== */
+
+/* Message représentatif : champs de taille moyenne */
+static Message sampleMessage() {
+    Message msg("alice", "bob", "Réunion de demain", std::string(200, 'x'));
+    msg.receivedAt = 1700000000;
+    return msg;
+}
+
+std::vector<MicroBenchmark> makeBenchmarks() {
+    std::vector<MicroBenchmark> benchmarks;
+
+    benchmarks.push_back({"message_default_ctor", 2000000, [](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            Message msg;
+            keep(msg);
+        }
+    }});
+
+    benchmarks.push_back({"message_ctor", 1000000, [](uint64_t iterations) {
+        std::string from = "alice";
+        std::string to = "bob";
+        std::string subject = "Réunion de demain";
+        std::string body(200, 'x');
+        for (uint64_t i = 0; i < iterations; ++i) {
+            Message msg(from, to, subject, body);
+            keep(msg);
+        }
+    }});
+
+    benchmarks.push_back({"validate_field", 10000000, [](uint64_t iterations) {
+        std::string field(200, 'x');
+        for (uint64_t i = 0; i < iterations; ++i) {
+            Message::validateField(field, MAX_BODY_SIZE - 1, "Body");
+            keep(field);
+        }
+    }});
+
+    benchmarks.push_back({"serialize_legacy", 5000000, [](uint64_t iterations) {
+        Message msg = sampleMessage();
+        char buffer[sizeof(Message)];
+        size_t size;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            msg.serialize(buffer, size);
+            keep(buffer);
+        }
+    }});
+
+    benchmarks.push_back({"deserialize_legacy", 5000000, [](uint64_t iterations) {
+        Message msg = sampleMessage();
+        char buffer[sizeof(Message)];
+        size_t size;
+        msg.serialize(buffer, size);
+        for (uint64_t i = 0; i < iterations; ++i) {
+            Message decoded = Message::deserialize(buffer, size);
+            keep(decoded);
+        }
+    }});
+
+    benchmarks.push_back({"encode_compact", 2000000, [](uint64_t iterations) {
+        Message msg = sampleMessage();
+        std::string out;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            out.clear();
+            msg.encode(WireFormat::Compact, out);
+            keep(out);
+        }
+    }});
+
+    benchmarks.push_back({"decode_compact", 2000000, [](uint64_t iterations) {
+        std::string encoded;
+        sampleMessage().encode(WireFormat::Compact, encoded);
+        Message decoded;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            Message::decodeInto(WireFormat::Compact, encoded.data(), encoded.size(), decoded);
+            keep(decoded);
+        }
+    }});
+
+    benchmarks.push_back({"to_short_string", 500000, [](uint64_t iterations) {
+        Message msg = sampleMessage();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            std::string text = msg.toShortString();
+            keep(text);
+        }
+    }});
+
+    /*
+     * Aller simple d'une trame sur une paire de sockets locale :
+     * sendWithLength puis receiveWithLength dans le même thread (la
+     * trame tient dans le tampon du noyau). Mesure le coût des appels
+     * système et de la mise en trame, sans le réseau.
+     */
+    auto socketRoundTrip = [](size_t payloadSize) {
+        return [payloadSize](uint64_t iterations) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+                throw std::runtime_error("Échec de socketpair: " + std::string(strerror(errno)));
+            }
+            std::vector<char> payload(payloadSize, 'x');
+            std::vector<char> buffer(payloadSize);
+            for (uint64_t i = 0; i < iterations; ++i) {
+                SocketUtils::sendWithLength(pair[0], payload.data(), payload.size());
+                size_t received = SocketUtils::receiveWithLength(pair[1], buffer.data(), buffer.size());
+                keep(received);
+            }
+            SocketUtils::closeSocket(pair[0]);
+            SocketUtils::closeSocket(pair[1]);
+        };
+    };
+    benchmarks.push_back({"socketpair_frame_64", 200000, socketRoundTrip(64)});
+    benchmarks.push_back({"socketpair_frame_message", 200000, socketRoundTrip(sizeof(Message))});
+
+    /* Recherche dans un anneau de 5 nœuds (640 points) */
+    benchmarks.push_back({"hash_ring_node_for", 2000000, [](uint64_t iterations) {
+        HashRing ring;
+        for (int n = 1; n <= 5; ++n) {
+            ring.addNode("node" + std::to_string(n));
+        }
+        std::vector<std::string> names;
+        for (int u = 0; u < 64; ++u) {
+            names.push_back("user" + std::to_string(u));
+        }
+        for (uint64_t i = 0; i < iterations; ++i) {
+            const std::string& node = ring.nodeFor(names[i & 63]);
+            keep(node);
+        }
+    }});
+
+    return benchmarks;
+}
+
+/* ========================================================================== */
+/*                          MESURE                                            */
+/* ========================================================================== */
+
+/*
+ * Exécute un benchmark : une passe d'échauffement (1/10 des
+ * itérations), puis --repeat passes mesurées.
+ */
+MicroResult measure(const MicroBenchmark& benchmark, const MicroConfig& config) {
+    uint64_t iterations = std::max<uint64_t>(1, static_cast<uint64_t>(benchmark.iterations * config.scale));
+    benchmark.run(std::max<uint64_t>(1, iterations / 10));
+
+    std::vector<double> samples;
+    for (int r = 0; r < config.repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        benchmark.run(iterations);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double nanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        samples.push_back(nanos / static_cast<double>(iterations));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    MicroResult result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.minNanos = samples.front();
+    result.medianNanos = samples[samples.size() / 2];
+    result.baselineNanos = 0;
+    result.regression = false;
+    return result;
+}
+
+/* ========================================================================== */
+/*                          ANNEAU DE RATTACHEMENT                            */
+/* ========================================================================== */
+
+/* Effet de l'ajout d'un nœud sur le rattachement des noms */
+struct RingMoves {
+    size_t nodes;               /* Nœuds avant l'ajout                    */
+    size_t users;               /* Noms rattachés                         */
+    size_t moved;               /* Noms qui changent de nœud              */
+    size_t strayed;             /* ... vers un autre que le nouveau       */
+};
+
+RingMoves measureRingMoves(size_t nodes, size_t users) {
+    HashRing ring;
+    for (size_t n = 1; n <= nodes; ++n) {
+        ring.addNode("node" + std::to_string(n));
+    }
+    std::vector<std::string> before;
+    before.reserve(users);
+    for (size_t u = 0; u < users; ++u) {
+        before.push_back(ring.nodeFor("user" + std::to_string(u)));
+    }
+
+    std::string added = "node" + std::to_string(nodes + 1);
+    ring.addNode(added);
+    RingMoves moves = {nodes, users, 0, 0};
+    for (size_t u = 0; u < users; ++u) {
+        const std::string& home = ring.nodeFor("user" + std::to_string(u));
+        if (home != before[u]) {
+            moves.moved++;
+            moves.strayed += (home != added) ? 1 : 0;
+        }
+    }
+    return moves;
+}
+
+/* Part attendue 1/(N+1), à 50 % près (128 nœuds virtuels : écart typique de quelques %) */
+bool ringMovesAcceptable(const RingMoves& moves) {
+    double expected = static_cast<double>(moves.users) / static_cast<double>(moves.nodes + 1);
+    double moved = static_cast<double>(moves.moved);
+    return moves.strayed == 0 && moved >= expected * 0.5 && moved <= expected * 1.5;
+}
+
+/* ========================================================================== */
+/*                          RÉFÉRENCE                                         */
+/* ========================================================================== */
+
+/*
+ * Fichier de référence : une ligne "<nom> <ns par opération>" par
+ * benchmark ; les lignes vides et commençant par '#' sont ignorées.
+ */
+std::map<std::string, double> loadBaseline(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Impossible de lire la référence " + path);
+    }
+
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name;
+        double nanos;
+        if (fields >> name >> nanos) {
+            baseline[name] = nanos;
+        }
+    }
+    return baseline;
+}
+
+void saveBaseline(const std::string& path, const std::vector<MicroResult>& results) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Impossible d'écrire la référence " + path);
+    }
+    file << "# Référence microbench : <nom> <ns par opération (médiane)>" << std::endl;
+    file << std::fixed << std::setprecision(2);
+    for (const MicroResult& result : results) {
+        file << result.name << " " << result.medianNanos << std::endl;
+    }
+}
+
+/* ========================================================================== */
+/*                          RAPPORT                                           */
+/* ========================================================================== */
+
+/* moves : contrôle de l'anneau, nullptr s'il est exclu par --filter (absent du format csv) */
+void writeResults(std::ostream& out, const std::vector<MicroResult>& results, const RingMoves* moves,
+                  const MicroConfig& config) {
+    out << std::fixed << std::setprecision(2);
+
+    if (config.format == "json") {
+        out << "{\n  \"repeat\": " << config.repeat << ",\n  \"cpu\": " << config.cpu
+            << ",\n  \"threshold_percent\": " << config.thresholdPercent;
+        if (moves != nullptr) {
+            out << ",\n  \"hash_ring_moves\": {\"nodes\": " << moves->nodes << ", \"users\": " << moves->users
+                << ", \"moved\": " << moves->moved << ", \"strayed\": " << moves->strayed
+                << ", \"ok\": " << (ringMovesAcceptable(*moves) ? "true" : "false") << "}";
+        }
+        out << ",\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const MicroResult& r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                << ", \"min_ns\": " << r.minNanos << ", \"median_ns\": " << r.medianNanos;
+            if (r.baselineNanos > 0) {
+                out << ", \"baseline_ns\": " << r.baselineNanos
+                    << ", \"regression\": " << (r.regression ? "true" : "false");
+            }
+            out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        return;
+    }
+
+    if (config.format == "csv") {
+        out << "name,iterations,min_ns,median_ns,baseline_ns,regression\n";
+        for (const MicroResult& r : results) {
+            out << r.name << "," << r.iterations << "," << r.minNanos << "," << r.medianNanos << ","
+                << r.baselineNanos << "," << (r.regression ? 1 : 0) << "\n";
+        }
+        return;
+    }
+
+    /* Largeurs en octets : +1 par caractère accentué pour garder l'alignement */
+    out << std::left << std::setw(28) << "Benchmark" << std::right << std::setw(13) << "itérations"
+        << std::setw(12) << "min ns" << std::setw(13) << "médiane ns" << std::setw(14) << "référence"
+        << std::setw(11) << "écart" << std::endl;
+    for (const MicroResult& r : results) {
+        out << std::left << std::setw(28) << r.name << std::right << std::setw(12) << r.iterations
+            << std::setw(12) << r.minNanos << std::setw(12) << r.medianNanos;
+        if (r.baselineNanos > 0) {
+            double delta = (r.medianNanos / r.baselineNanos - 1.0) * 100.0;
+            out << std::setw(12) << r.baselineNanos << std::setw(9) << std::showpos << delta << std::noshowpos
+                << "%" << (r.regression ? "  RÉGRESSION" : "");
+        }
+        out << std::endl;
+    }
+
+    if (moves != nullptr) {
+        out << std::endl << "hash_ring_moves : " << moves->nodes << " -> " << moves->nodes + 1 << " nœuds, "
+            << 100.0 * static_cast<double>(moves->moved) / static_cast<double>(moves->users) << " % des "
+            << moves->users << " noms déplacés (attendu " << 100.0 / static_cast<double>(moves->nodes + 1)
+            << " %), " << moves->strayed << " entre anciens nœuds"
+            << (ringMovesAcceptable(*moves) ? "" : "  ÉCHEC") << std::endl;
+    }
+}
+
+/* ========================================================================== */
+/*                          ARGUMENTS                                         */
+/* ========================================================================== */
+
+MicroConfig parseArguments(int argc, char* argv[]) {
+    MicroConfig config;
+    config.repeat = 7;
+    config.scale = 1.0;
+    config.cpu = -1;
+    config.format = "text";
+    config.thresholdPercent = 10.0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t separator = arg.find('=');
+        std::string name = arg.substr(0, separator);
+        std::string value = (separator == std::string::npos) ? "" : arg.substr(separator + 1);
+
+        if (name == "--filter") {
+            config.filter = value;
+        } else if (name == "--repeat") {
+            config.repeat = std::stoi(value);
+            if (config.repeat < 1) {
+                throw std::invalid_argument("--repeat doit être >= 1");
+            }
+        } else if (name == "--scale") {
+            config.scale = std::stod(value);
+            if (config.scale <= 0) {
+                throw std::invalid_argument("--scale doit être > 0");
+            }
+        } else if (name == "--cpu") {
+            config.cpu = std::stoi(value);
+            if (config.cpu < 0) {
+                throw std::invalid_argument("--cpu doit être >= 0");
+            }
+        } else if (name == "--format") {
+            if (value != "text" && value != "json" && value != "csv") {
+                throw std::invalid_argument("--format doit valoir text, json ou csv");
+            }
+            config.format = value;
+        } else if (name == "--output") {
+            config.outputPath = value;
+        } else if (name == "--save-baseline") {
+            config.saveBaselinePath = value;
+        } else if (name == "--baseline") {
+            config.baselinePath = value;
+        } else if (name == "--threshold") {
+            config.thresholdPercent = std::stod(value);
+            if (config.thresholdPercent < 0) {
+                throw std::invalid_argument("--threshold doit être >= 0");
+            }
+        } else {
+            throw std::invalid_argument("Option inconnue: " + arg);
+        }
+    }
+    return config;
+}
+
+/* ========================================================================== */
+/*                          PROGRAMME PRINCIPAL                               */
+/* ========================================================================== */
+
+int main(int argc, char* argv[]) {
+    try {
+        MicroConfig config = parseArguments(argc, argv);
+
+        /* Épinglage : pas de migration entre cœurs pendant les mesures */
+        if (config.cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(config.cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                throw std::runtime_error("Échec de l'épinglage sur le cœur " + std::to_string(config.cpu)
+                                         + ": " + strerror(errno));
+            }
+        }
+
+        std::map<std::string, double> baseline;
+        if (!config.baselinePath.empty()) {
+            baseline = loadBaseline(config.baselinePath);
+        }
+
+        std::vector<MicroResult> results;
+        bool regression = false;
+        for (const MicroBenchmark& benchmark : makeBenchmarks()) {
+            if (!config.filter.empty() && benchmark.name.find(config.filter) == std::string::npos) {
+                continue;
+            }
+            MicroResult result = measure(benchmark, config);
+
+            auto reference = baseline.find(result.name);
+            if (reference != baseline.end() && reference->second > 0) {
+                result.baselineNanos = reference->second;
+                result.regression = result.medianNanos > reference->second * (1.0 + config.thresholdPercent / 100.0);
+                regression = regression || result.regression;
+            }
+            results.push_back(result);
+        }
+
+        std::unique_ptr<RingMoves> moves;
+        if (config.filter.empty() || std::string("hash_ring_moves").find(config.filter) != std::string::npos) {
+            uint64_t users = std::max<uint64_t>(1000, static_cast<uint64_t>(100000 * config.scale));
+            moves = std::make_unique<RingMoves>(measureRingMoves(4, users));
+        }
+
+        if (config.outputPath.empty()) {
+            writeResults(std::cout, results, moves.get(), config);
+        } else {
+            std::ofstream file(config.outputPath);
+            if (!file) {
+                throw std::runtime_error("Impossible d'écrire " + config.outputPath);
+            }
+            writeResults(file, results, moves.get(), config);
+        }
+
+        if (!config.saveBaselinePath.empty()) {
+            saveBaseline(config.saveBaselinePath, results);
+        }
+
+        if (regression) {
+            std::cerr << "Régression au-delà de " << config.thresholdPercent << " % détectée" << std::endl;
+            return 2;
+        }
+        if (moves && !ringMovesAcceptable(*moves)) {
+            std::cerr << "Anneau de rattachement : l'ajout d'un nœud déplace trop de noms" << std::endl;
+            return 2;
+        }
+
+    } catch (const std::exception& e) {
+        std::cerr << "Erreur: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
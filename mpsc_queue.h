@@ -0,0 +1,150 @@
+/*
+ * mpsc_queue.h
+ *
+ * File sans verrou à producteurs multiples et consommateur unique.
+ *
+ * Algorithme de D. Vyukov : liste chaînée dont la tête est échangée
+ * atomiquement par les producteurs (un seul exchange, pas de boucle de
+ * réessai : push() termine en un nombre borné d'étapes) et dont la queue
+ * n'est lue que par le consommateur. Un nœud factice évite tout cas
+ * particulier pour la file vide.
+ *
+ * Le consommateur peut s'endormir en attendant un nombre minimal
+ * d'éléments : il publie ce seuil avant de dormir, et seul le producteur
+ * qui le franchit prend le mutex de réveil. Tant que le consommateur
+ * travaille, les producteurs ne touchent à aucun verrou.
+ *
+ * Un producteur interrompu entre l'échange de la tête et le chaînage
+ * de son nœud masque temporairement les nœuds suivants : tryPop()
+ * retourne alors false bien que size() soit non nul, jusqu'à ce qu'il
+ * reprenne.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include "lock_profiler.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <limits>
+#include <utility>
+#include <cstddef>
+
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue()
+        : m_head(&m_stub), m_tail(&m_stub), m_size(0), m_wakeAt(NOT_SLEEPING) {
+        m_stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~MpscQueue() {
+        T value;
+        while (tryPop(value)) {
+        }
+        if (m_tail != &m_stub) {
+            delete m_tail;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /* Ajout en fin de file (tout thread, sans verrou) */
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+
+        /* Réveil seulement si le consommateur dort et attend ce nombre d'éléments */
+        size_t size = m_size.fetch_add(1) + 1;
+        if (size >= m_wakeAt.load()) {
+            LockGuard<QueueMutex> lock(m_mutex);
+            m_cond.notify_one();
+        }
+    }
+
+    /* Retrait du plus ancien élément (consommateur uniquement) */
+    bool tryPop(T& out) {
+        Node* tail = m_tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+
+        out = std::move(next->value);
+        m_tail = next;
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        if (tail != &m_stub) {
+            delete tail;
+        }
+        return true;
+    }
+
+    /* Nombre d'éléments déposés et non retirés (approximatif) */
+    size_t size() const { return m_size.load(std::memory_order_relaxed); }
+    bool empty() const { return size() == 0; }
+
+    /*
+     * Attente (consommateur) d'au moins minItems éléments, ou de stop()
+     * vrai après un appel à wake(). Retourne immédiatement si le seuil
+     * est déjà atteint.
+     */
+    template <typename Stop>
+    void wait(size_t minItems, Stop stop) {
+        UniqueLock<QueueMutex> lock(m_mutex);
+        m_wakeAt.store(minItems);
+        m_cond.wait(lock, [&] { return m_size.load() >= minItems || stop(); });
+        m_wakeAt.store(NOT_SLEEPING, std::memory_order_relaxed);
+    }
+
+    /* Idem, limitée à timeout */
+    template <typename Rep, typename Period, typename Stop>
+    void waitFor(size_t minItems, std::chrono::duration<Rep, Period> timeout, Stop stop) {
+        UniqueLock<QueueMutex> lock(m_mutex);
+        m_wakeAt.store(minItems);
+        m_cond.wait_for(lock, timeout, [&] { return m_size.load() >= minItems || stop(); });
+        m_wakeAt.store(NOT_SLEEPING, std::memory_order_relaxed);
+    }
+
+    /*
+     * Réveil inconditionnel du consommateur (arrêt). Le mutex est pris
+     * pour qu'un consommateur entre le test de son prédicat et sa mise
+     * en attente ne manque pas la notification.
+     */
+    void wake() {
+        LockGuard<QueueMutex> lock(m_mutex);
+        m_cond.notify_all();
+    }
+
+private:
+    using QueueMutex = ProfiledMutex<LockClass::Queue>;
+
+    static constexpr size_t NOT_SLEEPING = std::numeric_limits<size_t>::max();
+
+    struct Node {
+        Node() = default;
+        explicit Node(T&& v) : value(std::move(v)) {}
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    /*
+     * Tête (producteurs) et queue (consommateur) sur des lignes de cache
+     * distinctes : les dépôts n'invalident pas la ligne lue par le
+     * consommateur.
+     */
+    alignas(64) std::atomic<Node*> m_head;
+    alignas(64) Node* m_tail;
+    Node m_stub;
+    alignas(64) std::atomic<size_t> m_size;
+    std::atomic<size_t> m_wakeAt;       /* Seuil de réveil, NOT_SLEEPING sinon */
+    QueueMutex m_mutex;                 /* Sommeil du consommateur uniquement  */
+    LockCondition m_cond;
+};
+
+#endif /* MPSC_QUEUE_H */
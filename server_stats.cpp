@@ -0,0 +1,137 @@
+/*
+ * server_stats.cpp
+ *
+ * Implémentation des métriques du serveur (voir server_stats.h).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "server_stats.h"
+#include <chrono>
+
+/* ========================================================================== */
+/*                              NOMS                                          */
+/* ========================================================================== */
+
+const char* statName(StatCounter counter) {
+    switch (counter) {
+        case StatCounter::FramesIn:          return "frames_in";
+        case StatCounter::BytesIn:           return "bytes_in";
+        case StatCounter::FramesOut:         return "frames_out";
+        case StatCounter::BytesOut:          return "bytes_out";
+        case StatCounter::MessagesEnqueued:  return "messages_enqueued";
+        case StatCounter::MessagesDelivered: return "messages_delivered";
+        case StatCounter::MessagesStored:    return "messages_stored";
+        case StatCounter::MessagesFailed:    return "messages_failed";
+        case StatCounter::MessagesRelayed:   return "messages_relayed";
+        case StatCounter::PoolJobs:          return "pool_jobs";
+        case StatCounter::PoolSteals:        return "pool_steals";
+        case StatCounter::LoginsRedirected:  return "logins_redirected";
+        case StatCounter::Count:             break;
+    }
+    return "?";
+}
+
+const char* statName(StatTimer timer) {
+    switch (timer) {
+        case StatTimer::QueueTime:         return "queue_time";
+        case StatTimer::PoolWait:          return "pool_wait";
+        case StatTimer::CommandSend:       return "cmd_send";
+        case StatTimer::CommandSendBatch:  return "cmd_send_batch";
+        case StatTimer::CommandListUsers:  return "cmd_list_users";
+        case StatTimer::CommandGetHistory: return "cmd_get_history";
+        case StatTimer::CommandGetLog:     return "cmd_get_log";
+        case StatTimer::CommandStats:      return "cmd_stats";
+        case StatTimer::CommandDisconnect: return "cmd_disconnect";
+        case StatTimer::CommandOther:      return "cmd_other";
+        case StatTimer::Count:             break;
+    }
+    return "?";
+}
+
+/* ========================================================================== */
+/*                        BLOCS PAR THREAD                                    */
+/* ========================================================================== */
+
+ServerStats::~ServerStats() {
+    for (auto& block : m_blocks) {
+        for (auto& timer : block->timers) {
+            delete timer.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/*
+ * Bloc du thread appelant, créé et inscrit au premier appel. Seule
+ * l'inscription prend le verrou ; les appels suivants ne lisent que
+ * deux variables thread_local.
+ */
+ServerStats::Block& ServerStats::localBlock() {
+    thread_local ServerStats* owner = nullptr;
+    thread_local Block* block = nullptr;
+
+    if (owner != this) {
+        auto created = std::make_unique<Block>();
+        block = created.get();
+        owner = this;
+        std::lock_guard<std::mutex> lock(m_blocksMutex);
+        m_blocks.push_back(std::move(created));
+    }
+    return *block;
+}
+
+/*
+ * L'histogramme est publié (release) après sa construction : un
+ * snapshot concurrent le voit soit absent, soit entièrement initialisé.
+ */
+void ServerStats::record(StatTimer timer, uint64_t nanos) {
+    std::atomic<Histogram*>& slot = localBlock().timers[static_cast<size_t>(timer)];
+    Histogram* histogram = slot.load(std::memory_order_relaxed);
+    if (histogram == nullptr) {
+        histogram = new Histogram();
+        slot.store(histogram, std::memory_order_release);
+    }
+    histogram->record(nanos);
+}
+
+/* ========================================================================== */
+/*                              LECTURE                                       */
+/* ========================================================================== */
+
+StatsSnapshot ServerStats::snapshot() const {
+    StatsSnapshot snapshot;
+    for (auto& value : snapshot.counters) {
+        value = 0;
+    }
+    for (size_t i = 0; i < STAT_TIMERS; ++i) {
+        snapshot.timers.push_back(std::make_unique<Histogram>());
+    }
+
+    std::lock_guard<std::mutex> lock(m_blocksMutex);
+    for (const auto& block : m_blocks) {
+        for (size_t i = 0; i < STAT_COUNTERS; ++i) {
+            snapshot.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < STAT_TIMERS; ++i) {
+            const Histogram* histogram = block->timers[i].load(std::memory_order_acquire);
+            if (histogram != nullptr) {
+                snapshot.timers[i]->merge(*histogram);
+            }
+        }
+    }
+    return snapshot;
+}
+
+/* ========================================================================== */
+/*                           INSTANCE ET HORLOGE                              */
+/* ========================================================================== */
+
+ServerStats& serverStats() {
+    static ServerStats stats;
+    return stats;
+}
+
+uint64_t statsClockNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
@@ -0,0 +1,128 @@
+/*
+ * server_stats.h
+ *
+ * Métriques du serveur : compteurs (trames, octets, messages) et
+ * histogrammes de durées (temps passé en file, traitement des
+ * commandes), exposés par la commande STATS et --stats-interval.
+ *
+ * Chaque thread qui compte (boucles d'événements, workers de livraison
+ * et du pool des commandes)
+ * écrit dans son propre bloc, créé et inscrit à son premier appel : un
+ * compteur n'a qu'un seul écrivain, et add() / record() ne prennent
+ * aucun verrou ni instruction verrouillée. La lecture (snapshot) fait
+ * la somme des blocs sans arrêter les écrivains ; elle ne prend que le
+ * verrou d'inscription, jamais tenu par un thread qui compte.
+ *
+ * Les histogrammes (≈ 30 Kio chacun, voir histogram.h) sont alloués à
+ * la première valeur enregistrée par le thread. Les blocs ne sont
+ * jamais libérés avant la fin du programme : un thread terminé garde
+ * ses valeurs dans les totaux.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include "histogram.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/* Compteurs cumulés depuis le démarrage */
+enum class StatCounter {
+    FramesIn,           /* Trames reçues des clients                     */
+    BytesIn,            /* Octets de ces trames (préfixe de longueur inclus) */
+    FramesOut,          /* Trames acceptées dans les files de sortie     */
+    BytesOut,           /* Octets de ces trames (portions de fichier incluses) */
+    MessagesEnqueued,   /* Messages mis en file de livraison             */
+    MessagesDelivered,  /* Livraisons (un broadcast compte par destinataire) */
+    MessagesStored,     /* Messages conservés pour un destinataire absent */
+    MessagesFailed,     /* Livraisons refusées (boîte pleine, file pleine) */
+    MessagesRelayed,    /* Trames RELAY envoyées à d'autres nœuds        */
+    PoolJobs,           /* Calculs exécutés par le pool des commandes    */
+    PoolSteals,         /* Dont pris dans la file d'un autre worker      */
+    LoginsRedirected,   /* Identifications renvoyées vers un autre nœud  */
+    Count
+};
+
+/* Durées mesurées, en nanosecondes */
+enum class StatTimer {
+    QueueTime,          /* Mise en file -> retrait par le worker         */
+    PoolWait,           /* Dépôt dans le pool des commandes -> début     */
+    CommandSend,        /* Traitement d'une commande, par type           */
+    CommandSendBatch,
+    CommandListUsers,
+    CommandGetHistory,
+    CommandGetLog,
+    CommandStats,
+    CommandDisconnect,
+    CommandOther,
+    Count
+};
+
+constexpr size_t STAT_COUNTERS = static_cast<size_t>(StatCounter::Count);
+constexpr size_t STAT_TIMERS = static_cast<size_t>(StatTimer::Count);
+
+/* Nom d'une métrique dans les rapports (ex. "frames_in", "cmd_send") */
+const char* statName(StatCounter counter);
+const char* statName(StatTimer timer);
+
+/* Totaux de tous les threads à un instant donné */
+struct StatsSnapshot {
+    uint64_t counters[STAT_COUNTERS];
+    std::vector<std::unique_ptr<Histogram>> timers;  /* Un par StatTimer */
+
+    uint64_t counter(StatCounter counter) const { return counters[static_cast<size_t>(counter)]; }
+    const Histogram& timer(StatTimer timer) const { return *timers[static_cast<size_t>(timer)]; }
+};
+
+/*
+ * Classe ServerStats
+ *
+ * add() et record() sont appelables depuis n'importe quel thread ;
+ * snapshot() aussi, pendant que les autres comptent.
+ */
+class ServerStats {
+public:
+    ServerStats() = default;
+    ~ServerStats();
+
+    ServerStats(const ServerStats&) = delete;
+    ServerStats& operator=(const ServerStats&) = delete;
+
+    /* Ajout au compteur du thread appelant */
+    void add(StatCounter counter, uint64_t amount = 1) {
+        std::atomic<uint64_t>& value = localBlock().counters[static_cast<size_t>(counter)];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    /* Enregistrement d'une durée dans l'histogramme du thread appelant */
+    void record(StatTimer timer, uint64_t nanos);
+
+    /* Somme des compteurs et fusion des histogrammes de tous les threads */
+    StatsSnapshot snapshot() const;
+
+private:
+    /* Bloc d'un thread, aligné sur une ligne de cache (pas de faux partage) */
+    struct alignas(64) Block {
+        std::atomic<uint64_t> counters[STAT_COUNTERS] = {};
+        std::atomic<Histogram*> timers[STAT_TIMERS] = {};
+    };
+
+    Block& localBlock();
+
+    mutable std::mutex m_blocksMutex;             /* Protège m_blocks (inscription) */
+    std::vector<std::unique_ptr<Block>> m_blocks;
+};
+
+/* Métriques du processus (serveur) */
+ServerStats& serverStats();
+
+/* Horloge monotone des mesures, en nanosecondes */
+uint64_t statsClockNanos();
+
+#endif /* SERVER_STATS_H */
@@ -4,12 +4,43 @@
  * Serveur de messagerie instantanée multi-threadé.
  * 
  * Architecture :
- *   - Thread principal     : accepte les connexions entrantes
- *   - Threads utilisateurs : un par client connecté (réception commandes)
- *   - Thread de livraison  : distribue les messages toutes les 30 secondes
+ *   - Boucles d'événements : une par cœur (epoll, edge-triggered), chacune
+ *                            accepte des connexions et gère leurs sockets
+ *                            non bloquants (lecture des trames, commandes)
+ *   - Sessions             : une coroutine par connexion (voir session.h),
+ *                            reprise par sa boucle à chaque trame reçue ;
+ *                            les commandes s'écrivent comme du code
+ *                            séquentiel sans thread par client
+ *   - Workers de livraison : réveillés dès qu'un message est mis en file
+ *                            (ou toutes les 30 secondes en mode périodique) ;
+ *                            répartition par destinataire, une file chacun
+ *   - Pool des commandes   : workers à vol de travail (voir worker_pool.h)
+ *                            qui exécutent la partie coûteuse de LIST_USERS,
+ *                            GET_HISTORY, GET_LOG et STATS hors des boucles ;
+ *                            la session attend le résultat, sa boucle
+ *                            continue de servir les autres connexions
+ *   - Thread du journal    : écrit le log par lots, hors du chemin des
+ *                            requêtes (voir logger.h)
+ *   - Fédération           : avec --peers, plusieurs serveurs forment une
+ *                            grappe (voir cluster.h) ; chaque nœud relie
+ *                            ses pairs par des liaisons persistantes et y
+ *                            relaie les messages de leurs utilisateurs ;
+ *                            un anneau de hachage cohérent donne à chaque
+ *                            utilisateur son nœud (voir hash_ring.h)
+ *   - Métriques            : compteurs et histogrammes par thread (voir
+ *                            server_stats.h), lus par la commande STATS et
+ *                            copiés dans le log toutes les --stats-interval s
+ * 
+ * Le nombre de threads ne dépend plus du nombre de clients connectés,
+ * et une connexion inactive ne consomme aucun CPU.
  * 
  * Synchronisation :
- *   - Mutex sur les structures partagées (utilisateurs, file, historique)
+ *   - File des messages sans verrou (voir mpsc_queue.h) : les SEND et
+ *     la livraison ne se bloquent jamais mutuellement
+ *   - Mutex sur les autres structures partagées (utilisateurs, historique)
+ *   - File de sortie bornée par connexion : aucun envoi bloquant, aucun
+ *     envoi sous un verrou global ; un client lent est coupé (ou ses
+ *     messages ignorés) au-delà de --max-outbound octets en attente
  *   - Variable atomique pour le flag d'arrêt
  * 
  * Projet R3.05 - Programmation Système
@@ -17,39 +48,137 @@
 
 #include "message.h"
 #include "socket_utils.h"
+#include "event_loop.h"
+#include "connection.h"
+#include "session.h"
+#include "user_registry.h"
+#include "logger.h"
+#include "history_store.h"
+#include "mailbox_store.h"
+#include "mpsc_queue.h"
+#include "message_pool.h"
+#include "server_stats.h"
+#include "worker_pool.h"
+#include "cluster.h"
 #include <iostream>
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
-#include <fstream>
 #include <chrono>
 #include <map>
 #include <algorithm>
-#include <sstream>
-#include <iomanip>
 #include <ctime>
 #include <atomic>
+#include <memory>
+#include <csignal>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <poll.h>
 
 /* ========================================================================== */
 /*                          CONFIGURATION                                     */
 /* ========================================================================== */
 
-constexpr int PORT = 8888;                        /* Port d'écoute du serveur       */
-constexpr int DELIVERY_INTERVAL_SECONDS = 30;     /* Intervalle de livraison (s)    */
+constexpr int DEFAULT_PORT = 8888;                /* Port d'écoute du serveur       */
+constexpr int DELIVERY_INTERVAL_SECONDS = 30;     /* Intervalle par défaut (s)      */
+constexpr size_t DEFAULT_BATCH_MAX = 64;          /* Taille max d'un lot de livraison */
+constexpr size_t MAX_COMMAND_SIZE = 255;          /* Taille max nom / commande      */
+constexpr size_t HISTORY_PAGE_MAX = 100;          /* Messages max par GET_HISTORY   */
+constexpr size_t HISTORY_SCAN_MAX = 4096;         /* Messages examinés par requête  */
+constexpr size_t MAILBOX_BATCH_MAX = 64;          /* Messages par trame MSG_BATCH   */
+constexpr int CLUSTER_RETRY_MS = 1000;            /* Reconnexion aux pairs (ms)     */
+constexpr int CLUSTER_CONNECT_TIMEOUT_MS = 2000;  /* Connexion à un pair (ms)       */
+constexpr size_t CLUSTER_OUTBOUND_BYTES = 16 * 1024 * 1024; /* File d'une liaison vers un pair */
 
-/* ========================================================================== */
-/*                      STRUCTURES DE DONNÉES                                 */
-/* ========================================================================== */
+/*
+ * Mode de livraison des messages.
+ *   - Immediate : le worker de livraison est réveillé à chaque mise en file
+ *   - Periodic  : ancien comportement, livraison toutes les N secondes
+ */
+enum class DeliveryMode {
+    Immediate,
+    Periodic
+};
 
 /*
- * Structure représentant un utilisateur connecté.
- * Chaque client dispose de son propre thread de gestion.
+ * Options de lancement du serveur (ligne de commande).
+ *   --port=N                : port d'écoute (défaut : 8888)
+ *   --backlog=N             : file des connexions en attente (défaut : SOMAXCONN)
+ *   --reuseport=0|1         : un socket d'écoute SO_REUSEPORT par boucle (défaut : 0,
+ *                             socket partagé avec EPOLLEXCLUSIVE)
+ *   --io-threads=N          : nombre de boucles d'événements (défaut : nombre de cœurs)
+ *   --io-backend=NOM        : epoll (défaut) ou io_uring (repli sur epoll si indisponible)
+ *   --delivery=MODE         : immediate (défaut) ou periodic
+ *   --delivery-interval=S   : intervalle du mode périodique en secondes (défaut : 30)
+ *   --delivery-workers=N    : workers de livraison, messages répartis par destinataire
+ *                             (défaut : nombre de cœurs, 64 max)
+ *   --command-workers=N     : workers du pool des commandes (défaut : nombre de cœurs,
+ *                             0 = commandes exécutées par les boucles)
+ *   --batch-window-us=N     : fenêtre de regroupement en µs (défaut : 0, désactivée)
+ *   --batch-max=N           : nombre de messages qui déclenche la livraison du lot
+ *   --max-outbound=OCTETS   : limite de la file de sortie d'un client (défaut : 1 Mio)
+ *   --slow-consumer=ACTION  : disconnect (défaut) ou drop quand la limite est atteinte
+ *   --wire-format=FORMAT    : format le plus récent accepté, compact (défaut) ou legacy
+ *   --tcp-nodelay=0|1       : TCP_NODELAY sur les sockets clients (défaut : 1)
+ *   --sndbuf=OCTETS         : taille SO_SNDBUF (défaut : valeur système)
+ *   --rcvbuf=OCTETS         : taille SO_RCVBUF (défaut : valeur système)
+ *   --log-echo=0|1          : copie du log sur la console (défaut : 1)
+ *   --log-flush=POLITIQUE   : batch (défaut, flush après chaque lot) ou interval
+ *   --log-flush-ms=N        : intervalle de flush de la politique interval (défaut : 1000)
+ *   --log-max-size=OCTETS   : rotation du log au-delà de cette taille (défaut : 0, jamais)
+ *   --log-keep=N            : nombre d'anciens fichiers de log conservés (défaut : 5)
+ *   --history-dir=CHEMIN    : répertoire de l'historique (défaut : history)
+ *   --history-segment-size=OCTETS : taille max d'un segment (défaut : 16 Mio)
+ *   --history-segments=N    : nombre de segments conservés (défaut : 16, 0 = tous)
+ *   --history-max-age=S     : âge max des messages conservés en secondes (défaut : 0, illimité)
+ *   --mailbox-dir=CHEMIN    : répertoire des débordements de boîtes (défaut : mailboxes)
+ *   --mailbox-max=N         : messages max en attente par utilisateur (défaut : 1000)
+ *   --mailbox-memory=N      : messages en attente gardés en mémoire, au total (défaut : 10000)
+ *   --stats-interval=S      : copie des métriques dans le log toutes les S secondes
+ *                             (défaut : 0, désactivée ; voir la commande STATS)
+ *   --node-id=NOM           : nom de ce nœud dans la grappe (obligatoire avec --peers)
+ *   --peers=LISTE           : autres nœuds, "<nom>@<ip>:<port>,..." (port client de
+ *                             chaque pair ; défaut : aucun, serveur seul)
+ *   --cluster-secret=S      : secret partagé exigé des liaisons entre nœuds
+ *                             (obligatoire avec --peers)
+ *   --ring-vnodes=N         : nœuds virtuels par nœud sur l'anneau de rattachement
+ *                             (défaut : 128 ; identique sur tous les nœuds)
  */
-struct ConnectedUser {
-    std::string username;           /* Nom d'utilisateur                      */
-    SOCKET socket;                  /* Socket de communication                */
-    std::thread* handlerThread;     /* Thread dédié à ce client               */
+struct ServerConfig {
+    int port;                       /* Port d'écoute                          */
+    int backlog;                    /* File des connexions en attente         */
+    bool reusePort;                 /* Un socket d'écoute par boucle          */
+    int ioThreads;                  /* Nombre de boucles d'événements         */
+    IoBackend ioBackend;            /* epoll ou io_uring                      */
+    DeliveryMode deliveryMode;      /* Livraison immédiate ou périodique      */
+    int deliveryIntervalSeconds;    /* Intervalle du mode périodique          */
+    int deliveryWorkers;            /* Nombre de workers de livraison         */
+    int commandWorkers;             /* Workers du pool des commandes (0 : non) */
+    int batchWindowMicros;          /* Attente max pour compléter un lot      */
+    size_t batchMax;                /* Taille qui déclenche la livraison      */
+    size_t maxOutboundBytes;        /* Limite de la file de sortie            */
+    SlowConsumerPolicy slowConsumer; /* Action sur un client lent             */
+    WireFormat maxWireFormat;       /* Format de message le plus récent accepté */
+    SocketOptions socketOptions;    /* Options TCP des sockets                */
+    LoggerOptions logOptions;       /* Console, politique de flush du log     */
+    HistoryOptions historyOptions;  /* Répertoire et rétention de l'historique */
+    MailboxOptions mailboxOptions;  /* Limites des boîtes de réception        */
+    int statsIntervalSeconds;       /* Copie périodique des métriques (0 : non) */
+    std::string nodeId;             /* Nom du nœud dans la grappe             */
+    std::vector<PeerAddress> peers; /* Autres nœuds (vide : serveur seul)     */
+    std::string clusterSecret;      /* Secret des liaisons (vide : aucun)     */
+    size_t ringVirtualNodes;        /* Nœuds virtuels par nœud sur l'anneau   */
+};
+
+/* Message en file de livraison, daté pour mesurer son temps d'attente */
+struct QueuedMessage {
+    MessageRef message;
+    uint64_t enqueuedAt = 0;        /* statsClockNanos() à la mise en file    */
+    bool relayed = false;           /* Reçu d'un autre nœud : livré ici seulement */
 };
 
 /* ========================================================================== */
@@ -57,441 +186,1946 @@ struct ConnectedUser {
 /* ========================================================================== */
 
 /* Données partagées entre les threads */
-std::vector<ConnectedUser> g_connectedUsers;  /* Liste des utilisateurs connectés  */
-std::queue<Message> g_messageQueue;           /* File d'attente des messages       */
-std::vector<Message> g_messageHistory;        /* Historique des messages           */
-
-/* Mutex pour la synchronisation (exclusion mutuelle) */
-std::mutex g_usersMutex;                      /* Protection de g_connectedUsers    */
-std::mutex g_queueMutex;                      /* Protection de g_messageQueue      */
-std::mutex g_historyMutex;                    /* Protection de g_messageHistory    */
-std::mutex g_logMutex;                        /* Protection de l'écriture log      */
+UserRegistry g_registry;                      /* Utilisateurs connectés (shardé)   */
+MessagePool g_messagePool;                    /* Messages reçus (partagés, immuables) */
+std::vector<std::unique_ptr<MpscQueue<QueuedMessage>>> g_deliveryQueues; /* Une file par worker */
+HistoryStore g_history;                       /* Historique persistant (segments)  */
+MailboxStore g_mailboxes;                     /* Boîtes des utilisateurs absents   */
+WorkerPool g_commandPool;                     /* Exécution des commandes coûteuses */
+ClusterDirectory g_cluster;                   /* Pairs et utilisateurs distants    */
 
 /* Autres variables globales */
-std::ofstream g_logFile;                      /* Fichier de journalisation         */
+Logger g_logger;                              /* Journal asynchrone (server.log)   */
 std::atomic<bool> g_serverRunning(true);      /* Flag d'arrêt (atomique)           */
+ServerConfig g_config;                        /* Options de lancement              */
+std::vector<std::unique_ptr<EventLoop>> g_eventLoops; /* Une boucle par cœur       */
+uint64_t g_startNanos = 0;                    /* Démarrage (durée de fonctionnement) */
+std::mutex g_statsMutex;                      /* Réveil du thread des métriques    */
+std::condition_variable g_statsCond;
+std::mutex g_clusterMutex;                    /* Réveil du thread des liaisons     */
+std::condition_variable g_clusterCond;
 
 /* ========================================================================== */
 /*                      PROTOTYPES DE FONCTIONS                               */
 /* ========================================================================== */
 
 void writeLog(const std::string& message);
-std::string getCurrentTimestamp();
-void userHandlerThread(SOCKET clientSocket, std::string clientIP);
-void deliveryThread();
-void sendMessageToUser(const std::string& username, const Message& msg);
-void broadcastMessage(const Message& msg);
+SOCKET createListener();
+void acceptClient(EventLoop& loop, SOCKET clientSocket, const std::string& clientIP);
+void onClientEvent(const std::shared_ptr<Connection>& conn, uint32_t events);
+void onClientData(const std::shared_ptr<Connection>& conn, const char* data, size_t size);
+void onLoopError(SOCKET fd, const std::string& what);
+void resumeSession(const std::shared_ptr<Connection>& conn, std::coroutine_handle<> session);
+bool readFromClient(Connection& conn);
+Session runSession(std::shared_ptr<Connection> conn);
+Connection::WriteAwaiter reply(Connection& conn, const std::string& response);
+bool handleLogin(Connection& conn, const std::string& loginFrame);
+void closeConnection(const std::shared_ptr<Connection>& conn);
+bool sendFrame(Connection& conn, const char* data, size_t size);
+bool sendEncodedFrame(Connection& conn, const FrameBuffer& frame);
+FrameBuffer encodeMessageFrame(const Message& msg, WireFormat format);
+bool sendResponse(Connection& conn, const std::string& response);
+void stopServer();
+void enqueueMessage(const MessageRef& msg, bool relayed = false);
+size_t deliveryWorkerFor(const std::string& recipient);
+void deliveryThread(size_t worker);
+void deliverMessage(const Message& msg, size_t worker, bool relayed);
+FrameBuffer encodeMessageBatch(const std::vector<Message>& messages, WireFormat format);
+void pumpMailbox(Connection& conn);
+void broadcastMessage(const Message& msg, size_t worker);
 std::string getUsernameBySocket(SOCKET sock);
 void removeUser(SOCKET sock);
-void handleCommand(SOCKET clientSocket, const std::string& username, const std::string& command);
-bool isUserConnected(const std::string& username);
+Task handleCommand(Connection& conn, std::string command);
+void handleSendPayload(Connection& conn, const std::string& sendId, const char* data, size_t size);
+void handleSendBatch(Connection& conn, const char* data, size_t size);
+Task startLogStream(Connection& conn, std::string request);
+Task sendHistory(Connection& conn, std::string request);
+std::string formatStats();
+void statsThread();
+ServerConfig parseArguments(int argc, char* argv[]);
 void sendNotificationToSender(const std::string& senderUsername, const std::string& notification);
+FrameBuffer encodeRelayFrame(const Message& msg);
+void announcePresence(const std::string& event, const std::string& username);
+Task servePeer(Connection& conn, std::string hello);
+void handlePeerFrame(const std::string& node, const char* data, size_t size);
+void attachPeerLink(EventLoop& loop, SOCKET sock, const PeerAddress& peer);
+Session runPeerLink(std::shared_ptr<Connection> link, std::string node);
+void clusterThread();
 
 /* ========================================================================== */
 /*                           JOURNALISATION                                   */
 /* ========================================================================== */
 
 /*
- * Écrit un message horodaté dans le fichier de log et sur la console.
- * Thread-safe grâce au mutex g_logMutex.
+ * Écrit un message horodaté dans le fichier de log (et sur la console
+ * si --log-echo=1).
+ * 
+ * L'entrée est seulement déposée dans l'anneau du thread appelant :
+ * l'écriture sur disque est faite par lots par le thread du Logger.
  */
 void writeLog(const std::string& message) {
-    std::lock_guard<std::mutex> lock(g_logMutex);
-    std::string timestamp = getCurrentTimestamp();
-    std::string logEntry = "[" + timestamp + "] " + message;
-    g_logFile << logEntry << std::endl;
-    g_logFile.flush();
-    std::cout << logEntry << std::endl;
+    g_logger.log(message);
 }
 
+/* ========================================================================== */
+/*                    BOUCLES D'ÉVÉNEMENTS (RÉACTEUR)                         */
+/* ========================================================================== */
+
 /*
- * Retourne l'heure actuelle formatée en chaîne de caractères.
- * Format : YYYY-MM-DD HH:MM:SS
+ * Crée un socket d'écoute non bloquant sur --port, avec --backlog
+ * (et SO_REUSEPORT si --reuseport=1).
  */
-std::string getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t_now = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time_t_now), "%Y-%m-%d %H:%M:%S");
-    return ss.str();
+SOCKET createListener() {
+    SOCKET listener = SocketUtils::createTCPSocket(g_config.socketOptions);
+    try {
+        if (g_config.reusePort) {
+            SocketUtils::enableReusePort(listener);
+        }
+        SocketUtils::bindSocket(listener, g_config.port);
+        SocketUtils::listenSocket(listener, g_config.backlog);
+        SocketUtils::setNonBlocking(listener);
+    } catch (...) {
+        SocketUtils::closeSocket(listener);
+        throw;
+    }
+    return listener;
 }
 
-/* ========================================================================== */
-/*                    THREAD DE GESTION UTILISATEUR                           */
-/* ========================================================================== */
-
 /*
- * Thread dédié à la gestion d'un client connecté.
+ * Accepte les connexions en attente sur un socket d'écoute.
+ * 
+ * Appelée par la boucle qui a reçu l'événement. Selon --reuseport :
+ *   - 0 : socket d'écoute partagé, enregistré dans toutes les boucles
+ *         avec EPOLLEXCLUSIVE (le noyau ne réveille qu'une boucle)
+ *   - 1 : un socket d'écoute par boucle (SO_REUSEPORT), le noyau
+ *         répartit lui-même les connexions entre les boucles
  * 
- * Cycle de vie :
- *   1. Réception du nom d'utilisateur
- *   2. Boucle de réception des commandes
- *   3. Nettoyage et fermeture à la déconnexion
+ * Avec epoll, la file du noyau est vidée jusqu'à EAGAIN (au plus
+ * ACCEPT_BATCH_MAX connexions par réveil) ; avec io_uring, un accept
+ * multishot produit une complétion par connexion. Une rafale de
+ * reconnexions ne déborde donc pas le backlog à raison d'un accept()
+ * par réveil.
  * 
- * Paramètres :
- *   - clientSocket : socket de communication avec ce client
- *   - clientIP     : adresse IP du client (pour le log)
+ * Chaque nouvelle connexion reste attachée à cette boucle pour toute
+ * sa durée de vie ; sa session démarre aussitôt et attend la trame
+ * d'identification.
  */
-void userHandlerThread(SOCKET clientSocket, std::string clientIP) {
-    std::string username;
+void acceptClient(EventLoop& loop, SOCKET clientSocket, const std::string& clientIP) {
+    if (clientSocket == INVALID_SOCKET) {
+        writeLog("Erreur d'acceptation: " + clientIP);
+        return;
+    }
     
     try {
-        /* Étape 1 : Réception du nom d'utilisateur */
-        char buffer[256];
-        size_t received = SocketUtils::receiveWithLength(clientSocket, buffer, sizeof(buffer) - 1);
-        if (received == 0) {
-            throw std::runtime_error("Déconnexion lors de la réception du nom");
-        }
-        buffer[received] = '\0';
-        username = std::string(buffer);
-        
-        /* Mise à jour du nom dans la structure globale */
-        {
-            std::lock_guard<std::mutex> lock(g_usersMutex);
-            for (auto& user : g_connectedUsers) {
-                if (user.socket == clientSocket) {
-                    user.username = username;
-                    break;
-                }
+        SocketUtils::applySocketOptions(clientSocket, g_config.socketOptions);
+    } catch (const std::exception& e) {
+        writeLog("Erreur de configuration du socket de " + clientIP + ": " + std::string(e.what()));
+        SocketUtils::closeSocket(clientSocket);
+        return;
+    }
+    
+    auto conn = std::make_shared<Connection>(clientSocket, clientIP, &loop,
+                                             g_config.maxOutboundBytes, g_config.slowConsumer);
+    
+    /* Enregistrement dans le registre (nom reçu plus tard) */
+    g_registry.addConnection(conn);
+    
+    try {
+        loop.addStream(clientSocket,
+                       [conn](uint32_t events) { onClientEvent(conn, events); },
+                       [conn](const char* data, size_t size) { onClientData(conn, data, size); });
+    } catch (const std::exception& e) {
+        /* Typiquement epoll_ctl refusé faute de descripteurs : seul ce client est refusé */
+        writeLog("Erreur d'enregistrement de " + clientIP + ": " + std::string(e.what()));
+        g_registry.removeConnection(clientSocket);
+        conn->close();
+        return;
+    }
+    
+    runSession(conn);
+}
+
+/*
+ * Exception levée par un gestionnaire ou une tâche d'une boucle (voir
+ * EventLoop::setErrorHandler) : la connexion concernée est fermée, les
+ * autres clients de la boucle ne sont pas touchés.
+ */
+void onLoopError(SOCKET fd, const std::string& what) {
+    std::shared_ptr<Connection> conn = (fd == INVALID_SOCKET) ? nullptr : g_registry.findBySocket(fd);
+    if (!conn) {
+        writeLog("Erreur dans une boucle d'événements: " + what);
+        return;
+    }
+    writeLog("Erreur avec " + conn->username + ": " + what);
+    closeConnection(conn);
+}
+
+/*
+ * Gestionnaire d'événements d'une connexion client.
+ * 
+ * EPOLLOUT : le socket accepte à nouveau des données, on reprend le
+ * vidage de la file de sortie, de la boîte de réception, l'envoi de
+ * fichier en cours (GET_LOG) puis la session si elle attendait de la
+ * place ; si la lecture avait été suspendue pendant cette attente,
+ * elle reprend.
+ * 
+ * En mode edge-triggered, epoll ne signale qu'une seule fois l'arrivée
+ * de données : on lit donc jusqu'à EAGAIN, en traitant les trames
+ * complètes au fur et à mesure. Avec io_uring, les données arrivent
+ * par onClientData() et EPOLLRDHUP signale la fin du flux.
+ */
+void onClientEvent(const std::shared_ptr<Connection>& conn, uint32_t events) {
+    bool open = true;
+    
+    if (events & EPOLLOUT) {
+        conn->onWritable();
+        pumpMailbox(*conn);
+        conn->pumpStream();
+        conn->resumeWriter();
+        if (conn->inputPending && conn->frameWaiter) {
+            conn->inputPending = false;
+            if (conn->loop->receivesData()) {
+                conn->loop->resumeInput(conn->socket);
+            } else {
+                events |= EPOLLIN;
             }
         }
+    }
+    
+    if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+        return;
+    }
+    
+    try {
+        open = conn->loop->receivesData() ? false : readFromClient(*conn);
         
-        writeLog("Utilisateur connecté: " + username + " depuis " + clientIP);
-        
-        /* Étape 2 : Boucle principale de réception des commandes */
-        while (g_serverRunning) {
-            /* Vérification non-bloquante avec timeout de 1 seconde */
-            if (!SocketUtils::hasData(clientSocket, 1000)) {
-                continue;
-            }
-            
-            /* Réception de la commande */
-            received = SocketUtils::receiveWithLength(clientSocket, buffer, sizeof(buffer) - 1);
-            if (received == 0) {
-                writeLog("Utilisateur déconnecté: " + username);
-                break;
-            }
-            
-            buffer[received] = '\0';
-            std::string command(buffer);
-            
-            writeLog("Commande reçue de " + username + ": " + command);
-            handleCommand(clientSocket, username, command);
+        if (!open) {
+            writeLog("Utilisateur déconnecté: " + conn->username);
         }
         
     } catch (const std::exception& e) {
-        writeLog("Erreur avec " + username + ": " + std::string(e.what()));
+        writeLog("Erreur avec " + conn->username + ": " + std::string(e.what()));
+        open = false;
     }
     
-    /* Étape 3 : Nettoyage */
-    removeUser(clientSocket);
-    SocketUtils::closeSocket(clientSocket);
+    if (!open || (events & (EPOLLHUP | EPOLLERR))) {
+        closeConnection(conn);
+    }
 }
 
-/* ========================================================================== */
-/*                       THREAD DE LIVRAISON                                  */
-/* ========================================================================== */
+/*
+ * Données reçues par la boucle io_uring : ajoutées au tampon de la
+ * connexion, puis la session est reprise si une trame est complète.
+ * Si la session attend de la place en sortie ou un calcul du pool, les
+ * données restent dans le tampon jusqu'à sa reprise et la réception
+ * est suspendue, comme la lecture avec epoll (voir readFromClient) :
+ * le tampon ne grossit pas pour un client qui ne lit pas ses réponses.
+ */
+void onClientData(const std::shared_ptr<Connection>& conn, const char* data, size_t size) {
+    try {
+        conn->reader.append(data, size);
+        conn->resumeReader();
+        if (!conn->frameWaiter && !conn->inputPending && conn->socket != INVALID_SOCKET) {
+            conn->inputPending = true;
+            conn->loop->pauseInput(conn->socket);
+        }
+    } catch (const std::exception& e) {
+        writeLog("Erreur avec " + conn->username + ": " + std::string(e.what()));
+        closeConnection(conn);
+    }
+}
+
+/*
+ * Reprise d'une session dont le calcul confié au pool est terminé
+ * (thread de la boucle, via post). Les données arrivées pendant le
+ * calcul n'ont pas été lues (voir readFromClient) et epoll ne les
+ * signalera plus : si la session attend de nouveau une trame, la
+ * lecture reprend ici. La tâche n'ayant pas de descripteur pour la
+ * boucle, une erreur est rapportée ici au nom de la connexion.
+ */
+void resumeSession(const std::shared_ptr<Connection>& conn, std::coroutine_handle<> session) {
+    session.resume();
+    if (conn->inputPending && conn->frameWaiter) {
+        conn->inputPending = false;
+        try {
+            if (conn->loop->receivesData()) {
+                conn->loop->resumeInput(conn->socket);
+            } else {
+                onClientEvent(conn, EPOLLIN);
+            }
+        } catch (const std::exception& e) {
+            onLoopError(conn->socket, e.what());
+        }
+    }
+}
 
 /*
- * Thread de livraison périodique des messages.
+ * co_await offload(conn, fn) : fn() s'exécute dans le pool des
+ * commandes, puis la session reprend dans le thread de sa boucle. La
+ * connexion est gardée en vie jusqu'à la reprise.
+ */
+template <typename Fn>
+auto offload(Connection& conn, Fn fn) {
+    std::shared_ptr<Connection> self = conn.shared_from_this();
+    return g_commandPool.offload(std::move(fn), [self](std::coroutine_handle<> session) {
+        self->loop->post([self, session]() { resumeSession(self, session); });
+    });
+}
+
+/*
+ * Lit le socket non bloquant jusqu'à EAGAIN.
  * 
- * Fonctionnement :
- *   - Se réveille toutes les 30 secondes
- *   - Vide la file d'attente des messages
- *   - Route chaque message vers son destinataire (unicast ou broadcast)
- *   - Notifie l'expéditeur en cas d'échec de livraison
+ * Chaque recv() remplit directement le tampon de la connexion et peut
+ * ramener plusieurs trames ; la session les traite toutes avant la
+ * lecture suivante, ce qui borne la taille du tampon.
+ * 
+ * Si la session attend de la place en sortie (client qui ne lit pas ses
+ * réponses), la lecture est suspendue : le client est freiné par TCP
+ * au lieu de remplir le tampon. Elle reprend sur EPOLLOUT.
+ * 
+ * Retourne false si le client a fermé la connexion (recv() == 0)
+ * ou en cas d'erreur, true si le socket est simplement vidé (EAGAIN).
  */
-void deliveryThread() {
-    writeLog("Thread de livraison démarré");
-    
-    while (g_serverRunning) {
-        /* Attente de l'intervalle de livraison */
-        std::this_thread::sleep_for(std::chrono::seconds(DELIVERY_INTERVAL_SECONDS));
+bool readFromClient(Connection& conn) {
+    while (true) {
+        if (conn.socket == INVALID_SOCKET) {
+            return true;    /* Fermée par la session */
+        }
+        if (!conn.frameWaiter) {
+            if (conn.closed) {
+                return false;
+            }
+            conn.inputPending = true;
+            return true;
+        }
         
-        std::lock_guard<std::mutex> queueLock(g_queueMutex);
+        FrameReader::Status status = conn.reader.fill(conn.socket);
         
-        if (g_messageQueue.empty()) {
-            continue;
+        if (status == FrameReader::Status::WouldBlock) {
+            return true;
+        }
+        if (status != FrameReader::Status::Ok) {
+            return false;
         }
         
-        writeLog("Livraison de " + std::to_string(g_messageQueue.size()) + " message(s)");
+        conn.resumeReader();
+    }
+}
+
+/*
+ * Session d'un client (coroutine, thread de la boucle propriétaire).
+ * 
+ * Trames successives :
+ *   1. Première trame : identification (voir handleLogin), ou "PEER:..."
+ *      pour la liaison d'un autre nœud de la grappe (voir servePeer)
+ *   2. Trame "SEND_BATCH:" : plusieurs messages (voir handleSendBatch)
+ *   3. Sinon : commande (voir handleCommand, qui lit elle-même la trame
+ *      Message suivant un "SEND:")
+ * 
+ * La session se termine quand readFrame() rend une trame vide
+ * (connexion fermée par la boucle). Une erreur de protocole ferme la
+ * connexion. Le shared_ptr passé par valeur garde la connexion en vie
+ * pendant toute la session.
+ */
+Session runSession(std::shared_ptr<Connection> conn) {
+    try {
+        bool loggedIn = false;
         
-        /* Traitement de tous les messages en attente */
-        while (!g_messageQueue.empty()) {
-            Message msg = g_messageQueue.front();
-            g_messageQueue.pop();
+        while (true) {
+            FrameView frame = co_await conn->readFrame();
+            if (!frame) {
+                co_return;
+            }
             
-            /* Horodatage de la livraison */
-            msg.receivedAt = std::time(nullptr);
+            if (loggedIn && frame.size >= 11 && memcmp(frame.data, "SEND_BATCH:", 11) == 0) {
+                uint64_t started = statsClockNanos();
+                handleSendBatch(*conn, frame.data + 11, frame.size - 11);
+                serverStats().record(StatTimer::CommandSendBatch, statsClockNanos() - started);
+                continue;
+            }
             
-            /* Routage : broadcast si "all", unicast sinon */
-            bool delivered = false;
-            if (std::string(msg.to) == "all") {
-                broadcastMessage(msg);
-                delivered = true;
-            } else {
-                /* Vérification de l'existence du destinataire */
-                if (isUserConnected(msg.to)) {
-                    sendMessageToUser(msg.to, msg);
-                    delivered = true;
-                } else {
-                    /* Notification d'échec à l'expéditeur */
-                    std::string notification = "NOTIFY:Échec livraison - Utilisateur '" + std::string(msg.to) + "' non connecté";
-                    sendNotificationToSender(msg.from, notification);
-                    writeLog("Échec livraison: destinataire '" + std::string(msg.to) + "' non connecté");
-                }
+            if (frame.size > MAX_COMMAND_SIZE) {
+                throw std::runtime_error("Message trop grand: " + std::to_string(frame.size) + " > " + std::to_string(MAX_COMMAND_SIZE));
             }
             
-            /* Archivage dans l'historique */
-            {
-                std::lock_guard<std::mutex> historyLock(g_historyMutex);
-                g_messageHistory.push_back(msg);
+            std::string text(frame.data, frame.size);
+            
+            if (!loggedIn && text.compare(0, 5, "PEER:") == 0) {
+                co_await servePeer(*conn, text.substr(5));
+                co_return;
             }
             
-            if (delivered) {
-                writeLog("Message livré de " + std::string(msg.from) + " à " + std::string(msg.to));
+            if (!loggedIn) {
+                if (!handleLogin(*conn, text)) {
+                    closeConnection(conn);      /* Redirigé vers un autre nœud */
+                    co_return;
+                }
+                loggedIn = true;
+                continue;
             }
+            
+            writeLog("Commande reçue de " + conn->username + ": " + text);
+            co_await handleCommand(*conn, std::move(text));
         }
+        
+    } catch (const std::exception& e) {
+        writeLog("Erreur avec " + conn->username + ": " + std::string(e.what()));
+        closeConnection(conn);
     }
-    
-    writeLog("Thread de livraison terminé");
 }
 
-/* ========================================================================== */
-/*                     FONCTIONS UTILITAIRES                                  */
-/* ========================================================================== */
-
 /*
- * Vérifie si un utilisateur est actuellement connecté.
+ * Traite la trame d'identification.
+ * 
+ * Deux formes sont acceptées :
+ *   - "<nom>"                   : ancien client, format Legacy, pas de réponse
+ *   - "HELLO:<version>:<nom>"   : négociation du format de message ; le
+ *                                 serveur répond "WELCOME:<version retenue>"
+ *                                 (la plus récente supportée par les deux)
+ * 
+ * Dans une grappe, un client HELLO dont le nom est rattaché à un autre
+ * nœud (voir ClusterDirectory::homeNode) reçoit "REDIRECT:<ip>:<port>"
+ * et la fonction retourne false : la session ferme alors la connexion,
+ * le client se reconnecte à cette adresse. Si ce nœud est injoignable
+ * d'ici, l'identification est refusée : aucun autre nœud ne sert ses
+ * utilisateurs. Un ancien client ne comprendrait pas la réponse : il
+ * est accepté sur place.
+ * 
+ * Retourne true si l'utilisateur est connecté ici ; lève une exception
+ * si l'identification est refusée (trame invalide, nom déjà pris).
  */
-bool isUserConnected(const std::string& username) {
-    std::lock_guard<std::mutex> lock(g_usersMutex);
-    for (const auto& user : g_connectedUsers) {
-        if (user.username == username) {
-            return true;
+bool handleLogin(Connection& conn, const std::string& loginFrame) {
+    std::string username = loginFrame;
+    bool negotiated = false;
+    
+    if (loginFrame.compare(0, 6, "HELLO:") == 0) {
+        size_t separator = loginFrame.find(':', 6);
+        if (separator == std::string::npos) {
+            sendResponse(conn, "ERROR:Identification mal formée");
+            throw std::runtime_error("Identification mal formée");
+        }
+        
+        int requested = std::atoi(loginFrame.substr(6, separator - 6).c_str());
+        if (requested < static_cast<int>(WireFormat::Legacy)) {
+            sendResponse(conn, "ERROR:Version de protocole invalide");
+            throw std::runtime_error("Version de protocole invalide");
+        }
+        
+        int chosen = std::min(requested, static_cast<int>(g_config.maxWireFormat));
+        conn.wireFormat = static_cast<WireFormat>(chosen);
+        username = loginFrame.substr(separator + 1);
+        negotiated = true;
+    }
+    
+    if (username.empty()) {
+        throw std::runtime_error("Nom d'utilisateur vide");
+    }
+    
+    if (negotiated && g_cluster.enabled()) {
+        const std::string& home = g_cluster.homeNode(username);
+        const PeerAddress* peer = g_cluster.findPeer(home);
+        if (peer != nullptr) {
+            if (!g_cluster.hasLink(home)) {
+                sendResponse(conn, "ERROR:Nœud " + home + " de cet utilisateur injoignable");
+                throw std::runtime_error("Nœud " + home + " de " + username + " injoignable");
+            }
+            serverStats().add(StatCounter::LoginsRedirected);
+            sendResponse(conn, "REDIRECT:" + peer->host + ":" + std::to_string(peer->port));
+            writeLog("Utilisateur " + username + " redirigé vers le nœud " + home + " (" + conn.clientIP + ")");
+            return false;
         }
     }
-    return false;
+    
+    /*
+     * Indexation par nom dans le registre (un nom par connexion), sous le
+     * verrou de la boîte de réception : un message livré pendant ce temps
+     * attend, puis voit soit l'utilisateur absent (il rejoint la boîte),
+     * soit la boîte en cours de vidage (il la rejoint aussi). Un nom
+     * connecté sur un autre nœud de la grappe est aussi refusé.
+     */
+    size_t waiting;
+    std::string remoteNode;
+    {
+        MailboxStore::Lock mailboxLock = g_mailboxes.lockUser(username);
+        if (g_cluster.findRemote(username, remoteNode)
+                || !g_registry.registerUsername(conn.shared_from_this(), username)) {
+            sendResponse(conn, "ERROR:Nom d'utilisateur déjà utilisé");
+            throw std::runtime_error("Nom d'utilisateur déjà utilisé: " + username);
+        }
+        
+        if (negotiated) {
+            sendResponse(conn, "WELCOME:" + std::to_string(static_cast<int>(conn.wireFormat)));
+        }
+        
+        waiting = g_mailboxes.pending(username);
+        conn.mailboxDraining = (waiting > 0);
+    }
+    
+    announcePresence("ONLINE:", username);
+    
+    writeLog("Utilisateur connecté: " + conn.username + " depuis " + conn.clientIP
+             + (conn.wireFormat == WireFormat::Compact ? " (format compact)" : ""));
+    
+    if (waiting > 0) {
+        writeLog(std::to_string(waiting) + " message(s) en attente pour " + conn.username);
+        pumpMailbox(conn);
+    }
+    return true;
 }
 
 /*
- * Envoie une notification à un utilisateur (typiquement l'expéditeur).
- * Utilisé pour informer d'un échec de livraison.
+ * Ferme une connexion (thread de la boucle propriétaire uniquement).
+ * 
+ * L'utilisateur est retiré de la liste AVANT la fermeture du socket :
+ * une fois fermé, son numéro de descripteur peut être réutilisé par
+ * une nouvelle connexion. La session, si elle attend, est ensuite
+ * reprise pour se terminer.
+ * 
+ * Sans effet si la connexion est déjà fermée (par la session).
  */
-void sendNotificationToSender(const std::string& senderUsername, const std::string& notification) {
-    std::lock_guard<std::mutex> lock(g_usersMutex);
-    for (const auto& user : g_connectedUsers) {
-        if (user.username == senderUsername) {
-            try {
-                SocketUtils::sendWithLength(user.socket, notification.c_str(), notification.length());
-            } catch (const std::exception& e) {
-                writeLog("Échec envoi notification à " + senderUsername + ": " + std::string(e.what()));
-            }
-            return;
-        }
+void closeConnection(const std::shared_ptr<Connection>& conn) {
+    if (conn->socket == INVALID_SOCKET) {
+        return;
     }
+    conn->loop->remove(conn->socket);
+    removeUser(conn->socket);
+    conn->close();
+    conn->endSession();
 }
 
-/* ========================================================================== */
-/*                       ENVOI DE MESSAGES                                    */
-/* ========================================================================== */
-
 /*
- * Envoie un message à un utilisateur spécifique.
+ * Dépose une trame dans la file de sortie d'un client (tout thread).
+ * L'appel ne bloque jamais : la trame part immédiatement si possible,
+ * sinon quand la boucle reçoit EPOLLOUT.
  * 
- * Format du protocole :
- *   [4 octets longueur]["MSG:" + données sérialisées du Message]
+ * Retourne false si la trame n'a pas été acceptée.
  */
-void sendMessageToUser(const std::string& username, const Message& msg) {
-    std::lock_guard<std::mutex> lock(g_usersMutex);
+bool sendFrame(Connection& conn, const char* data, size_t size) {
+    return sendEncodedFrame(conn, makeFrame("", data, size));
+}
+
+/*
+ * Dépose une trame déjà encodée (éventuellement partagée par plusieurs
+ * destinataires) dans la file de sortie d'un client.
+ */
+bool sendEncodedFrame(Connection& conn, const FrameBuffer& frame) {
+    EnqueueResult result = conn.enqueue(frame);
     
-    for (const auto& user : g_connectedUsers) {
-        if (user.username == username) {
-            try {
-                char buffer[sizeof(Message) + 10];
-                size_t size;
-                msg.serialize(buffer, size);
-                
-                /* Construction du message complet : header + données */
-                std::string header = "MSG:";
-                std::vector<char> fullMessage(header.begin(), header.end());
-                fullMessage.insert(fullMessage.end(), buffer, buffer + size);
-                
-                SocketUtils::sendWithLength(user.socket, fullMessage.data(), fullMessage.size());
-                
-            } catch (const std::exception& e) {
-                writeLog("Échec d'envoi à " + username + ": " + std::string(e.what()));
-            }
-            return;
-        }
+    if (result == EnqueueResult::Dropped) {
+        writeLog("File de sortie pleine, trame ignorée pour " + conn.username);
+    } else if (result == EnqueueResult::Disconnected) {
+        writeLog("Client lent déconnecté (file de sortie pleine): " + conn.username);
     }
     
-    writeLog("Utilisateur destinataire inexistant ou déconnecté: " + username);
+    return result == EnqueueResult::Queued;
 }
 
 /*
- * Diffuse un message à tous les utilisateurs connectés (sauf l'expéditeur).
- * Utilisé pour les messages avec destinataire "all".
+ * Envoie une réponse textuelle (OK:, ERROR:, USERS:, ...) au client.
  */
-void broadcastMessage(const Message& msg) {
-    std::lock_guard<std::mutex> lock(g_usersMutex);
-    
-    for (const auto& user : g_connectedUsers) {
-        /* Exclure l'expéditeur de la diffusion */
-        if (user.username != std::string(msg.from)) {
-            try {
-                char buffer[sizeof(Message) + 10];
-                size_t size;
-                msg.serialize(buffer, size);
-                
-                std::string header = "MSG:";
-                std::vector<char> fullMessage(header.begin(), header.end());
-                fullMessage.insert(fullMessage.end(), buffer, buffer + size);
-                
-                SocketUtils::sendWithLength(user.socket, fullMessage.data(), fullMessage.size());
-                
-            } catch (const std::exception& e) {
-                writeLog("Échec broadcast à " + user.username + ": " + std::string(e.what()));
-            }
-        }
+bool sendResponse(Connection& conn, const std::string& response) {
+    return sendFrame(conn, response.c_str(), response.length());
+}
+
+/*
+ * Réponse textuelle depuis la session : co_await reply(conn, "...")
+ * suspend la session si la file de sortie du client est pleine.
+ */
+Connection::WriteAwaiter reply(Connection& conn, const std::string& response) {
+    return conn.write(makeFrame("", response.data(), response.size()));
+}
+
+/*
+ * Arrêt du serveur : lève le flag et réveille toutes les boucles,
+ * les workers de livraison et les threads des métriques et des liaisons.
+ */
+void stopServer() {
+    g_serverRunning = false;
+    for (auto& loop : g_eventLoops) {
+        loop->stop();
+    }
+    for (auto& queue : g_deliveryQueues) {
+        queue->wake();
     }
+    {
+        std::lock_guard<std::mutex> lock(g_statsMutex);
+    }
+    g_statsCond.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(g_clusterMutex);
+    }
+    g_clusterCond.notify_all();
 }
 
+/* ========================================================================== */
+/*                       THREAD DE LIVRAISON                                  */
+/* ========================================================================== */
+
 /*
- * Retourne le nom d'utilisateur associé à un socket.
+ * Worker chargé des messages d'un destinataire.
+ * 
+ * Le worker est déduit du shard du nom dans le registre : un worker
+ * livre donc exactement les utilisateurs des shards qu'il parcourt pour
+ * un broadcast, et tous les messages d'un même destinataire (unicast ou
+ * broadcast) passent par la même file, dans l'ordre.
  */
-std::string getUsernameBySocket(SOCKET sock) {
-    std::lock_guard<std::mutex> lock(g_usersMutex);
-    for (const auto& user : g_connectedUsers) {
-        if (user.socket == sock) {
-            return user.username;
+size_t deliveryWorkerFor(const std::string& recipient) {
+    return g_registry.userShard(recipient) % g_deliveryQueues.size();
+}
+
+/*
+ * Mise en file d'un message (tout thread, sans verrou).
+ * Unicast : file du worker du destinataire ; broadcast : une poignée sur
+ * le même message dans chaque file, chaque worker le diffusant à ses
+ * propres destinataires. relayed : message reçu d'un autre nœud, qui
+ * ne sera pas relayé à nouveau.
+ */
+void enqueueMessage(const MessageRef& msg, bool relayed) {
+    uint64_t now = statsClockNanos();
+    if (std::string(msg->to) == "all") {
+        for (auto& queue : g_deliveryQueues) {
+            queue->push(QueuedMessage{msg, now, relayed});
         }
+    } else {
+        g_deliveryQueues[deliveryWorkerFor(msg->to)]->push(QueuedMessage{msg, now, relayed});
     }
-    return "";
+    serverStats().add(StatCounter::MessagesEnqueued);
 }
 
 /*
- * Retire un utilisateur de la liste des connectés.
- * Condition d'arrêt du serveur : si c'était le dernier utilisateur.
+ * Worker de livraison des messages.
+ * 
+ * Fonctionnement :
+ *   - Mode immédiat : s'endort jusqu'à ce qu'un message soit mis en
+ *     file, puis éventuellement jusqu'à --batch-window-us pour regrouper
+ *     jusqu'à --batch-max messages
+ *   - Mode périodique : se réveille toutes les --delivery-interval secondes
+ *   - Les messages sont retirés de la file sans verrou et livrés un à un :
+ *     les producteurs (SEND) ne sont jamais bloqués, ni pendant le retrait
+ *     ni pendant les envois
+ *   - L'arrêt du serveur réveille immédiatement le thread
+ * 
+ * Chaque worker a sa propre file (voir enqueueMessage) : les workers
+ * livrent en parallèle sans partager de file ni de verrou.
  */
-void removeUser(SOCKET sock) {
-    std::lock_guard<std::mutex> lock(g_usersMutex);
+void deliveryThread(size_t worker) {
+    MpscQueue<QueuedMessage>& queue = *g_deliveryQueues[worker];
+    std::string name = "Worker de livraison " + std::to_string(worker);
+    writeLog(name + " démarré");
     
-    auto it = std::find_if(g_connectedUsers.begin(), g_connectedUsers.end(),
-                          [sock](const ConnectedUser& user) { return user.socket == sock; });
+    auto stopping = [] { return !g_serverRunning.load(); };
     
-    if (it != g_connectedUsers.end()) {
-        std::string username = it->username;
-        g_connectedUsers.erase(it);
-        writeLog("Utilisateur retiré: " + username + " (" + std::to_string(g_connectedUsers.size()) + " restants)");
+    while (g_serverRunning) {
+        if (g_config.deliveryMode == DeliveryMode::Periodic) {
+            /* Attente de l'intervalle (interrompue par l'arrêt) */
+            queue.waitFor(SIZE_MAX, std::chrono::seconds(g_config.deliveryIntervalSeconds), stopping);
+        } else {
+            /* Attente du premier message */
+            queue.wait(1, stopping);
+            
+            /* Fenêtre de regroupement (micro-batching) */
+            if (g_config.batchWindowMicros > 0) {
+                queue.waitFor(g_config.batchMax, std::chrono::microseconds(g_config.batchWindowMicros),
+                                       stopping);
+            }
+        }
         
-        /* Arrêt du serveur si plus aucun client */
-        if (g_connectedUsers.empty()) {
-            writeLog("Dernier client déconnecté - Arrêt du serveur");
-            g_serverRunning = false;
+        if (!g_serverRunning) {
+            break;
+        }
+        
+        /* Lot = messages présents au réveil ; les suivants attendront le tour suivant */
+        size_t pending = queue.size();
+        if (pending == 0) {
+            continue;
+        }
+        
+        writeLog(name + " : livraison de " + std::to_string(pending) + " message(s)");
+        
+        QueuedMessage item;
+        size_t delivered = 0;
+        while (delivered < pending) {
+            if (!queue.tryPop(item)) {
+                /* Producteur en cours de chaînage : son message arrive aussitôt */
+                std::this_thread::yield();
+                continue;
+            }
+            serverStats().record(StatTimer::QueueTime, statsClockNanos() - item.enqueuedAt);
+            deliverMessage(*item.message, worker, item.relayed);
+            item = QueuedMessage();
+            delivered++;
         }
     }
+    
+    writeLog(name + " terminé");
 }
 
-/* ========================================================================== */
-/*                    TRAITEMENT DES COMMANDES                                */
-/* ========================================================================== */
-
 /*
- * Traite une commande reçue d'un client.
+ * Livre un message retiré de la file.
  * 
- * Commandes supportées :
- *   - SEND:       Envoyer un message (suivi des données sérialisées)
- *   - LIST_USERS  Obtenir la liste des utilisateurs connectés
- *   - GET_LOG     Télécharger le fichier de log du serveur
- *   - DISCONNECT  Se déconnecter proprement
+ * Route le message vers son destinataire (unicast ou broadcast),
+ * notifie l'expéditeur en cas d'échec et l'archive dans l'historique.
+ * 
+ * Un broadcast est reçu par tous les workers : chacun le livre à ses
+ * propres destinataires, et seul le worker 0 l'archive et le relaie
+ * aux autres nœuds de la grappe (une trame par nœud).
+ * 
+ * Un destinataire connecté sur un autre nœud reçoit le message par la
+ * liaison vers ce nœud ; un destinataire absent, par la liaison vers
+ * son nœud de rattachement, où sa boîte est tenue (c'est là qu'il sera
+ * redirigé). Si ce nœud est injoignable, la livraison échoue et
+ * l'expéditeur est notifié : le message n'est pas gardé dans une autre
+ * boîte. Un message déjà relayé (relayed) n'est livré qu'ici : s'il y
+ * est absent, il rejoint sa boîte sur ce nœud. Chaque nœud archive les
+ * messages qu'il livre.
  */
-void handleCommand(SOCKET clientSocket, const std::string& username, const std::string& command) {
-    try {
-        if (command.substr(0, 5) == "SEND:") {
-            /* Commande d'envoi de message */
-            char buffer[sizeof(Message)];
-            size_t received = SocketUtils::receiveWithLength(clientSocket, buffer, sizeof(buffer));
-            
-            if (received == sizeof(Message)) {
-                Message msg = Message::deserialize(buffer, received);
-                
-                /* Ajout à la file d'attente pour le thread de livraison */
-                {
-                    std::lock_guard<std::mutex> lock(g_queueMutex);
-                    g_messageQueue.push(msg);
-                }
-                
-                std::string response = "OK:Message en file d'attente";
-                SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
-                writeLog("Message ajouté à la queue de " + std::string(msg.from) + " vers " + std::string(msg.to));
-            } else {
-                std::string response = "ERROR:Message mal formaté";
-                SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
+void deliverMessage(const Message& msg, size_t worker, bool relayed) {
+    /* Routage : broadcast si "all", unicast sinon */
+    bool delivered = false;
+    if (std::string(msg.to) == "all") {
+        broadcastMessage(msg, worker);
+        delivered = true;
+        if (worker != 0) {
+            return;
+        }
+        if (!relayed && g_cluster.linkCount() > 0) {
+            size_t nodes = g_cluster.sendToAll(encodeRelayFrame(msg));
+            serverStats().add(StatCounter::MessagesRelayed, nodes);
+        }
+    } else {
+        enum class Route { Local, Remote, Home, Mailbox };
+        std::string recipient(msg.to);
+        const std::string& home = g_cluster.homeNode(recipient);
+        std::string node;
+        std::shared_ptr<Connection> conn;
+        bool online = false;
+        bool unreachable = false;
+        MailboxResult stored = MailboxResult::Stored;
+        
+        /*
+         * Choix de la route sous le verrou de la boîte du destinataire :
+         * soit il est connecté ici (boîte déjà vidée) et le message part
+         * directement, soit il est connecté sur un autre nœud, soit il
+         * est absent ; sinon le message rejoint sa boîte, vidée dans
+         * l'ordre à la connexion (voir handleLogin et pumpMailbox). Seul
+         * ce dépôt se fait sous le verrou, partagé avec d'autres noms :
+         * l'envoi sur le socket et le relais attendent qu'il soit rendu.
+         * Les messages d'un même destinataire passent tous par ce worker,
+         * leur ordre ne dépend donc pas du verrou.
+         */
+        auto route = [&](bool remote) {
+            MailboxStore::Lock mailboxLock = g_mailboxes.lockUser(recipient);
+            conn = g_registry.findByName(recipient);
+            online = (conn != nullptr);
+            if (conn && !conn->mailboxDraining) {
+                return Route::Local;
             }
-            
-        } else if (command == "LIST_USERS") {
-            /* Liste des utilisateurs connectés */
-            std::string userList;
-            {
-                std::lock_guard<std::mutex> lock(g_usersMutex);
-                for (const auto& user : g_connectedUsers) {
-                    userList += user.username + ";";
-                }
+            if (!conn && !relayed && remote && g_cluster.findRemote(recipient, node)) {
+                return Route::Remote;
             }
-            
-            std::string response = "USERS:" + userList;
-            SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
-            
-        } else if (command == "GET_LOG") {
-            /* Téléchargement du fichier de log */
-            /* Utilisation du mutex pour éviter les conflits avec l'écriture */
-            std::string logContent;
-            {
-                std::lock_guard<std::mutex> lock(g_logMutex);
-                /* Forcer l'écriture de toutes les données en attente */
-                g_logFile.flush();
-                
-                /* Lecture du fichier log séparément */
-                std::ifstream logFileRead("server.log", std::ios::in);
-                if (logFileRead.is_open()) {
-                    std::stringstream buffer;
-                    buffer << logFileRead.rdbuf();
-                    logContent = buffer.str();
-                    logFileRead.close();
-                }
+            if (!conn && !relayed && home != g_cluster.self()) {
+                return Route::Home;
             }
-            
-            if (!logContent.empty()) {
-                std::string response = "LOG:" + logContent;
-                SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
+            stored = g_mailboxes.store(recipient, msg);
+            serverStats().add(stored == MailboxResult::Stored ? StatCounter::MessagesStored
+                                                              : StatCounter::MessagesFailed);
+            return Route::Mailbox;
+        };
+        
+        Route path = route(true);
+        if (path == Route::Remote) {
+            if (g_cluster.sendTo(node, encodeRelayFrame(msg))) {
+                serverStats().add(StatCounter::MessagesRelayed);
+                online = true;
+                delivered = true;
             } else {
-                std::string response = "ERROR:Impossible de lire le fichier log";
-                SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
+                path = route(false);    /* Liaison perdue : traité comme un absent */
             }
-            
-        } else if (command == "DISCONNECT") {
+        }
+        if (path == Route::Local) {
+            bool sent = sendEncodedFrame(*conn, encodeMessageFrame(msg, conn->wireFormat));
+            serverStats().add(sent ? StatCounter::MessagesDelivered : StatCounter::MessagesFailed);
+            delivered = true;
+        } else if (path == Route::Home) {
+            /* Absent : sa boîte est tenue par son nœud, qui notifiera l'expéditeur */
+            if (g_cluster.sendTo(home, encodeRelayFrame(msg))) {
+                serverStats().add(StatCounter::MessagesRelayed);
+                online = true;
+            } else {
+                serverStats().add(StatCounter::MessagesFailed);
+                unreachable = true;
+            }
+        }
+        
+        if (unreachable) {
+            std::string notification = "NOTIFY:Échec livraison - nœud de '" + recipient + "' injoignable";
+            sendNotificationToSender(msg.from, notification);
+            writeLog("Échec livraison: nœud " + home + " de '" + recipient + "' injoignable");
+        } else if (!delivered && stored != MailboxResult::Stored) {
+            /* Notification d'échec à l'expéditeur */
+            std::string notification = "NOTIFY:Échec livraison - Boîte de réception de '" + recipient + "' pleine";
+            sendNotificationToSender(msg.from, notification);
+            writeLog("Échec livraison: boîte de réception de '" + recipient + "' pleine");
+        } else if (!online) {
+            std::string notification = "NOTIFY:Utilisateur '" + recipient + "' non connecté - message conservé";
+            sendNotificationToSender(msg.from, notification);
+            writeLog("Message conservé pour '" + recipient + "' (non connecté)");
+        }
+    }
+    
+    /* Archivage dans l'historique (sur disque) */
+    try {
+        g_history.append(msg);
+    } catch (const std::exception& e) {
+        writeLog("Erreur d'archivage: " + std::string(e.what()));
+    }
+    
+    if (delivered) {
+        writeLog("Message livré de " + std::string(msg.from) + " à " + std::string(msg.to)
+                 + (relayed ? " (relayé)" : ""));
+    }
+}
+
+/* ========================================================================== */
+/*                     FONCTIONS UTILITAIRES                                  */
+/* ========================================================================== */
+
+/*
+ * Envoie une notification à un utilisateur (typiquement l'expéditeur).
+ * Utilisé pour informer d'un échec de livraison. Un utilisateur connecté
+ * sur un autre nœud la reçoit par la liaison vers ce nœud.
+ */
+void sendNotificationToSender(const std::string& senderUsername, const std::string& notification) {
+    std::shared_ptr<Connection> conn = g_registry.findByName(senderUsername);
+    if (!conn) {
+        std::string node;
+        if (g_cluster.findRemote(senderUsername, node)) {
+            std::string payload = senderUsername + "\n" + notification;
+            g_cluster.sendTo(node, makeFrame("NOTIFY:", payload.data(), payload.size()));
+        }
+        return;
+    }
+    
+    try {
+        sendResponse(*conn, notification);
+    } catch (const std::exception& e) {
+        writeLog("Échec envoi notification à " + senderUsername + ": " + std::string(e.what()));
+    }
+}
+
+/* ========================================================================== */
+/*                       ENVOI DE MESSAGES                                    */
+/* ========================================================================== */
+
+/*
+ * Encode une trame "MSG:" pour un message dans le format du destinataire.
+ * 
+ * Format du protocole :
+ *   [4 octets longueur]["MSG:" + message encodé (Legacy ou Compact)]
+ * 
+ * Le tampon obtenu est immuable : il peut être déposé tel quel dans
+ * les files de sortie de plusieurs destinataires.
+ */
+FrameBuffer encodeMessageFrame(const Message& msg, WireFormat format) {
+    std::string payload;
+    msg.encode(format, payload);
+    return makeFrame("MSG:", payload.data(), payload.size());
+}
+
+/*
+ * Encode une trame "MSG_BATCH:" regroupant plusieurs messages.
+ * 
+ * Format :
+ *   ["MSG_BATCH:"][varint nombre]([varint taille][message encodé])...
+ */
+FrameBuffer encodeMessageBatch(const std::vector<Message>& messages, WireFormat format) {
+    std::string payload;
+    std::string encoded;
+    appendVarint(payload, messages.size());
+    for (const Message& msg : messages) {
+        encoded.clear();
+        msg.encode(format, encoded);
+        appendVarint(payload, encoded.size());
+        payload += encoded;
+    }
+    return makeFrame("MSG_BATCH:", payload.data(), payload.size());
+}
+
+/*
+ * Vide la boîte de réception d'un client qui vient de se connecter
+ * (thread de la boucle propriétaire).
+ * 
+ * Les messages partent par lots de MAILBOX_BATCH_MAX dans des trames
+ * MSG_BATCH, tant que la file de sortie a de la place ; la suite est
+ * reprise au prochain EPOLLOUT. Tant que mailboxDraining est vrai, les
+ * nouveaux messages pour ce client rejoignent aussi sa boîte : l'ordre
+ * d'arrivée est donc respecté jusqu'au dernier lot.
+ */
+void pumpMailbox(Connection& conn) {
+    std::vector<Message> batch;
+    
+    while (conn.mailboxDraining && !conn.closed) {
+        if (!conn.hasOutboundRoom(MAILBOX_BATCH_MAX * sizeof(Message))) {
+            return;
+        }
+        
+        batch.clear();
+        {
+            MailboxStore::Lock mailboxLock = g_mailboxes.lockUser(conn.username);
+            if (g_mailboxes.take(conn.username, MAILBOX_BATCH_MAX, batch) == 0
+                    && g_mailboxes.pending(conn.username) == 0) {
+                conn.mailboxDraining = false;
+                return;
+            }
+        }
+        
+        if (!batch.empty()) {
+            bool sent = sendEncodedFrame(conn, encodeMessageBatch(batch, conn.wireFormat));
+            serverStats().add(sent ? StatCounter::MessagesDelivered : StatCounter::MessagesFailed, batch.size());
+            writeLog("Livraison différée de " + std::to_string(batch.size()) + " message(s) à " + conn.username);
+        }
+    }
+}
+
+/*
+ * Diffuse un message à tous les utilisateurs connectés (sauf l'expéditeur).
+ * Utilisé pour les messages avec destinataire "all".
+ * 
+ * Le message est encodé au plus une fois par format (à la première
+ * connexion qui l'utilise) : la diffusion coûte ensuite un dépôt de
+ * pointeur par destinataire.
+ */
+void broadcastMessage(const Message& msg, size_t worker) {
+    std::string sender(msg.from);
+    FrameBuffer legacyFrame;
+    FrameBuffer compactFrame;
+    
+    /* Seulement les utilisateurs dont ce worker assure la livraison */
+    g_registry.forEachUser([&](const std::shared_ptr<Connection>& conn) {
+        /* Exclure l'expéditeur de la diffusion */
+        if (conn->username == sender) {
+            return;
+        }
+        
+        FrameBuffer& frame = (conn->wireFormat == WireFormat::Compact) ? compactFrame : legacyFrame;
+        if (!frame) {
+            frame = encodeMessageFrame(msg, conn->wireFormat);
+        }
+        bool sent = sendEncodedFrame(*conn, frame);
+        serverStats().add(sent ? StatCounter::MessagesDelivered : StatCounter::MessagesFailed);
+    }, worker, g_deliveryQueues.size());
+}
+
+/*
+ * Retourne le nom d'utilisateur associé à un socket.
+ */
+std::string getUsernameBySocket(SOCKET sock) {
+    std::shared_ptr<Connection> conn = g_registry.findBySocket(sock);
+    return conn ? conn->username : "";
+}
+
+/*
+ * Retire un utilisateur de la liste des connectés (et l'annonce aux
+ * autres nœuds de la grappe).
+ * Condition d'arrêt du serveur : si c'était le dernier utilisateur ;
+ * un nœud de grappe reste actif pour ses pairs.
+ */
+void removeUser(SOCKET sock) {
+    std::shared_ptr<Connection> conn = g_registry.removeConnection(sock);
+    
+    if (conn) {
+        size_t remaining = g_registry.connectionCount();
+        writeLog("Utilisateur retiré: " + conn->username + " (" + std::to_string(remaining) + " restants)");
+        if (!conn->username.empty()) {
+            announcePresence("OFFLINE:", conn->username);
+        }
+        
+        /* Arrêt du serveur si plus aucun client */
+        if (remaining == 0 && !g_cluster.enabled()) {
+            writeLog("Dernier client déconnecté - Arrêt du serveur");
+            stopServer();
+        }
+    }
+}
+
+/* ========================================================================== */
+/*                            FÉDÉRATION                                      */
+/* ========================================================================== */
+
+/*
+ * Trame "RELAY:" d'un message pour un autre nœud (format compact,
+ * indépendant du format négocié par les clients).
+ */
+FrameBuffer encodeRelayFrame(const Message& msg) {
+    std::string payload;
+    msg.encode(WireFormat::Compact, payload);
+    return makeFrame("RELAY:", payload.data(), payload.size());
+}
+
+/*
+ * Annonce "ONLINE:<nom>" ou "OFFLINE:<nom>" à tous les nœuds reliés,
+ * après la mise à jour du registre (voir ClusterDirectory::announce).
+ */
+void announcePresence(const std::string& event, const std::string& username) {
+    if (!g_cluster.enabled()) {
+        return;
+    }
+    g_cluster.announce(makeFrame(event, username.data(), username.size()));
+}
+
+/*
+ * Liaison entrante d'un autre nœud (suite de la session qui a reçu
+ * "PEER:<nœud>[:<secret>]"). Les trames du pair sont traitées jusqu'à
+ * la fermeture ; la présence qu'il a annoncée est alors oubliée.
+ * 
+ * La liaison est refusée, avant toute modification de la présence,
+ * si le nœud n'est pas dans --peers, si la connexion ne vient pas de
+ * son adresse ou si le secret de la grappe est absent ou faux (voir
+ * ClusterDirectory::authenticatePeer) : un client du port public ne
+ * peut donc ni relayer de messages ni usurper la présence d'un pair.
+ */
+Task servePeer(Connection& conn, std::string hello) {
+    std::string node;
+    if (!g_cluster.authenticatePeer(hello, conn.clientIP, node)) {
+        sendResponse(conn, "ERROR:Liaison de nœud refusée");
+        throw std::runtime_error("Liaison refusée pour le nœud " + node + " depuis " + conn.clientIP);
+    }
+    
+    const void* token = &conn;
+    g_cluster.beginInbound(node, token);
+    writeLog("Liaison entrante du nœud " + node + " (" + conn.clientIP + ")");
+    
+    try {
+        while (true) {
+            FrameView frame = co_await conn.readFrame();
+            if (!frame) {
+                break;
+            }
+            handlePeerFrame(node, frame.data, frame.size);
+        }
+    } catch (...) {
+        g_cluster.endInbound(node, token);
+        throw;
+    }
+    
+    g_cluster.endInbound(node, token);
+    writeLog("Liaison entrante du nœud " + node + " fermée");
+}
+
+/*
+ * Traite une trame reçue d'un pair (voir cluster.h pour le protocole).
+ * Un message relayé est mis en file comme un SEND local, marqué pour
+ * ne pas repartir vers un autre nœud. Lève une exception si la trame
+ * est invalide (la liaison est alors fermée).
+ */
+void handlePeerFrame(const std::string& node, const char* data, size_t size) {
+    if (size >= 6 && memcmp(data, "RELAY:", 6) == 0) {
+        MessageRef msg = g_messagePool.decode(WireFormat::Compact, data + 6, size - 6, std::time(nullptr));
+        enqueueMessage(msg, true);
+        return;
+    }
+    
+    std::string text(data, size);
+    if (text.compare(0, 7, "ONLINE:") == 0) {
+        g_cluster.setRemote(text.substr(7), node);
+        writeLog("Utilisateur distant connecté: " + text.substr(7) + " (nœud " + node + ")");
+        
+    } else if (text.compare(0, 8, "OFFLINE:") == 0) {
+        g_cluster.clearRemote(text.substr(8), node);
+        writeLog("Utilisateur distant déconnecté: " + text.substr(8) + " (nœud " + node + ")");
+        
+    } else if (text.compare(0, 7, "NOTIFY:") == 0) {
+        /* Utilisateur local uniquement : une notification ne repart pas */
+        size_t separator = text.find('\n', 7);
+        if (separator == std::string::npos) {
+            throw std::runtime_error("Trame NOTIFY mal formée du nœud " + node);
+        }
+        std::shared_ptr<Connection> conn = g_registry.findByName(text.substr(7, separator - 7));
+        if (conn) {
+            sendResponse(*conn, text.substr(separator + 1));
+        }
+        
+    } else {
+        throw std::runtime_error("Trame inconnue du nœud " + node);
+    }
+}
+
+/*
+ * Installe une liaison sortante vers un pair (thread de la boucle,
+ * socket déjà connecté par clusterThread).
+ * 
+ * "PEER:<ce nœud>[:<secret>]" est déposé avant la publication de la liaison :
+ * aucune autre trame ne peut le précéder. La liaison est ensuite
+ * publiée avec l'instantané des utilisateurs connectés ici.
+ */
+void attachPeerLink(EventLoop& loop, SOCKET sock, const PeerAddress& peer) {
+    auto link = std::make_shared<Connection>(sock, peer.host, &loop,
+                                             CLUSTER_OUTBOUND_BYTES, SlowConsumerPolicy::Disconnect);
+    std::string hello = g_cluster.peerHello();
+    link->enqueue(makeFrame("", hello.data(), hello.size()));
+    
+    loop.addStream(sock,
+                   [link](uint32_t events) { onClientEvent(link, events); },
+                   [link](const char* data, size_t size) { onClientData(link, data, size); });
+    
+    bool attached = g_cluster.attachLink(peer.node, link, [](Connection& newLink) {
+        g_registry.forEachUser([&newLink](const std::shared_ptr<Connection>& user) {
+            newLink.enqueue(makeFrame("ONLINE:", user->username.data(), user->username.size()));
+        });
+    });
+    if (!attached) {
+        closeConnection(link);
+        return;
+    }
+    
+    writeLog("Liaison vers le nœud " + peer.node + " établie (" + peer.host + ":"
+             + std::to_string(peer.port) + ")");
+    runPeerLink(link, peer.node);
+}
+
+/*
+ * Session d'une liaison sortante : le pair n'y envoie rien, elle ne
+ * sert qu'à détecter la fermeture. La liaison est alors retirée et
+ * clusterThread la rétablira.
+ */
+Session runPeerLink(std::shared_ptr<Connection> link, std::string node) {
+    while (true) {
+        FrameView frame = co_await link->readFrame();
+        if (!frame) {
+            break;
+        }
+        writeLog("Trame inattendue du nœud " + node + ": "
+                 + std::string(frame.data, std::min(frame.size, MAX_COMMAND_SIZE)));
+    }
+    
+    g_cluster.detachLink(node, link);
+    writeLog("Liaison vers le nœud " + node + " fermée");
+}
+
+/*
+ * Thread des liaisons sortantes : toutes les CLUSTER_RETRY_MS ms, se
+ * connecte aux pairs sans liaison. Les connexions sont lancées toutes
+ * ensemble (non bloquantes) puis attendues ensemble, au plus
+ * CLUSTER_CONNECT_TIMEOUT_MS : un pair injoignable ne retarde pas les
+ * autres. Chaque socket connecté est confié à une boucle, les pairs
+ * étant répartis entre les boucles. Un pair injoignable n'est
+ * journalisé qu'une fois jusqu'à son retour.
+ */
+void clusterThread() {
+    const std::vector<PeerAddress>& peers = g_cluster.peers();
+    std::vector<bool> reported(peers.size(), false);
+    
+    auto attach = [&peers, &reported](size_t i, SOCKET sock) {
+        reported[i] = false;
+        EventLoop* loop = g_eventLoops[i % g_eventLoops.size()].get();
+        PeerAddress peer = peers[i];
+        loop->post([loop, sock, peer]() { attachPeerLink(*loop, sock, peer); });
+    };
+    auto fail = [&peers, &reported](size_t i, SOCKET sock, const std::string& reason) {
+        if (sock != INVALID_SOCKET) {
+            SocketUtils::closeSocket(sock);
+        }
+        if (!reported[i]) {
+            writeLog("Nœud " + peers[i].node + " injoignable: " + reason);
+            reported[i] = true;
+        }
+    };
+    
+    while (g_serverRunning) {
+        std::vector<size_t> pending;                /* Pair de chaque connexion en cours */
+        std::vector<struct pollfd> sockets;
+        for (size_t i = 0; i < peers.size(); ++i) {
+            if (g_cluster.hasLink(peers[i].node)) {
+                reported[i] = false;
+                continue;
+            }
+            
+            SOCKET sock = INVALID_SOCKET;
+            try {
+                sock = SocketUtils::createTCPSocket(g_config.socketOptions);
+                if (SocketUtils::startConnect(sock, peers[i].host, peers[i].port)) {
+                    attach(i, sock);
+                    continue;
+                }
+            } catch (const std::exception& e) {
+                fail(i, sock, e.what());
+                continue;
+            }
+            pending.push_back(i);
+            sockets.push_back({sock, POLLOUT, 0});
+        }
+        
+        /* Un descripteur négatif est ignoré par poll() : connexion réglée */
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CLUSTER_CONNECT_TIMEOUT_MS);
+        size_t remaining = pending.size();
+        while (remaining > 0 && g_serverRunning) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                break;
+            }
+            int ready = poll(sockets.data(), sockets.size(), static_cast<int>(left.count()));
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0) {
+                break;
+            }
+            for (size_t k = 0; k < sockets.size(); ++k) {
+                if (sockets[k].fd < 0 || sockets[k].revents == 0) {
+                    continue;
+                }
+                int error = SocketUtils::connectError(sockets[k].fd);
+                if (error == 0) {
+                    attach(pending[k], sockets[k].fd);
+                } else {
+                    fail(pending[k], sockets[k].fd, strerror(error));
+                }
+                sockets[k].fd = -1;
+                remaining--;
+            }
+        }
+        for (size_t k = 0; k < sockets.size(); ++k) {
+            if (sockets[k].fd >= 0) {
+                fail(pending[k], sockets[k].fd, "délai de connexion dépassé");
+            }
+        }
+        
+        std::unique_lock<std::mutex> lock(g_clusterMutex);
+        g_clusterCond.wait_for(lock, std::chrono::milliseconds(CLUSTER_RETRY_MS),
+                               [] { return !g_serverRunning.load(); });
+    }
+}
+
+/* ========================================================================== */
+/*                    TRAITEMENT DES COMMANDES                                */
+/* ========================================================================== */
+
+/*
+ * Traite une commande reçue d'un client.
+ * 
+ * Commandes supportées :
+ *   - SEND:       Envoyer un message (la trame suivante contient les données
+ *                 sérialisées, traitée par handleSendPayload) ; "SEND:<id>"
+ *                 fait répondre "ACK:<id>" au lieu de "OK:..."
+ *   - SEND_BATCH: Envoyer plusieurs messages en une trame (handleSendBatch)
+ *   - LIST_USERS  Obtenir la liste des utilisateurs connectés (grappe comprise)
+ *   - GET_LOG     Télécharger le fichier de log du serveur (voir startLogStream)
+ *   - GET_HISTORY Consulter l'historique des messages (voir sendHistory)
+ *   - STATS       Obtenir les métriques du serveur (voir formatStats)
+ *   - DISCONNECT  Se déconnecter proprement
+ * 
+ * Les SEND restent dans la boucle (rapides, et leur ordre d'arrivée
+ * fixe l'ordre des messages) ; LIST_USERS, GET_HISTORY, GET_LOG et
+ * STATS confient leur calcul au pool des commandes. La session ne
+ * reprend la lecture qu'après la réponse : les réponses d'une connexion
+ * restent dans l'ordre de ses commandes.
+ * 
+ * La durée de traitement est enregistrée par type de commande (attente
+ * dans le pool comprise) ; pour un SEND, elle part de la réception de
+ * la trame Message.
+ */
+Task handleCommand(Connection& conn, std::string command) {
+    if (command.substr(0, 5) == "SEND:") {
+        /* Commande d'envoi de message : la trame suivante est le Message */
+        std::string sendId = command.substr(5);
+        FrameView payload = co_await conn.readFrame();
+        if (payload) {
+            uint64_t started = statsClockNanos();
+            handleSendPayload(conn, sendId, payload.data, payload.size);
+            serverStats().record(StatTimer::CommandSend, statsClockNanos() - started);
+        }
+        co_return;
+    }
+    
+    StatTimer timer = StatTimer::CommandOther;
+    uint64_t started = statsClockNanos();
+    
+    try {
+        if (command == "LIST_USERS") {
+            /* Liste des utilisateurs connectés (sur tous les nœuds) */
+            timer = StatTimer::CommandListUsers;
+            std::string userList;
+            co_await offload(conn, [&userList]() {
+                g_registry.forEachUser([&userList](const std::shared_ptr<Connection>& user) {
+                    userList += user->username + ";";
+                });
+                g_cluster.forEachRemoteUser([&userList](const std::string& username, const std::string&) {
+                    userList += username + ";";
+                });
+            });
+            
+            co_await reply(conn, "USERS:" + userList);
+            
+        } else if (command.substr(0, 12) == "GET_HISTORY:") {
+            /* Consultation de l'historique persistant */
+            timer = StatTimer::CommandGetHistory;
+            co_await sendHistory(conn, command.substr(12));
+            
+        } else if (command == "GET_LOG" || command.substr(0, 8) == "GET_LOG:") {
+            /* Téléchargement du fichier de log (envoi par portions) */
+            timer = StatTimer::CommandGetLog;
+            std::string request = command.size() > 8 ? command.substr(8) : "";
+            co_await startLogStream(conn, std::move(request));
+            
+        } else if (command == "STATS") {
+            /* Métriques du serveur */
+            timer = StatTimer::CommandStats;
+            std::string report;
+            co_await offload(conn, [&report]() { report = formatStats(); });
+            co_await reply(conn, "STATS:" + report);
+            
+        } else if (command == "DISCONNECT") {
             /* Déconnexion explicite */
-            std::string response = "OK:Déconnexion";
-            SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
-            writeLog("Déconnexion demandée par " + username);
+            timer = StatTimer::CommandDisconnect;
+            co_await reply(conn, "OK:Déconnexion");
+            writeLog("Déconnexion demandée par " + conn.username);
             
         } else {
             /* Commande inconnue */
-            std::string response = "ERROR:Commande inexistante";
-            SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
-            writeLog("Commande invalide de " + username + ": " + command);
+            co_await reply(conn, "ERROR:Commande inexistante");
+            writeLog("Commande invalide de " + conn.username + ": " + command);
         }
         
     } catch (const std::exception& e) {
         writeLog("Erreur traitement commande: " + std::string(e.what()));
         try {
-            std::string response = "ERROR:" + std::string(e.what());
-            SocketUtils::sendWithLength(clientSocket, response.c_str(), response.length());
+            sendResponse(conn, "ERROR:" + std::string(e.what()));
         } catch (...) {
             /* Ignorer les erreurs d'envoi de la réponse d'erreur */
         }
     }
+    
+    serverStats().record(timer, statsClockNanos() - started);
+}
+
+/*
+ * Envoie une page de l'historique au client.
+ * 
+ * Requêtes (après "GET_HISTORY:") :
+ *   - <n°>:<nombre>             : messages à partir du n° de séquence
+ *                                 (0 = plus ancien message conservé)
+ *   - SINCE:<epoch>:<nombre>    : messages reçus à cette date ou après
+ * 
+ * Seuls les messages envoyés par le client, qui lui sont adressés ou
+ * diffusés à tous sont retournés. Réponse : une trame
+ * HIST:<n°>:<message encodé> par message, puis HIST_END:<n° suivant>
+ * pour demander la page suivante. La lecture des segments et l'encodage
+ * se font dans le pool des commandes ; la session envoie ensuite les
+ * trames et attend que le client lise si la page dépasse la fenêtre de
+ * la file de sortie.
+ */
+Task sendHistory(Connection& conn, std::string request) {
+    std::string username = conn.username;
+    WireFormat format = conn.wireFormat;
+    std::vector<FrameBuffer> frames;
+    std::string error;
+    
+    /* Lecture des segments et encodage des trames dans le pool */
+    co_await offload(conn, [&]() {
+        uint64_t fromSeq;
+        size_t count;
+        
+        try {
+            std::string arguments = request;
+            bool byTime = arguments.substr(0, 6) == "SINCE:";
+            if (byTime) {
+                arguments = arguments.substr(6);
+            }
+            size_t separator = arguments.find(':');
+            if (separator == std::string::npos) {
+                throw std::invalid_argument(request);
+            }
+            long long start = std::stoll(arguments.substr(0, separator));
+            long long requested = std::stoll(arguments.substr(separator + 1));
+            if (start < 0 || requested < 1) {
+                throw std::invalid_argument(request);
+            }
+            fromSeq = byTime ? g_history.seqAtTime(static_cast<time_t>(start)) : static_cast<uint64_t>(start);
+            count = std::min(static_cast<size_t>(requested), HISTORY_PAGE_MAX);
+        } catch (const std::exception&) {
+            error = "ERROR:Requête GET_HISTORY invalide";
+            return;
+        }
+        
+        uint64_t nextSeq;
+        std::vector<HistoryEntry> entries = g_history.read(fromSeq, count, HISTORY_SCAN_MAX,
+            [&username](const Message& msg) {
+                return username == msg.from || username == msg.to || std::string(msg.to) == "all";
+            }, nextSeq);
+        
+        std::string payload;
+        for (const HistoryEntry& entry : entries) {
+            payload.clear();
+            entry.message.encode(format, payload);
+            frames.push_back(makeFrame("HIST:" + std::to_string(entry.seq) + ":", payload.data(), payload.size()));
+        }
+        std::string end = "HIST_END:" + std::to_string(nextSeq);
+        frames.push_back(makeFrame("", end.data(), end.size()));
+    });
+    
+    if (!error.empty()) {
+        sendResponse(conn, error);
+        co_return;
+    }
+    for (FrameBuffer& frame : frames) {
+        EnqueueResult result = co_await conn.write(std::move(frame));
+        if (result != EnqueueResult::Queued) {
+            co_return;
+        }
+    }
+}
+
+/*
+ * Démarre l'envoi du fichier de log (ou d'une partie) au client.
+ * 
+ * Requêtes (après "GET_LOG") :
+ *   - (vide)                    : fichier complet
+ *   - :TAIL:<n>                 : n dernières lignes
+ *   - :RANGE:<début>:<taille>   : plage d'octets
+ *   - :TIME:<début>[,<fin>]     : entrées horodatées entre début et fin
+ *                                 (format YYYY-MM-DD HH:MM:SS, bornes incluses)
+ * 
+ * Réponse : LOG_BEGIN:<taille>, puis des trames LOG: d'au plus
+ * STREAM_CHUNK_SIZE octets envoyées par sendfile(), puis LOG_END:.
+ * 
+ * Le flush du journal, l'ouverture et la recherche des bornes (TAIL,
+ * TIME) se font dans le pool des commandes ; l'envoi lui-même est
+ * piloté par la boucle (pumpStream).
+ * 
+ * Aucun verrou n'est pris : la taille du fichier est figée à la
+ * demande, et le journal continue d'écrire (ou de tourner) pendant
+ * l'envoi sans affecter le descripteur déjà ouvert.
+ */
+Task startLogStream(Connection& conn, std::string request) {
+    if (conn.stream) {
+        sendResponse(conn, "ERROR:Envoi du log déjà en cours");
+        co_return;
+    }
+    
+    SharedFilePtr file;
+    off_t begin = 0;
+    off_t end = 0;
+    std::string error;
+    
+    co_await offload(conn, [&]() {
+        /* Les entrées encore en attente sont d'abord écrites sur disque */
+        g_logger.flush();
+        
+        int fd = open(g_logger.path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = "ERROR:Impossible de lire le fichier log";
+            return;
+        }
+        file = std::make_shared<SharedFile>(fd);
+        
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            error = "ERROR:Impossible de lire le fichier log";
+            return;
+        }
+        off_t size = info.st_size;
+        end = size;
+        
+        try {
+            if (request.substr(0, 5) == "TAIL:") {
+                begin = findLogTail(fd, size, std::stoul(request.substr(5)));
+                
+            } else if (request.substr(0, 6) == "RANGE:") {
+                size_t separator = request.find(':', 6);
+                if (separator == std::string::npos) {
+                    throw std::invalid_argument("RANGE");
+                }
+                long long offset = std::stoll(request.substr(6, separator - 6));
+                long long length = std::stoll(request.substr(separator + 1));
+                if (offset < 0 || length < 0) {
+                    throw std::invalid_argument("RANGE");
+                }
+                begin = std::min<off_t>(offset, size);
+                end = std::min<off_t>(begin + length, size);
+                
+            } else if (request.substr(0, 5) == "TIME:") {
+                std::string range = request.substr(5);
+                size_t separator = range.find(',');
+                begin = findLogTime(fd, size, range.substr(0, separator));
+                if (separator != std::string::npos) {
+                    /* Borne de fin incluse : première entrée strictement après */
+                    end = std::max(begin, findLogTime(fd, size, range.substr(separator + 1) + "~"));
+                }
+                
+            } else if (!request.empty()) {
+                throw std::invalid_argument(request);
+            }
+        } catch (const std::exception&) {
+            error = "ERROR:Requête GET_LOG invalide";
+        }
+    });
+    
+    if (!error.empty()) {
+        sendResponse(conn, error);
+        co_return;
+    }
+    
+    sendResponse(conn, "LOG_BEGIN:" + std::to_string(end - begin));
+    
+    auto stream = std::make_unique<FileStream>();
+    stream->file = file;
+    stream->next = begin;
+    stream->end = end;
+    stream->prefix = "LOG:";
+    stream->trailer = makeFrame("LOG_END:", "", 0);
+    conn.stream = std::move(stream);
+    conn.pumpStream();
+}
+
+/*
+ * Traite la trame Message qui suit une commande SEND:<sendId>.
+ * Le message est décodé dans le format négocié à la connexion puis
+ * placé dans la file d'attente du worker de son destinataire.
+ */
+void handleSendPayload(Connection& conn, const std::string& sendId, const char* data, size_t size) {
+    try {
+        MessageRef msg;
+        try {
+            msg = g_messagePool.decode(conn.wireFormat, data, size, std::time(nullptr));
+        } catch (const std::runtime_error&) {
+            /* Message mal formaté : msg reste vide */
+        }
+        
+        if (msg) {
+            /* Ajout à la file d'attente (réveille le worker de livraison s'il dort) */
+            enqueueMessage(msg);
+            
+            sendResponse(conn, sendId.empty() ? "OK:Message en file d'attente" : "ACK:" + sendId);
+            writeLog("Message ajouté à la queue de " + std::string(msg->from) + " vers " + std::string(msg->to));
+        } else if (sendId.empty()) {
+            sendResponse(conn, "ERROR:Message mal formaté");
+        } else {
+            sendResponse(conn, "NACK:" + sendId + ":Message mal formaté");
+        }
+        
+    } catch (const std::exception& e) {
+        writeLog("Erreur traitement commande: " + std::string(e.what()));
+        try {
+            sendResponse(conn, "ERROR:" + std::string(e.what()));
+        } catch (...) {
+            /* Ignorer les erreurs d'envoi de la réponse d'erreur */
+        }
+    }
+}
+
+/*
+ * Traite une trame "SEND_BATCH:" contenant plusieurs messages.
+ * 
+ * Format (après le préfixe) :
+ *   [varint nombre]([varint id client][varint taille][message encodé])...
+ * 
+ * Les messages valides sont mis en file les uns après les autres et
+ * acquittés ensemble par une trame "ACK:<id>,<id>,..." ; chaque message
+ * refusé reçoit une trame "NACK:<id>:<raison>". Les identifiants sont
+ * choisis par le client : il peut ainsi garder plusieurs lots en vol et
+ * associer chaque acquittement à son envoi.
+ * 
+ * Le découpage du lot est vérifié en entier avant toute mise en file :
+ * un lot tronqué est refusé d'un bloc, chaque identifiant lisible reçoit
+ * un NACK, suivi de "ERROR:Lot de messages tronqué". Aucun message d'un
+ * lot refusé n'est donc livré sans réponse, ni l'inverse.
+ */
+void handleSendBatch(Connection& conn, const char* data, size_t size) {
+    const char* cursor = data;
+    const char* end = data + size;
+    uint64_t count;
+    
+    if (!readVarint(cursor, end, count) || count > SEND_BATCH_MAX) {
+        sendResponse(conn, "ERROR:Lot de messages mal formé");
+        return;
+    }
+    
+    /* Découpage : (id, début, taille) de chaque message */
+    struct BatchItem {
+        uint64_t id;
+        const char* data;
+        size_t size;
+    };
+    std::vector<BatchItem> items;
+    items.reserve(count);
+    bool truncated = false;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t id;
+        uint64_t length;
+        if (!readVarint(cursor, end, id)) {
+            truncated = true;
+            break;
+        }
+        if (!readVarint(cursor, end, length) || length > static_cast<uint64_t>(end - cursor)) {
+            items.push_back({id, nullptr, 0});
+            truncated = true;
+            break;
+        }
+        items.push_back({id, cursor, static_cast<size_t>(length)});
+        cursor += length;
+    }
+    
+    if (truncated) {
+        for (const BatchItem& item : items) {
+            sendResponse(conn, "NACK:" + std::to_string(item.id) + ":Lot de messages tronqué");
+        }
+        sendResponse(conn, "ERROR:Lot de messages tronqué");
+        return;
+    }
+    
+    std::vector<MessageRef> accepted;
+    std::string acks;
+    accepted.reserve(count);
+    time_t now = std::time(nullptr);
+    
+    for (const BatchItem& item : items) {
+        try {
+            accepted.push_back(g_messagePool.decode(conn.wireFormat, item.data, item.size, now));
+            acks += (acks.empty() ? "" : ",") + std::to_string(item.id);
+        } catch (const std::runtime_error&) {
+            sendResponse(conn, "NACK:" + std::to_string(item.id) + ":Message mal formaté");
+        }
+    }
+    
+    if (accepted.empty()) {
+        return;
+    }
+    
+    /* Ajout de tout le lot à la file d'attente (sans verrou) */
+    for (const MessageRef& msg : accepted) {
+        enqueueMessage(msg);
+    }
+    
+    sendResponse(conn, "ACK:" + acks);
+    writeLog(std::to_string(accepted.size()) + " message(s) ajouté(s) à la queue par " + conn.username);
+}
+
+/* ========================================================================== */
+/*                             MÉTRIQUES                                      */
+/* ========================================================================== */
+
+/*
+ * Rapport des métriques (commande STATS, --stats-interval).
+ * 
+ * Une ligne "<nom>=<valeur>" par jauge et par compteur, puis une ligne
+ * par histogramme de durées, en microsecondes :
+ *   <nom>_us count=<n> p50=<µs> p99=<µs> p999=<µs> max=<µs>
+ * 
+ * Les jauges sont lues à l'instant du rapport ; les compteurs et les
+ * histogrammes sont cumulés depuis le démarrage (voir server_stats.h).
+ * Un serveur compilé avec LOCK_PROFILING ajoute les lignes lock_*
+ * (voir lock_profiler.h).
+ */
+std::string formatStats() {
+    StatsSnapshot stats = serverStats().snapshot();
+    
+    size_t queueDepth = 0;
+    for (auto& queue : g_deliveryQueues) {
+        queueDepth += queue->size();
+    }
+    
+    std::string report;
+    auto line = [&report](const std::string& name, uint64_t value) {
+        report += name + "=" + std::to_string(value) + "\n";
+    };
+    auto micros = [](uint64_t nanos) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.1f", static_cast<double>(nanos) / 1000.0);
+        return std::string(text);
+    };
+    
+    line("uptime_s", (statsClockNanos() - g_startNanos) / 1000000000);
+    line("connected_users", g_registry.connectionCount());
+    line("queue_depth", queueDepth);
+    line("pool_queue_depth", g_commandPool.pending());
+    line("cluster_links", g_cluster.linkCount());
+    line("remote_users", g_cluster.remoteUserCount());
+    line("ring_nodes", g_cluster.enabled() ? g_cluster.ringSize() : 0);
+    line("history_messages", g_history.nextSeq() - g_history.firstSeq());
+    
+    /* Occupation du pool de messages (préfixe distinct du pool des commandes) */
+    MessagePoolStats messagePool = g_messagePool.stats();
+    line("message_pool_slabs", messagePool.slabs);
+    line("message_pool_live", messagePool.inUse);
+    line("message_pool_free", messagePool.capacity - std::min(messagePool.inUse, messagePool.capacity));
+    line("message_pool_peak", messagePool.peakInUse);
+    
+    for (size_t i = 0; i < STAT_COUNTERS; ++i) {
+        StatCounter counter = static_cast<StatCounter>(i);
+        line(statName(counter), stats.counter(counter));
+    }
+    
+    for (size_t i = 0; i < STAT_TIMERS; ++i) {
+        StatTimer timer = static_cast<StatTimer>(i);
+        const Histogram& histogram = stats.timer(timer);
+        report += std::string(statName(timer)) + "_us count=" + std::to_string(histogram.count())
+                  + " p50=" + micros(histogram.percentile(50.0))
+                  + " p99=" + micros(histogram.percentile(99.0))
+                  + " p999=" + micros(histogram.percentile(99.9))
+                  + " max=" + micros(histogram.max()) + "\n";
+    }
+    
+    /* Contention des verrous (serveur compilé avec LOCK_PROFILING) */
+    report += lockProfileReport();
+    if (report.back() != '\n') {
+        report += '\n';
+    }
+    
+    report.pop_back();
+    return report;
+}
+
+/*
+ * Copie des métriques dans le log toutes les --stats-interval secondes,
+ * une entrée par ligne du rapport. L'arrêt du serveur réveille le thread.
+ */
+void statsThread() {
+    auto interval = std::chrono::seconds(g_config.statsIntervalSeconds);
+    std::unique_lock<std::mutex> lock(g_statsMutex);
+    
+    while (!g_statsCond.wait_for(lock, interval, [] { return !g_serverRunning.load(); })) {
+        lock.unlock();
+        std::string report = formatStats();
+        size_t start = 0;
+        while (start <= report.size()) {
+            size_t end = report.find('\n', start);
+            if (end == std::string::npos) {
+                end = report.size();
+            }
+            writeLog("Stats: " + report.substr(start, end - start));
+            start = end + 1;
+        }
+        lock.lock();
+    }
+}
+
+/*
+ * Analyse les options de la ligne de commande (format --nom=valeur).
+ * Lève std::invalid_argument pour une option inconnue ou invalide.
+ */
+ServerConfig parseArguments(int argc, char* argv[]) {
+    ServerConfig config;
+    config.port = DEFAULT_PORT;
+    config.backlog = SOMAXCONN;
+    config.reusePort = false;
+    config.ioThreads = std::max(1u, std::thread::hardware_concurrency());
+    config.ioBackend = IoBackend::Epoll;
+    config.deliveryMode = DeliveryMode::Immediate;
+    config.deliveryIntervalSeconds = DELIVERY_INTERVAL_SECONDS;
+    config.deliveryWorkers = static_cast<int>(std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                                               DEFAULT_REGISTRY_SHARDS));
+    config.commandWorkers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    config.batchWindowMicros = 0;
+    config.batchMax = DEFAULT_BATCH_MAX;
+    config.maxOutboundBytes = DEFAULT_MAX_OUTBOUND_BYTES;
+    config.slowConsumer = SlowConsumerPolicy::Disconnect;
+    config.maxWireFormat = WireFormat::Compact;
+    config.statsIntervalSeconds = 0;
+    config.ringVirtualNodes = DEFAULT_VIRTUAL_NODES;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t separator = arg.find('=');
+        std::string name = arg.substr(0, separator);
+        std::string value = (separator == std::string::npos) ? "" : arg.substr(separator + 1);
+        
+        if (name == "--port") {
+            config.port = std::stoi(value);
+            if (config.port < 1 || config.port > 65535) {
+                throw std::invalid_argument("--port doit être entre 1 et 65535");
+            }
+        } else if (name == "--backlog") {
+            config.backlog = std::stoi(value);
+            if (config.backlog < 1) {
+                throw std::invalid_argument("--backlog doit être >= 1");
+            }
+        } else if (name == "--reuseport") {
+            if (value != "0" && value != "1") {
+                throw std::invalid_argument("--reuseport doit valoir 0 ou 1");
+            }
+            config.reusePort = (value == "1");
+        } else if (name == "--io-threads") {
+            config.ioThreads = std::stoi(value);
+            if (config.ioThreads < 1) {
+                throw std::invalid_argument("--io-threads doit être >= 1");
+            }
+        } else if (name == "--io-backend") {
+            if (value == "epoll") {
+                config.ioBackend = IoBackend::Epoll;
+            } else if (value == "io_uring") {
+                config.ioBackend = IoBackend::IoUring;
+            } else {
+                throw std::invalid_argument("--io-backend doit valoir epoll ou io_uring");
+            }
+        } else if (name == "--delivery") {
+            if (value == "immediate") {
+                config.deliveryMode = DeliveryMode::Immediate;
+            } else if (value == "periodic") {
+                config.deliveryMode = DeliveryMode::Periodic;
+            } else {
+                throw std::invalid_argument("--delivery doit valoir immediate ou periodic");
+            }
+        } else if (name == "--delivery-interval") {
+            config.deliveryIntervalSeconds = std::stoi(value);
+            if (config.deliveryIntervalSeconds < 1) {
+                throw std::invalid_argument("--delivery-interval doit être >= 1");
+            }
+        } else if (name == "--delivery-workers") {
+            config.deliveryWorkers = std::stoi(value);
+            if (config.deliveryWorkers < 1 || static_cast<size_t>(config.deliveryWorkers) > DEFAULT_REGISTRY_SHARDS) {
+                throw std::invalid_argument("--delivery-workers doit être entre 1 et "
+                                            + std::to_string(DEFAULT_REGISTRY_SHARDS));
+            }
+        } else if (name == "--command-workers") {
+            config.commandWorkers = std::stoi(value);
+            if (config.commandWorkers < 0) {
+                throw std::invalid_argument("--command-workers doit être >= 0");
+            }
+        } else if (name == "--batch-window-us") {
+            config.batchWindowMicros = std::stoi(value);
+            if (config.batchWindowMicros < 0) {
+                throw std::invalid_argument("--batch-window-us doit être >= 0");
+            }
+        } else if (name == "--batch-max") {
+            int batchMax = std::stoi(value);
+            if (batchMax < 1) {
+                throw std::invalid_argument("--batch-max doit être >= 1");
+            }
+            config.batchMax = static_cast<size_t>(batchMax);
+        } else if (name == "--max-outbound") {
+            long long maxOutbound = std::stoll(value);
+            if (maxOutbound < 1) {
+                throw std::invalid_argument("--max-outbound doit être >= 1");
+            }
+            config.maxOutboundBytes = static_cast<size_t>(maxOutbound);
+        } else if (name == "--slow-consumer") {
+            if (value == "disconnect") {
+                config.slowConsumer = SlowConsumerPolicy::Disconnect;
+            } else if (value == "drop") {
+                config.slowConsumer = SlowConsumerPolicy::DropMessages;
+            } else {
+                throw std::invalid_argument("--slow-consumer doit valoir disconnect ou drop");
+            }
+        } else if (name == "--wire-format") {
+            if (value == "compact") {
+                config.maxWireFormat = WireFormat::Compact;
+            } else if (value == "legacy") {
+                config.maxWireFormat = WireFormat::Legacy;
+            } else {
+                throw std::invalid_argument("--wire-format doit valoir compact ou legacy");
+            }
+        } else if (name == "--tcp-nodelay") {
+            config.socketOptions.noDelay = (value != "0");
+        } else if (name == "--sndbuf") {
+            config.socketOptions.sendBufferSize = std::stoi(value);
+        } else if (name == "--rcvbuf") {
+            config.socketOptions.receiveBufferSize = std::stoi(value);
+        } else if (name == "--log-echo") {
+            config.logOptions.echo = (value != "0");
+        } else if (name == "--log-flush") {
+            if (value == "batch") {
+                config.logOptions.flushPolicy = LogFlushPolicy::Batch;
+            } else if (value == "interval") {
+                config.logOptions.flushPolicy = LogFlushPolicy::Interval;
+            } else {
+                throw std::invalid_argument("--log-flush doit valoir batch ou interval");
+            }
+        } else if (name == "--log-flush-ms") {
+            config.logOptions.flushIntervalMs = std::stoi(value);
+            if (config.logOptions.flushIntervalMs < 1) {
+                throw std::invalid_argument("--log-flush-ms doit être >= 1");
+            }
+        } else if (name == "--log-max-size") {
+            long long maxSize = std::stoll(value);
+            if (maxSize < 0) {
+                throw std::invalid_argument("--log-max-size doit être >= 0");
+            }
+            config.logOptions.maxFileSize = static_cast<uint64_t>(maxSize);
+        } else if (name == "--log-keep") {
+            config.logOptions.keepFiles = std::stoi(value);
+            if (config.logOptions.keepFiles < 0) {
+                throw std::invalid_argument("--log-keep doit être >= 0");
+            }
+        } else if (name == "--history-dir") {
+            if (value.empty()) {
+                throw std::invalid_argument("--history-dir ne doit pas être vide");
+            }
+            config.historyOptions.directory = value;
+        } else if (name == "--history-segment-size") {
+            long long segmentSize = std::stoll(value);
+            if (segmentSize < 1) {
+                throw std::invalid_argument("--history-segment-size doit être >= 1");
+            }
+            config.historyOptions.segmentMaxBytes = static_cast<uint64_t>(segmentSize);
+        } else if (name == "--history-segments") {
+            int segments = std::stoi(value);
+            if (segments < 0) {
+                throw std::invalid_argument("--history-segments doit être >= 0");
+            }
+            config.historyOptions.maxSegments = static_cast<size_t>(segments);
+        } else if (name == "--history-max-age") {
+            config.historyOptions.maxAgeSeconds = std::stoll(value);
+            if (config.historyOptions.maxAgeSeconds < 0) {
+                throw std::invalid_argument("--history-max-age doit être >= 0");
+            }
+        } else if (name == "--mailbox-dir") {
+            if (value.empty()) {
+                throw std::invalid_argument("--mailbox-dir ne doit pas être vide");
+            }
+            config.mailboxOptions.directory = value;
+        } else if (name == "--mailbox-max") {
+            int maxPerUser = std::stoi(value);
+            if (maxPerUser < 0) {
+                throw std::invalid_argument("--mailbox-max doit être >= 0");
+            }
+            config.mailboxOptions.maxPerUser = static_cast<size_t>(maxPerUser);
+        } else if (name == "--mailbox-memory") {
+            int memoryTotal = std::stoi(value);
+            if (memoryTotal < 0) {
+                throw std::invalid_argument("--mailbox-memory doit être >= 0");
+            }
+            config.mailboxOptions.memoryTotal = static_cast<size_t>(memoryTotal);
+        } else if (name == "--stats-interval") {
+            config.statsIntervalSeconds = std::stoi(value);
+            if (config.statsIntervalSeconds < 0) {
+                throw std::invalid_argument("--stats-interval doit être >= 0");
+            }
+        } else if (name == "--node-id") {
+            if (value.empty() || value.find_first_of(",@:") != std::string::npos) {
+                throw std::invalid_argument("--node-id doit être un nom non vide sans ',', '@' ni ':'");
+            }
+            config.nodeId = value;
+        } else if (name == "--peers") {
+            config.peers = parsePeerList(value);
+        } else if (name == "--cluster-secret") {
+            config.clusterSecret = value;
+        } else if (name == "--ring-vnodes") {
+            int vnodes = std::stoi(value);
+            if (vnodes < 1) {
+                throw std::invalid_argument("--ring-vnodes doit être >= 1");
+            }
+            config.ringVirtualNodes = static_cast<size_t>(vnodes);
+        } else {
+            throw std::invalid_argument("Option inconnue: " + arg);
+        }
+    }
+    
+    if (!config.peers.empty()) {
+        if (config.nodeId.empty()) {
+            throw std::invalid_argument("--peers nécessite --node-id");
+        }
+        if (config.clusterSecret.empty()) {
+            /* L'adresse seule ne suffit pas : tout processus de la machine d'un pair la partage */
+            throw std::invalid_argument("--peers nécessite --cluster-secret");
+        }
+        for (const PeerAddress& peer : config.peers) {
+            if (peer.node == config.nodeId) {
+                throw std::invalid_argument("--peers ne doit pas contenir ce nœud (" + config.nodeId + ")");
+            }
+        }
+    }
+    
+    return config;
 }
 
 /* ========================================================================== */
@@ -504,94 +2138,181 @@ void handleCommand(SOCKET clientSocket, const std::string& username, const std::
  * Séquence de démarrage :
  *   1. Initialisation de la couche réseau
  *   2. Ouverture du fichier de log
- *   3. Création et configuration du socket serveur
- *   4. Démarrage du thread de livraison
- *   5. Boucle d'acceptation des connexions
+ *   3. Création du ou des sockets d'écoute (non bloquants, --port, --backlog)
+ *   4. Démarrage des workers de livraison et du pool des commandes
+ *   5. Démarrage des boucles d'événements (une par cœur)
+ *   6. En grappe, démarrage du thread des liaisons vers les pairs
  * 
  * Séquence d'arrêt :
- *   1. Attente de la fin du thread de livraison
- *   2. Attente et nettoyage des threads utilisateurs
- *   3. Fermeture du socket serveur
- *   4. Libération des ressources
+ *   1. Attente de la fin des boucles d'événements
+ *   2. Arrêt du pool des commandes et du thread des liaisons (avant la
+ *      destruction des boucles, auxquelles ils postent des tâches)
+ *   3. Attente de la fin des workers de livraison
+ *   4. Fermeture des connexions restantes, des liaisons et des sockets d'écoute
+ *   5. Libération des ressources
  */
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        g_config = parseArguments(argc, argv);
+        g_cluster.configure(g_config.nodeId, g_config.peers, g_config.clusterSecret,
+                           g_config.ringVirtualNodes);
+        g_startNanos = statsClockNanos();
+        
+        /* Un client qui ferme pendant un envoi ne doit pas tuer le serveur */
+        signal(SIGPIPE, SIG_IGN);
+        
         /* Initialisation de la couche réseau (Winsock sous Windows) */
         SocketUtils::initializeWinsock();
         
-        /* Ouverture du fichier de log en mode ajout */
-        g_logFile.open("server.log", std::ios::app);
-        if (!g_logFile) {
+        /* Ouverture du fichier de log en mode ajout (thread d'écriture dédié) */
+        if (!g_logger.open("server.log", g_config.logOptions)) {
             std::cerr << "Impossible d'ouvrir le fichier de log" << std::endl;
             return 1;
         }
         
         writeLog("=== SERVEUR DE MESSAGERIE DÉMARRÉ ===");
         
-        /* Configuration du socket serveur */
-        SOCKET serverSocket = SocketUtils::createTCPSocket();
-        SocketUtils::bindSocket(serverSocket, PORT);
-        SocketUtils::listenSocket(serverSocket);
+        /* Ouverture de l'historique persistant (reprise des segments existants) */
+        g_history.open(g_config.historyOptions);
+        writeLog("Historique ouvert: " + g_config.historyOptions.directory
+                 + " (prochain message n°" + std::to_string(g_history.nextSeq()) + ")");
         
-        writeLog("Serveur en écoute sur le port " + std::to_string(PORT));
+        /* Boîtes de réception des utilisateurs absents */
+        g_mailboxes.open(g_config.mailboxOptions);
         
-        /* Démarrage du thread de livraison */
-        std::thread deliveryThreadObj(deliveryThread);
-        
-        /* Boucle principale : acceptation des connexions entrantes */
-        while (g_serverRunning) {
-            /* Vérification non-bloquante d'une connexion en attente */
-            if (!SocketUtils::hasData(serverSocket, 1000)) {
-                continue;
+        /* Sockets d'écoute : un partagé, ou un par boucle avec SO_REUSEPORT */
+        std::vector<SOCKET> listeners;
+        try {
+            int listenerCount = g_config.reusePort ? g_config.ioThreads : 1;
+            for (int i = 0; i < listenerCount; ++i) {
+                listeners.push_back(createListener());
             }
-            
-            std::string clientIP;
-            SOCKET clientSocket = SocketUtils::acceptConnection(serverSocket, clientIP);
-            
-            /* Création d'un thread dédié pour ce client */
-            std::thread* userThread = new std::thread(userHandlerThread, clientSocket, clientIP);
-            
-            /* Enregistrement dans la liste des utilisateurs */
-            {
-                std::lock_guard<std::mutex> lock(g_usersMutex);
-                ConnectedUser user;
-                user.username = "";  /* Sera défini par le thread */
-                user.socket = clientSocket;
-                user.handlerThread = userThread;
-                g_connectedUsers.push_back(user);
+        } catch (...) {
+            for (SOCKET listener : listeners) {
+                SocketUtils::closeSocket(listener);
             }
+            throw;
         }
         
-        /* Arrêt propre : attente du thread de livraison */
-        if (deliveryThreadObj.joinable()) {
-            deliveryThreadObj.join();
+        writeLog("Serveur en écoute sur le port " + std::to_string(g_config.port)
+                 + " (backlog " + std::to_string(g_config.backlog) + ", "
+                 + std::to_string(listeners.size()) + " socket(s) d'écoute, "
+                 + std::to_string(g_config.ioThreads) + " boucle(s) d'événements, "
+                 + std::to_string(g_config.deliveryWorkers) + " worker(s) de livraison, "
+                 + std::to_string(g_config.commandWorkers) + " worker(s) de commandes)");
+        
+        /* Démarrage des workers de livraison (une file chacun) */
+        for (int i = 0; i < g_config.deliveryWorkers; ++i) {
+            g_deliveryQueues.push_back(std::make_unique<MpscQueue<QueuedMessage>>());
+        }
+        std::vector<std::thread> deliveryThreads;
+        for (int i = 0; i < g_config.deliveryWorkers; ++i) {
+            deliveryThreads.emplace_back(deliveryThread, static_cast<size_t>(i));
         }
         
-        /* Attente et nettoyage des threads utilisateurs */
-        {
-            std::lock_guard<std::mutex> lock(g_usersMutex);
-            for (auto& user : g_connectedUsers) {
-                if (user.handlerThread) {
-                    if (user.handlerThread->joinable()) {
-                        user.handlerThread->join();
-                    }
-                    delete user.handlerThread;
-                    user.handlerThread = nullptr;
+        /* Pool des commandes coûteuses (vol de travail) */
+        g_commandPool.start(static_cast<size_t>(g_config.commandWorkers));
+        
+        /* Copie périodique des métriques dans le log (--stats-interval) */
+        std::thread metricsThread;
+        if (g_config.statsIntervalSeconds > 0) {
+            metricsThread = std::thread(statsThread);
+        }
+        
+        /* 
+         * Création des boucles d'événements. Si io_uring est indisponible
+         * (noyau trop ancien, désactivé), repli sur epoll pour toutes.
+         * Socket d'écoute partagé : le noyau ne réveille qu'une boucle par
+         * connexion entrante (EPOLLEXCLUSIVE, ou accept io_uring exclusif).
+         * Avec SO_REUSEPORT, chaque boucle n'écoute que son propre socket.
+         */
+        for (int i = 0; i < g_config.ioThreads; ++i) {
+            try {
+                g_eventLoops.push_back(EventLoop::create(g_config.ioBackend));
+            } catch (const std::runtime_error& e) {
+                if (g_config.ioBackend != IoBackend::IoUring) {
+                    throw;
                 }
+                writeLog("io_uring indisponible (" + std::string(e.what()) + "), repli sur epoll");
+                g_config.ioBackend = IoBackend::Epoll;
+                g_eventLoops.push_back(EventLoop::create(g_config.ioBackend));
             }
+            EventLoop* loop = g_eventLoops.back().get();
+            loop->setErrorHandler(onLoopError);
+            SOCKET listener = listeners[g_config.reusePort ? i : 0];
+            loop->addListener(listener, !g_config.reusePort,
+                              [loop](SOCKET clientSocket, const std::string& clientIP) {
+                                  acceptClient(*loop, clientSocket, clientIP);
+                              });
+        }
+        writeLog("Entrées/sorties réseau: " + std::string(g_eventLoops.front()->backendName()));
+        
+        std::vector<std::thread> loopThreads;
+        for (auto& loop : g_eventLoops) {
+            EventLoop* loopPtr = loop.get();
+            loopThreads.emplace_back([loopPtr]() {
+                try {
+                    loopPtr->run();
+                } catch (const std::exception& e) {
+                    writeLog("Erreur fatale dans une boucle d'événements: " + std::string(e.what()));
+                    stopServer();
+                }
+            });
+        }
+        
+        /* Liaisons vers les autres nœuds de la grappe */
+        std::thread linksThread;
+        if (g_cluster.enabled()) {
+            writeLog("Nœud " + g_cluster.self() + " : " + std::to_string(g_cluster.peers().size()) + " pair(s)");
+            linksThread = std::thread(clusterThread);
+        }
+        
+        /* Arrêt propre : attente des boucles, du pool puis des workers de livraison */
+        for (auto& thread : loopThreads) {
+            thread.join();
+        }
+        
+        g_commandPool.stop();
+        if (linksThread.joinable()) {
+            linksThread.join();
+        }
+        
+        for (auto& thread : deliveryThreads) {
+            thread.join();
+        }
+        
+        if (metricsThread.joinable()) {
+            metricsThread.join();
+        }
+        
+        /* Fermeture des connexions encore ouvertes */
+        g_registry.forEachConnection([](const std::shared_ptr<Connection>& conn) {
+            conn->close();
+        });
+        for (const auto& link : g_cluster.takeLinks()) {
+            link->close();
+        }
+        g_eventLoops.clear();
+        
+        /* Fermeture des sockets d'écoute */
+        for (SOCKET listener : listeners) {
+            SocketUtils::closeSocket(listener);
         }
         
-        /* Fermeture du socket serveur */
-        SocketUtils::closeSocket(serverSocket);
+        g_history.close();
         
+        MessagePoolStats pool = g_messagePool.stats();
+        writeLog("Pool de messages : " + std::to_string(pool.allocations) + " message(s) reçu(s), pic de "
+                 + std::to_string(pool.peakInUse) + " en vol, " + std::to_string(pool.capacity)
+                 + " emplacement(s) en " + std::to_string(pool.slabs) + " bloc(s)");
         writeLog("=== SERVEUR ARRÊTÉ ===");
-        g_logFile.close();
+        g_logger.close();
         
         SocketUtils::cleanupWinsock();
         
     } catch (const std::exception& e) {
         std::cerr << "Erreur fatale: " << e.what() << std::endl;
-        g_logFile.close();
+        g_logger.close();
         SocketUtils::cleanupWinsock();
         return 1;
     }
@@ -0,0 +1,111 @@
+/*
+ * session.h
+ *
+ * Types de retour des coroutines C++20 qui traitent les sessions client.
+ *
+ * Une session est une coroutine par connexion, écrite comme du code
+ * séquentiel :
+ *
+ *     FrameView frame = co_await conn.readFrame();
+ *     co_await conn.write(buffer);
+ *
+ * Elle s'exécute dans le thread de la boucle propriétaire de la
+ * connexion, sans thread dédié : en attente d'une trame, elle n'occupe
+ * que son cadre de coroutine (quelques centaines d'octets) au lieu
+ * d'une pile de thread. La boucle la reprend quand une trame complète
+ * est arrivée ou quand la file de sortie s'est vidée (voir Connection).
+ *
+ *   - Session : coroutine racine, démarrée immédiatement et détachée ;
+ *               son cadre est libéré à la fin de la coroutine
+ *   - Task    : sous-coroutine (gestionnaire de commande), démarrée au
+ *               co_await de l'appelant, qui est repris à la fin ; une
+ *               exception est relancée chez l'appelant
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+/*
+ * Classe Session
+ *
+ * La coroutine doit intercepter elle-même ses exceptions : une
+ * exception non traitée termine le programme.
+ */
+class Session {
+public:
+    struct promise_type {
+        Session get_return_object() noexcept { return Session(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+/*
+ * Classe Task
+ *
+ * Démarrage paresseux : rien ne s'exécute avant le co_await. La fin de
+ * la sous-coroutine transfère directement le contrôle à l'appelant
+ * (transfert symétrique), sans passer par la boucle.
+ */
+class Task {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+        std::coroutine_handle<> continuation;   /* Coroutine qui attend la fin */
+        std::exception_ptr exception;           /* Exception à relancer        */
+
+        /* Reprise de l'appelant à la fin de la sous-coroutine */
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(Handle handle) noexcept {
+                return handle.promise().continuation;
+            }
+            void await_resume() const noexcept {}
+        };
+
+        Task get_return_object() noexcept { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+    };
+
+    explicit Task(Handle handle) : m_handle(handle) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    ~Task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&) = delete;
+
+    /* Attente par une autre coroutine : démarre la sous-coroutine */
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        m_handle.promise().continuation = caller;
+        return m_handle;
+    }
+    void await_resume() const {
+        if (m_handle.promise().exception) {
+            std::rethrow_exception(m_handle.promise().exception);
+        }
+    }
+
+private:
+    Handle m_handle;
+};
+
+#endif /* SESSION_H */
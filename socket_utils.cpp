@@ -14,9 +14,14 @@
     #include <winsock2.h>
 #else
     #include <sys/select.h>
+    #include <poll.h>
     #include <fcntl.h>
+    #include <cerrno>
 #endif
 
+/* Délai maximal d'attente de place en émission sur un socket non bloquant */
+constexpr int SEND_TIMEOUT_MS = 5000;
+
 /* ========================================================================== */
 /*                      INITIALISATION / NETTOYAGE                            */
 /* ========================================================================== */
@@ -59,9 +64,10 @@ void SocketUtils::cleanupWinsock() {
  *   - IPPROTO_TCP : Protocole TCP explicite
  * 
  * Active l'option SO_REUSEADDR pour pouvoir réutiliser le port
- * immédiatement après fermeture (évite "Address already in use").
+ * immédiatement après fermeture (évite "Address already in use"),
+ * puis applique les options TCP demandées.
  */
-SOCKET SocketUtils::createTCPSocket() {
+SOCKET SocketUtils::createTCPSocket(const SocketOptions& options) {
     SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (sock == INVALID_SOCKET) {
         throw std::runtime_error("Échec de création du socket");
@@ -69,10 +75,34 @@ SOCKET SocketUtils::createTCPSocket() {
     
     int opt = 1;
     setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt));
+    applySocketOptions(sock, options);
     
     return sock;
 }
 
+/*
+ * Applique les options TCP à un socket.
+ * 
+ *   - TCP_NODELAY : les petites trames (commandes, accusés) partent
+ *                   immédiatement au lieu d'attendre l'ACK précédent
+ *   - SO_SNDBUF / SO_RCVBUF : tailles des tampons noyau (0 = inchangées)
+ * 
+ * Les sockets acceptés héritent des tampons du socket d'écoute mais
+ * pas toujours de TCP_NODELAY : le serveur rappelle donc cette fonction
+ * après accept().
+ */
+void SocketUtils::applySocketOptions(SOCKET sock, const SocketOptions& options) {
+    int noDelay = options.noDelay ? 1 : 0;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+    
+    if (options.sendBufferSize > 0) {
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char*)&options.sendBufferSize, sizeof(options.sendBufferSize));
+    }
+    if (options.receiveBufferSize > 0) {
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&options.receiveBufferSize, sizeof(options.receiveBufferSize));
+    }
+}
+
 /*
  * Ferme un socket de manière portable.
  * Utilise closesocket() sous Windows, close() sous Linux.
@@ -107,11 +137,30 @@ void SocketUtils::bindSocket(SOCKET sock, int port) {
     }
 }
 
+/*
+ * Active SO_REUSEPORT (Linux 3.9+) : plusieurs sockets peuvent écouter
+ * sur le même port, chacun avec sa propre file de connexions, et le
+ * noyau répartit les connexions entrantes entre eux (hachage du
+ * quadruplet d'adresses).
+ */
+void SocketUtils::enableReusePort(SOCKET sock) {
+#ifdef SO_REUSEPORT
+    int opt = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&opt, sizeof(opt)) == SOCKET_ERROR) {
+        throw std::runtime_error("Échec de SO_REUSEPORT");
+    }
+#else
+    (void)sock;
+    throw std::runtime_error("SO_REUSEPORT non disponible sur ce système");
+#endif
+}
+
 /*
  * Passe le socket en mode écoute passive.
  * 
  * Le paramètre backlog définit la taille de la file d'attente
- * des connexions en attente d'être acceptées.
+ * des connexions en attente d'être acceptées (plafonnée par le noyau
+ * à net.core.somaxconn).
  */
 void SocketUtils::listenSocket(SOCKET sock, int backlog) {
     if (listen(sock, backlog) == SOCKET_ERROR) {
@@ -123,21 +172,74 @@ void SocketUtils::listenSocket(SOCKET sock, int backlog) {
  * Accepte une connexion entrante (bloquant).
  * 
  * Retourne le socket client créé pour cette connexion.
- * Récupère l'adresse IP du client via inet_ntoa().
+ * Récupère l'adresse IP du client via inet_ntop() (réentrant,
+ * contrairement à inet_ntoa() et son tampon statique).
+ * 
+ * Sous Linux, accept4() crée directement le socket non bloquant et
+ * fermé à l'exec() si demandé, sans fcntl() supplémentaire.
+ * 
+ * Si le socket d'écoute est non bloquant et que la file est vide (ou
+ * qu'une autre boucle a déjà pris la connexion), accept() échoue avec
+ * EAGAIN : on retourne alors INVALID_SOCKET au lieu de lever une
+ * exception. Une connexion abandonnée par le client avant d'être
+ * acceptée (ECONNABORTED) est ignorée.
  */
-SOCKET SocketUtils::acceptConnection(SOCKET serverSocket, std::string& clientIP) {
+SOCKET SocketUtils::acceptConnection(SOCKET serverSocket, std::string& clientIP, bool nonBlocking) {
     struct sockaddr_in clientAddr;
-    socklen_t clientAddrLen = sizeof(clientAddr);
+    socklen_t clientAddrLen;
+    SOCKET clientSocket;
     
-    SOCKET clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
-    if (clientSocket == INVALID_SOCKET) {
-        throw std::runtime_error("Échec d'accept");
+    while (true) {
+        clientAddrLen = sizeof(clientAddr);
+#ifdef _WIN32
+        clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
+        if (clientSocket != INVALID_SOCKET && nonBlocking) {
+            setNonBlocking(clientSocket);
+        }
+#else
+        clientSocket = accept4(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen,
+                               SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0));
+#endif
+        if (clientSocket != INVALID_SOCKET) {
+            break;
+        }
+#ifndef _WIN32
+        if (errno == ECONNABORTED) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return INVALID_SOCKET;
+        }
+#endif
+        /* errno gardé pour l'appelant (EMFILE, ENFILE : voir EventLoop::shedConnection) */
+        int error = errno;
+        std::string message = "Échec d'accept: " + std::string(strerror(error));
+        errno = error;
+        throw std::runtime_error(message);
     }
     
-    clientIP = inet_ntoa(clientAddr.sin_addr);
+    char address[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &clientAddr.sin_addr, address, sizeof(address)) == nullptr) {
+        address[0] = '\0';
+    }
+    clientIP = address;
     return clientSocket;
 }
 
+std::string SocketUtils::peerAddress(SOCKET sock) {
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    if (getpeername(sock, (struct sockaddr*)&addr, &addrLen) != 0) {
+        return "";
+    }
+    
+    char address[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &addr.sin_addr, address, sizeof(address)) == nullptr) {
+        return "";
+    }
+    return address;
+}
+
 /* ========================================================================== */
 /*                            CÔTÉ CLIENT                                     */
 /* ========================================================================== */
@@ -149,7 +251,8 @@ SOCKET SocketUtils::acceptConnection(SOCKET serverSocket, std::string& clientIP)
  *   - Windows : inet_addr() (IPv4 uniquement)
  *   - Linux   : inet_pton() (supporte IPv4 et IPv6)
  */
-void SocketUtils::connectToServer(SOCKET sock, const std::string& serverIP, int port) {
+/* Adresse IPv4 d'un serveur distant */
+static struct sockaddr_in serverAddress(const std::string& serverIP, int port) {
     struct sockaddr_in serverAddr;
     memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
@@ -162,12 +265,43 @@ void SocketUtils::connectToServer(SOCKET sock, const std::string& serverIP, int
         throw std::runtime_error("Adresse IP invalide");
     }
 #endif
-    
+    return serverAddr;
+}
+
+void SocketUtils::connectToServer(SOCKET sock, const std::string& serverIP, int port) {
+    struct sockaddr_in serverAddr = serverAddress(serverIP, port);
     if (connect(sock, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
         throw std::runtime_error("Échec de connexion au serveur " + serverIP + ":" + std::to_string(port));
     }
 }
 
+bool SocketUtils::startConnect(SOCKET sock, const std::string& serverIP, int port) {
+    struct sockaddr_in serverAddr = serverAddress(serverIP, port);
+    setNonBlocking(sock);
+    if (connect(sock, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) != SOCKET_ERROR) {
+        return true;
+    }
+#ifdef _WIN32
+    if (WSAGetLastError() == WSAEWOULDBLOCK) {
+        return false;
+    }
+#else
+    if (errno == EINPROGRESS) {
+        return false;
+    }
+#endif
+    throw std::runtime_error("Échec de connexion au serveur " + serverIP + ":" + std::to_string(port));
+}
+
+int SocketUtils::connectError(SOCKET sock) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) != 0) {
+        return errno;
+    }
+    return error;
+}
+
 /* ========================================================================== */
 /*                      ENVOI / RÉCEPTION DE DONNÉES                          */
 /* ========================================================================== */
@@ -178,12 +312,23 @@ void SocketUtils::connectToServer(SOCKET sock, const std::string& serverIP, int
  * Gère l'envoi partiel en bouclant jusqu'à ce que toutes
  * les données soient envoyées. C'est nécessaire car send()
  * peut ne pas envoyer tous les octets en une seule fois.
+ * 
+ * Sur un socket non bloquant dont le tampon est plein, attend
+ * qu'il redevienne inscriptible (au plus SEND_TIMEOUT_MS).
  */
 void SocketUtils::sendData(SOCKET sock, const char* data, size_t size) {
     size_t totalSent = 0;
     while (totalSent < size) {
         ssize_t sent = send(sock, data + totalSent, size - totalSent, 0);
         if (sent == SOCKET_ERROR) {
+#ifndef _WIN32
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && canWrite(sock, SEND_TIMEOUT_MS)) {
+                continue;
+            }
+#endif
             throw std::runtime_error("Échec d'envoi de données");
         }
         totalSent += sent;
@@ -221,6 +366,54 @@ bool SocketUtils::hasData(SOCKET sock, int timeoutMs) {
     return result > 0 && FD_ISSET(sock, &readSet);
 }
 
+/*
+ * Vérifie si le socket peut accepter des données en émission.
+ * 
+ * Utilise poll() plutôt que select() : les serveurs gèrent des
+ * milliers de sockets et select() est limité à FD_SETSIZE.
+ */
+bool SocketUtils::canWrite(SOCKET sock, int timeoutMs) {
+#ifdef _WIN32
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(sock, &writeSet);
+    
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    
+    int result = select(sock + 1, nullptr, &writeSet, nullptr, &timeout);
+    return result > 0 && FD_ISSET(sock, &writeSet);
+#else
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    
+    int result = poll(&pfd, 1, timeoutMs);
+    return result > 0 && (pfd.revents & POLLOUT);
+#endif
+}
+
+/*
+ * Passe le socket en mode non bloquant.
+ * Les appels recv()/send()/accept() retournent alors immédiatement
+ * avec EAGAIN au lieu de bloquer le thread.
+ */
+void SocketUtils::setNonBlocking(SOCKET sock) {
+#ifdef _WIN32
+    u_long mode = 1;
+    if (ioctlsocket(sock, FIONBIO, &mode) != 0) {
+        throw std::runtime_error("Échec du passage en mode non bloquant");
+    }
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::runtime_error("Échec du passage en mode non bloquant");
+    }
+#endif
+}
+
 /* ========================================================================== */
 /*                PROTOCOLE AVEC PRÉFIXE DE LONGUEUR                          */
 /* ========================================================================== */
@@ -255,14 +448,158 @@ bool SocketUtils::receiveExact(SOCKET sock, char* buffer, size_t size) {
  * Ce protocole permet au récepteur de savoir exactement
  * combien d'octets il doit lire, résolvant ainsi le problème
  * de délimitation des messages sur un flux TCP.
+ * 
+ * La longueur et les données sont envoyées ensemble par une écriture
+ * groupée : un seul appel système et un seul segment TCP, même avec
+ * l'algorithme de Nagle actif.
  */
 void SocketUtils::sendWithLength(SOCKET sock, const char* data, size_t size) {
-    /* Envoi de la longueur (4 octets, big-endian) */
     uint32_t netLength = htonl(static_cast<uint32_t>(size));
-    sendData(sock, reinterpret_cast<const char*>(&netLength), sizeof(netLength));
     
-    /* Envoi des données */
-    sendData(sock, data, size);
+    const char* buffers[2] = { reinterpret_cast<const char*>(&netLength), data };
+    size_t sizes[2] = { sizeof(netLength), size };
+    sendGathered(sock, buffers, sizes, 2);
+}
+
+/*
+ * Envoie plusieurs tampons contigus sur le flux en un minimum d'appels.
+ * 
+ * Linux : sendmsg() avec un tableau d'iovec (équivalent de writev avec
+ * MSG_NOSIGNAL). En cas d'envoi partiel, les iovec déjà envoyés sont
+ * sautés et le premier restant est décalé.
+ * Windows : envois successifs.
+ */
+void SocketUtils::sendGathered(SOCKET sock, const char* const* buffers, const size_t* sizes, size_t count) {
+#ifdef _WIN32
+    for (size_t i = 0; i < count; ++i) {
+        sendData(sock, buffers[i], sizes[i]);
+    }
+#else
+    std::vector<struct iovec> iov(count);
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = const_cast<char*>(buffers[i]);
+        iov[i].iov_len = sizes[i];
+    }
+    
+    size_t first = 0;
+    while (first < count) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov.data() + first;
+        msg.msg_iovlen = count - first;
+        
+        ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && canWrite(sock, SEND_TIMEOUT_MS)) {
+                continue;
+            }
+            throw std::runtime_error("Échec d'envoi de données");
+        }
+        
+        size_t remaining = static_cast<size_t>(sent);
+        while (first < count && remaining >= iov[first].iov_len) {
+            remaining -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+            iov[first].iov_len -= remaining;
+        }
+    }
+#endif
+}
+
+/* ========================================================================== */
+/*                      TAMPON DE LECTURE DE TRAMES                           */
+/* ========================================================================== */
+
+FrameReader::FrameReader(size_t maxFrameSize, size_t chunkSize)
+    : m_start(0), m_end(0), m_maxFrameSize(maxFrameSize), m_chunkSize(chunkSize) {
+}
+
+/*
+ * Garantit au moins m_chunkSize octets libres en fin de tampon.
+ * Les octets déjà consommés sont d'abord récupérés en déplaçant
+ * le reste en tête (memmove), le tampon n'est agrandi qu'ensuite.
+ */
+void FrameReader::prepareSpace() {
+    if (m_start > 0) {
+        memmove(m_buffer.data(), m_buffer.data() + m_start, m_end - m_start);
+        m_end -= m_start;
+        m_start = 0;
+    }
+    if (m_buffer.size() - m_end < m_chunkSize) {
+        m_buffer.resize(m_end + m_chunkSize);
+    }
+}
+
+/*
+ * Lit ce qui est disponible en un seul recv(), directement dans le tampon.
+ */
+FrameReader::Status FrameReader::fill(SOCKET sock) {
+    prepareSpace();
+    
+    while (true) {
+        ssize_t received = recv(sock, m_buffer.data() + m_end, m_buffer.size() - m_end, 0);
+        if (received > 0) {
+            m_end += static_cast<size_t>(received);
+            return Status::Ok;
+        }
+        if (received == 0) {
+            return Status::Closed;
+        }
+#ifndef _WIN32
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return Status::WouldBlock;
+        }
+#endif
+        return Status::Error;
+    }
+}
+
+/*
+ * Copie en fin de tampon des octets reçus hors de fill().
+ */
+void FrameReader::append(const char* data, size_t size) {
+    prepareSpace();
+    if (m_buffer.size() - m_end < size) {
+        m_buffer.resize(m_end + size);
+    }
+    memcpy(m_buffer.data() + m_end, data, size);
+    m_end += size;
+}
+
+/*
+ * Découpe la trame complète suivante.
+ * Une trame incomplète reste dans le tampon jusqu'à la prochaine lecture.
+ */
+bool FrameReader::nextFrame(const char*& data, size_t& size) {
+    if (m_end - m_start < sizeof(uint32_t)) {
+        return false;
+    }
+    
+    uint32_t netLength;
+    memcpy(&netLength, m_buffer.data() + m_start, sizeof(netLength));
+    uint32_t dataLength = ntohl(netLength);
+    
+    if (dataLength > m_maxFrameSize) {
+        throw std::runtime_error("Message trop grand: " + std::to_string(dataLength) + " > " + std::to_string(m_maxFrameSize));
+    }
+    
+    if (m_end - m_start - sizeof(uint32_t) < dataLength) {
+        return false;
+    }
+    
+    data = m_buffer.data() + m_start + sizeof(uint32_t);
+    size = dataLength;
+    m_start += sizeof(uint32_t) + dataLength;
+    return true;
 }
 
 /*
@@ -22,7 +22,9 @@
     typedef int socklen_t;
 #else
     #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <arpa/inet.h>
     #include <unistd.h>
     #define SOCKET int
@@ -33,6 +35,20 @@
 
 #include <string>
 #include <stdexcept>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Options appliquées à un socket TCP à sa création (ou après accept).
+ *   - noDelay           : désactive l'algorithme de Nagle (TCP_NODELAY)
+ *   - sendBufferSize    : taille du tampon d'émission (SO_SNDBUF), 0 = défaut système
+ *   - receiveBufferSize : taille du tampon de réception (SO_RCVBUF), 0 = défaut système
+ */
+struct SocketOptions {
+    bool noDelay = true;
+    int sendBufferSize = 0;
+    int receiveBufferSize = 0;
+};
 
 /*
  * Classe SocketUtils
@@ -49,23 +65,52 @@ public:
     static void cleanupWinsock();
     
     /* Création d'un socket TCP (AF_INET, SOCK_STREAM) */
-    static SOCKET createTCPSocket();
+    static SOCKET createTCPSocket(const SocketOptions& options = SocketOptions());
+    
+    /* Application des options TCP (ex : socket retourné par accept) */
+    static void applySocketOptions(SOCKET sock, const SocketOptions& options);
     
     /* Fermeture d'un socket */
     static void closeSocket(SOCKET sock);
     
+    /*
+     * Partage du port entre plusieurs sockets d'écoute (SO_REUSEPORT,
+     * Linux) : le noyau répartit les connexions entrantes entre eux.
+     * À appeler avant bindSocket().
+     */
+    static void enableReusePort(SOCKET sock);
+    
     /* Association du socket à une adresse locale (bind) */
     static void bindSocket(SOCKET sock, int port);
     
     /* Passage en mode écoute (listen) */
-    static void listenSocket(SOCKET sock, int backlog = 5);
+    static void listenSocket(SOCKET sock, int backlog = SOMAXCONN);
+    
+    /* 
+     * Acceptation d'une connexion entrante (accept).
+     * Sur un socket d'écoute non bloquant, retourne INVALID_SOCKET
+     * si aucune connexion n'est en attente. Si nonBlocking est vrai,
+     * le socket retourné est déjà non bloquant (accept4 sous Linux).
+     */
+    static SOCKET acceptConnection(SOCKET serverSocket, std::string& clientIP, bool nonBlocking = false);
     
-    /* Acceptation d'une connexion entrante (accept) */
-    static SOCKET acceptConnection(SOCKET serverSocket, std::string& clientIP);
+    /* Adresse IP du pair d'un socket connecté (chaîne vide si inconnue) */
+    static std::string peerAddress(SOCKET sock);
     
     /* Connexion à un serveur distant (connect) */
     static void connectToServer(SOCKET sock, const std::string& serverIP, int port);
     
+    /*
+     * Connexion non bloquante : le socket passe en mode non bloquant et
+     * la connexion est lancée. Retourne true si elle est déjà établie,
+     * false si elle est en cours (attendre que le socket soit
+     * inscriptible, puis lire connectError) ; lève une exception sinon.
+     */
+    static bool startConnect(SOCKET sock, const std::string& serverIP, int port);
+    
+    /* Issue d'une connexion lancée par startConnect : 0 ou code d'erreur (SO_ERROR) */
+    static int connectError(SOCKET sock);
+    
     /* Envoi de données brutes (send avec gestion envoi partiel) */
     static void sendData(SOCKET sock, const char* data, size_t size);
     
@@ -75,16 +120,81 @@ public:
     /* Vérification de données disponibles avec select() */
     static bool hasData(SOCKET sock, int timeoutMs = 0);
     
+    /* Attente de place dans le tampon d'émission (socket non bloquant) */
+    static bool canWrite(SOCKET sock, int timeoutMs = 0);
+    
+    /* Passage du socket en mode non bloquant (O_NONBLOCK) */
+    static void setNonBlocking(SOCKET sock);
+    
     /* 
      * Protocole avec préfixe de longueur (Length-Prefixed Protocol)
      * Résout le problème de fragmentation TCP en préfixant chaque
      * message par sa longueur sur 4 octets (network byte order).
+     * 
+     * sendWithLength envoie longueur et données en un seul appel
+     * système (écriture groupée), donc en un seul segment TCP.
      */
     static void sendWithLength(SOCKET sock, const char* data, size_t size);
     static size_t receiveWithLength(SOCKET sock, char* buffer, size_t maxSize);
     
     /* Réception exacte de N octets (boucle sur recv) */
     static bool receiveExact(SOCKET sock, char* buffer, size_t size);
+    
+    /* Envoi groupé de plusieurs tampons (writev/sendmsg), gère l'envoi partiel */
+    static void sendGathered(SOCKET sock, const char* const* buffers, const size_t* sizes, size_t count);
+};
+
+/*
+ * Classe FrameReader
+ * 
+ * Tampon de lecture associé à une connexion : un seul recv() peut
+ * ramener plusieurs trames [longueur][données], qui sont ensuite
+ * découpées sans nouvel appel système.
+ * 
+ * Utilisation :
+ *   reader.fill(sock);
+ *   while (reader.nextFrame(data, size)) { ... }
+ * 
+ * Sur un socket non bloquant en edge-triggered, répéter jusqu'à
+ * WouldBlock en traitant les trames entre deux lectures : le tampon
+ * reste ainsi borné même si le client envoie en continu.
+ * 
+ * Les pointeurs retournés par nextFrame() restent valides jusqu'au
+ * prochain appel à fill() ou append().
+ */
+class FrameReader {
+public:
+    /* Résultat d'une lecture sur le socket */
+    enum class Status {
+        Ok,         /* Données lues                                 */
+        WouldBlock, /* Rien de disponible (socket non bloquant)     */
+        Closed,     /* Fermeture par le pair (recv() == 0)          */
+        Error       /* Erreur de réception                          */
+    };
+    
+    explicit FrameReader(size_t maxFrameSize, size_t chunkSize = 16 * 1024);
+    
+    /* Un seul appel à recv(), directement dans le tampon */
+    Status fill(SOCKET sock);
+    
+    /* Ajout d'octets déjà reçus par ailleurs (boucle io_uring) */
+    void append(const char* data, size_t size);
+    
+    /* Trame complète suivante ; false si incomplète. Lève une exception si trop grande */
+    bool nextFrame(const char*& data, size_t& size);
+    
+    /* Nombre d'octets reçus non encore consommés */
+    size_t pending() const { return m_end - m_start; }
+    
+private:
+    /* Déplace les octets non consommés en début de tampon et réserve de la place */
+    void prepareSpace();
+    
+    std::vector<char> m_buffer;     /* Tampon de réception                    */
+    size_t m_start;                 /* Début des octets non consommés         */
+    size_t m_end;                   /* Fin des octets reçus                   */
+    size_t m_maxFrameSize;          /* Taille max acceptée pour une trame     */
+    size_t m_chunkSize;             /* Place minimale libre avant un recv()   */
 };
 
 #endif /* SOCKET_UTILS_H */
@@ -0,0 +1,643 @@
+/*
+ * uring_event_loop.cpp
+ *
+ * Implémentation io_uring de la boucle d'événements.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "uring_event_loop.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/* Groupe de l'anneau de tampons de réception */
+constexpr uint16_t RECV_BUFFER_GROUP = 0;
+
+/* Taille de l'anneau de complétion : les requêtes multishot en produisent beaucoup */
+constexpr unsigned URING_CQ_DEPTH = 4 * URING_QUEUE_DEPTH;
+
+/* ========================================================================== */
+/*                          APPELS SYSTÈME                                    */
+/* ========================================================================== */
+
+static int uringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int uringRegister(int ringFd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ringFd, opcode, arg, count));
+}
+
+/* ========================================================================== */
+/*                      CONSTRUCTION / DESTRUCTION                            */
+/* ========================================================================== */
+
+/*
+ * Création de l'anneau, du plus au moins performant selon le noyau :
+ *   1. SINGLE_ISSUER + DEFER_TASKRUN (6.1) : les complétions ne sont
+ *      produites que pendant io_uring_enter(), dans le thread de la
+ *      boucle, sans interruption du thread en cours de traitement.
+ *      L'anneau est créé désactivé et activé par run() : le thread de
+ *      la boucle devient alors son unique soumetteur.
+ *   2. COOP_TASKRUN (5.19)
+ *   3. sans option
+ */
+UringEventLoop::UringEventLoop()
+    : m_ringFd(-1), m_enableRing(false),
+      m_sqRing(MAP_FAILED), m_sqRingSize(0), m_sqHead(nullptr), m_sqTail(nullptr),
+      m_sqMask(0), m_sqEntries(0), m_sqArray(nullptr), m_sqes(nullptr), m_sqesSize(0),
+      m_sqeTail(0), m_toSubmit(0),
+      m_cqRing(MAP_FAILED), m_cqRingSize(0), m_cqHead(nullptr), m_cqTail(nullptr),
+      m_cqMask(0), m_cqes(nullptr),
+      m_bufRing(nullptr), m_bufRingSize(0), m_buffers(nullptr), m_bufTail(0),
+      m_nextId(1) {
+    const unsigned setupFlags[] = {
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED,
+        IORING_SETUP_COOP_TASKRUN,
+        0
+    };
+
+    io_uring_params params;
+    int error = 0;
+    for (unsigned flags : setupFlags) {
+        memset(&params, 0, sizeof(params));
+        params.flags = flags | IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+        params.cq_entries = URING_CQ_DEPTH;
+        m_ringFd = uringSetup(URING_QUEUE_DEPTH, &params);
+        if (m_ringFd >= 0) {
+            m_enableRing = (flags & IORING_SETUP_R_DISABLED) != 0;
+            break;
+        }
+        error = errno;
+        if (error != EINVAL) {
+            break;
+        }
+    }
+    if (m_ringFd < 0) {
+        throw std::runtime_error("Échec de io_uring_setup: " + std::string(strerror(error)));
+    }
+
+    try {
+        /* Anneaux de soumission et de complétion (un seul mmap si le noyau le permet) */
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap && m_cqRingSize > m_sqRingSize) {
+            m_sqRingSize = m_cqRingSize;
+        }
+
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            throw std::runtime_error("Échec du mmap de l'anneau de soumission");
+        }
+        if (singleMmap) {
+            m_cqRing = m_sqRing;
+        } else {
+            m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+            if (m_cqRing == MAP_FAILED) {
+                throw std::runtime_error("Échec du mmap de l'anneau de complétion");
+            }
+        }
+
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            throw std::runtime_error("Échec du mmap des entrées de soumission");
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(m_sqRing);
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_sqeTail = *m_sqTail;
+
+        char* cq = static_cast<char*>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        /* Anneau de tampons de réception, enregistré auprès du noyau */
+        m_bufRingSize = RECV_BUFFER_COUNT * sizeof(io_uring_buf);
+        void* bufRing = mmap(nullptr, m_bufRingSize, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (bufRing == MAP_FAILED) {
+            throw std::runtime_error("Échec de l'allocation de l'anneau de tampons");
+        }
+        m_bufRing = static_cast<io_uring_buf_ring*>(bufRing);
+
+        void* buffers = mmap(nullptr, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffers == MAP_FAILED) {
+            throw std::runtime_error("Échec de l'allocation des tampons de réception");
+        }
+        m_buffers = static_cast<char*>(buffers);
+
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(m_bufRing);
+        reg.ring_entries = RECV_BUFFER_COUNT;
+        reg.bgid = RECV_BUFFER_GROUP;
+        if (uringRegister(m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            throw std::runtime_error("Échec de l'enregistrement des tampons: " + std::string(strerror(errno)));
+        }
+
+        for (unsigned i = 0; i < RECV_BUFFER_COUNT; ++i) {
+            recycleBuffer(static_cast<uint16_t>(i));
+        }
+    } catch (...) {
+        releaseRing();
+        throw;
+    }
+}
+
+UringEventLoop::~UringEventLoop() {
+    releaseRing();
+}
+
+/*
+ * Fermer l'anneau annule toutes les requêtes en cours ; les tampons
+ * ne sont libérés qu'ensuite.
+ */
+void UringEventLoop::releaseRing() {
+    if (m_ringFd >= 0) {
+        close(m_ringFd);
+        m_ringFd = -1;
+    }
+    if (m_sqes != nullptr) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = MAP_FAILED;
+    if (m_sqRing != MAP_FAILED) {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = MAP_FAILED;
+    }
+    if (m_buffers != nullptr) {
+        munmap(m_buffers, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE);
+        m_buffers = nullptr;
+    }
+    if (m_bufRing != nullptr) {
+        munmap(m_bufRing, m_bufRingSize);
+        m_bufRing = nullptr;
+    }
+}
+
+/* ========================================================================== */
+/*                            SOUMISSION                                      */
+/* ========================================================================== */
+
+/*
+ * Entrée libre de l'anneau de soumission, remise à zéro. Si l'anneau
+ * est plein, les entrées en attente sont d'abord soumises.
+ */
+io_uring_sqe* UringEventLoop::nextSqe() {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqeTail - head >= m_sqEntries) {
+        submit(0);
+        head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqeTail - head >= m_sqEntries) {
+            throw std::runtime_error("Anneau de soumission io_uring plein");
+        }
+    }
+
+    unsigned index = m_sqeTail & m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    ++m_sqeTail;
+    ++m_toSubmit;
+    return sqe;
+}
+
+/*
+ * Publie les entrées préparées et les soumet ; si waitFor > 0, attend
+ * dans le même appel au moins waitFor complétions.
+ */
+void UringEventLoop::submit(unsigned waitFor) {
+    if (m_toSubmit == 0 && waitFor == 0) {
+        return;
+    }
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+
+    int submitted = uringEnter(m_ringFd, m_toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (submitted < 0) {
+        /* EINTR : signal ; EAGAIN/EBUSY : complétions à consommer d'abord */
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+            return;
+        }
+        throw std::runtime_error("Échec de io_uring_enter: " + std::string(strerror(errno)));
+    }
+    unsigned count = static_cast<unsigned>(submitted);
+    m_toSubmit -= (count < m_toSubmit) ? count : m_toSubmit;
+}
+
+/*
+ * Accept multishot. Le noyau arme l'attente des connexions en mode
+ * exclusif : un socket partagé par plusieurs boucles ne réveille que
+ * l'une d'elles par connexion.
+ */
+void UringEventLoop::armAccept(uint64_t id, Registration& reg) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reg.fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = tag(id, OP_ACCEPT);
+    reg.acceptArmed = true;
+}
+
+/* Recv multishot : le noyau prend un tampon dans le groupe à chaque réception */
+void UringEventLoop::armRecv(uint64_t id, Registration& reg) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = reg.fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = tag(id, OP_RECV);
+    reg.recvArmed = true;
+}
+
+void UringEventLoop::armPoll(uint64_t id, Registration& reg) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = reg.fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = reg.events;
+    sqe->user_data = tag(id, OP_POLL);
+    reg.pollArmed = true;
+}
+
+/*
+ * Attente d'une connexion sans l'accepter (poll simple, non multishot).
+ * Le noyau réserve le descripteur avant de regarder la file : faute de
+ * descripteur, un accept réarmé échouerait aussitôt même sans client.
+ */
+void UringEventLoop::armListenWait(uint64_t id, Registration& reg) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = reg.fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag(id, OP_POLL);
+    reg.pollArmed = true;
+}
+
+void UringEventLoop::armWake() {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_wakeFd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag(0, OP_WAKE);
+}
+
+/* Annulation d'une requête en cours ; sa complétion (-ECANCELED) sera ignorée */
+void UringEventLoop::cancel(uint64_t userData) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = tag(0, OP_CANCEL);
+}
+
+/*
+ * Rend un tampon de réception au noyau. Les entrées sont indexées depuis
+ * le début de l'anneau : en C++, le membre bufs de io_uring_buf_ring est
+ * décalé par la macro de tableau flexible du noyau.
+ */
+void UringEventLoop::recycleBuffer(uint16_t bufferId) {
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(m_bufRing) + (m_bufTail & (RECV_BUFFER_COUNT - 1));
+    buf->addr = reinterpret_cast<uint64_t>(m_buffers + static_cast<size_t>(bufferId) * RECV_BUFFER_SIZE);
+    buf->len = RECV_BUFFER_SIZE;
+    buf->bid = bufferId;
+    ++m_bufTail;
+    __atomic_store_n(&m_bufRing->tail, m_bufTail, __ATOMIC_RELEASE);
+}
+
+/* ========================================================================== */
+/*                   ENREGISTREMENT DES DESCRIPTEURS                          */
+/* ========================================================================== */
+
+uint64_t UringEventLoop::addRegistration(SOCKET fd, std::unique_ptr<Registration> reg) {
+    uint64_t id = m_nextId++;
+    reg->fd = fd;
+    m_registrations[id] = std::move(reg);
+    m_ids[fd] = id;
+    return id;
+}
+
+void UringEventLoop::addListener(SOCKET fd, bool, AcceptHandler handler) {
+    auto reg = std::make_unique<Registration>();
+    reg->events = 0;
+    reg->onAccept = std::move(handler);
+    Registration& ref = *reg;
+    armAccept(addRegistration(fd, std::move(reg)), ref);
+}
+
+void UringEventLoop::addStream(SOCKET fd, Handler handler, DataHandler onData) {
+    auto reg = std::make_unique<Registration>();
+    reg->events = POLLOUT;
+    reg->handler = std::move(handler);
+    reg->onData = std::move(onData);
+    Registration& ref = *reg;
+    uint64_t id = addRegistration(fd, std::move(reg));
+    armRecv(id, ref);
+    armPoll(id, ref);
+}
+
+/* Masque epoll -> masque poll (EPOLLET et EPOLLEXCLUSIVE n'ont pas d'équivalent) */
+static uint32_t pollMask(uint32_t events) {
+    return events & ~(static_cast<uint32_t>(EPOLLET) | EPOLLEXCLUSIVE | EPOLLONESHOT);
+}
+
+void UringEventLoop::add(SOCKET fd, uint32_t events, Handler handler) {
+    auto reg = std::make_unique<Registration>();
+    reg->events = pollMask(events);
+    reg->handler = std::move(handler);
+    Registration& ref = *reg;
+    armPoll(addRegistration(fd, std::move(reg)), ref);
+}
+
+/* Mise à jour du masque du poll multishot en place (sans l'annuler) */
+void UringEventLoop::modify(SOCKET fd, uint32_t events) {
+    auto idIt = m_ids.find(fd);
+    if (idIt == m_ids.end()) {
+        throw std::runtime_error("Descripteur non enregistré: " + std::to_string(fd));
+    }
+    uint64_t id = idIt->second;
+    Registration& reg = *m_registrations[id];
+    reg.events = pollMask(events);
+
+    if (!reg.pollArmed) {
+        armPoll(id, reg);
+        return;
+    }
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = tag(id, OP_POLL);
+    sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = reg.events;
+    sqe->user_data = tag(0, OP_CANCEL);
+}
+
+/*
+ * Le recv multishot est annulé et n'est plus réarmé à sa fin. Une
+ * reprise avant la complétion de l'annulation ne réarme rien : la
+ * requête l'est à cette complétion (voir handleCompletion).
+ */
+void UringEventLoop::pauseInput(SOCKET fd) {
+    auto idIt = m_ids.find(fd);
+    if (idIt == m_ids.end()) {
+        return;
+    }
+    Registration& reg = *m_registrations[idIt->second];
+    if (!reg.recvPaused && reg.recvArmed) {
+        cancel(tag(idIt->second, OP_RECV));
+    }
+    reg.recvPaused = true;
+}
+
+void UringEventLoop::resumeInput(SOCKET fd) {
+    auto idIt = m_ids.find(fd);
+    if (idIt == m_ids.end()) {
+        return;
+    }
+    Registration& reg = *m_registrations[idIt->second];
+    reg.recvPaused = false;
+    if (!reg.recvArmed) {
+        armRecv(idIt->second, reg);
+    }
+}
+
+/*
+ * Les requêtes armées sont annulées ; le noyau garde une référence sur
+ * le socket jusqu'à leur fin, si bien que le descripteur peut être fermé
+ * immédiatement après.
+ */
+void UringEventLoop::remove(SOCKET fd) {
+    auto idIt = m_ids.find(fd);
+    if (idIt == m_ids.end()) {
+        return;
+    }
+    uint64_t id = idIt->second;
+    m_ids.erase(idIt);
+
+    auto it = m_registrations.find(id);
+    if (it == m_registrations.end()) {
+        return;
+    }
+    Registration& reg = *it->second;
+    if (reg.acceptArmed) {
+        cancel(tag(id, OP_ACCEPT));
+    }
+    if (reg.recvArmed) {
+        cancel(tag(id, OP_RECV));
+    }
+    if (reg.pollArmed) {
+        cancel(tag(id, OP_POLL));
+    }
+    m_registrations.erase(it);
+}
+
+/* ========================================================================== */
+/*                          BOUCLE PRINCIPALE                                 */
+/* ========================================================================== */
+
+/*
+ * Un io_uring_enter() par tour : soumission des requêtes préparées
+ * pendant le tour précédent et attente d'au moins une complétion.
+ */
+void UringEventLoop::run() {
+    if (m_enableRing) {
+        if (uringRegister(m_ringFd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0) {
+            throw std::runtime_error("Échec de l'activation de l'anneau: " + std::string(strerror(errno)));
+        }
+        m_enableRing = false;
+    }
+
+    m_running = true;
+    armWake();
+
+    while (m_running) {
+        submit(1);
+        processCompletions();
+        runPendingTasks();
+    }
+}
+
+/*
+ * Consomme toutes les complétions disponibles. La tête est avancée
+ * avant l'appel du gestionnaire, qui peut lui-même soumettre.
+ */
+void UringEventLoop::processCompletions() {
+    unsigned head = *m_cqHead;
+    while (true) {
+        unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            break;
+        }
+        const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+        uint64_t userData = cqe.user_data;
+        int32_t res = cqe.res;
+        uint32_t flags = cqe.flags;
+        ++head;
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+        handleCompletion(userData, res, flags);
+    }
+}
+
+/*
+ * Aiguillage d'une complétion. Les gestionnaires sont copiés avant
+ * l'appel (ils peuvent désenregistrer leur descripteur), et
+ * l'enregistrement est recherché à nouveau avant de réarmer une
+ * requête multishot terminée (complétion sans IORING_CQE_F_MORE).
+ * Une exception d'un gestionnaire ne concerne que son descripteur
+ * (voir setErrorHandler) : le tampon est rendu et le réarmement a lieu.
+ */
+void UringEventLoop::handleCompletion(uint64_t userData, int32_t res, uint32_t flags) {
+    Op op = static_cast<Op>(userData & 7);
+    uint64_t id = userData >> 3;
+    bool more = (flags & IORING_CQE_F_MORE) != 0;
+
+    if (op == OP_CANCEL) {
+        return;
+    }
+    if (op == OP_WAKE) {
+        drainWakeup();
+        if (!more) {
+            armWake();
+        }
+        return;
+    }
+
+    /* Un tampon pris par le noyau est toujours rendu, même pour une connexion fermée */
+    bool hasBuffer = (op == OP_RECV) && (flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t bufferId = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+
+    auto it = m_registrations.find(id);
+    if (it == m_registrations.end()) {
+        if (hasBuffer) {
+            recycleBuffer(bufferId);
+        }
+        return;
+    }
+    Registration& reg = *it->second;
+    SOCKET fd = reg.fd;
+
+    switch (op) {
+        case OP_ACCEPT: {
+            if (!more) {
+                reg.acceptArmed = false;
+            }
+            if (res == -ECANCELED) {
+                return;
+            }
+            if (res == -EMFILE || res == -ENFILE) {
+                /* Accept suspendu jusqu'à la prochaine connexion (voir armListenWait) */
+                reg.acceptPaused = true;
+                if (reg.acceptArmed) {
+                    cancel(tag(id, OP_ACCEPT));
+                }
+                if (!reg.pollArmed) {
+                    armListenWait(id, reg);
+                }
+            }
+            AcceptHandler handler = reg.onAccept;
+            dispatch(fd, [&handler, res]() {
+                if (res >= 0) {
+                    handler(res, SocketUtils::peerAddress(res));
+                } else {
+                    handler(INVALID_SOCKET, "Échec de accept: " + std::string(strerror(-res)));
+                }
+            });
+            if (res == -EMFILE || res == -ENFILE) {
+                shedConnection(fd);
+            }
+            break;
+        }
+
+        case OP_RECV: {
+            if (!more) {
+                reg.recvArmed = false;
+            }
+            if (res > 0) {
+                DataHandler onData = reg.onData;
+                const char* data = m_buffers + static_cast<size_t>(bufferId) * RECV_BUFFER_SIZE;
+                dispatch(fd, [&onData, data, res]() { onData(data, static_cast<size_t>(res)); });
+                recycleBuffer(bufferId);
+                break;
+            }
+            if (hasBuffer) {
+                recycleBuffer(bufferId);
+            }
+            if (res == -ENOBUFS || res == -ECANCELED) {
+                break;      /* Tampons tous pris, ou pauseInput() : réarmement sauf pause */
+            }
+            Handler handler = reg.handler;
+            dispatch(fd, [&handler, res]() { handler(res == 0 ? EPOLLRDHUP : EPOLLERR); });
+            return;
+        }
+
+        case OP_POLL: {
+            if (!more) {
+                reg.pollArmed = false;
+            }
+            if (res == -ECANCELED) {
+                return;
+            }
+            if (reg.onAccept) {
+                /* Socket d'écoute : une connexion attend, nouvel essai d'accept */
+                reg.acceptPaused = false;
+                if (!reg.acceptArmed) {
+                    armAccept(id, reg);
+                }
+                return;
+            }
+            Handler handler = reg.handler;
+            uint32_t mask = res < 0 ? static_cast<uint32_t>(EPOLLERR) : static_cast<uint32_t>(res);
+            dispatch(fd, [&handler, mask]() { handler(mask); });
+            break;
+        }
+
+        default:
+            return;
+    }
+
+    if (!more) {
+        auto again = m_registrations.find(id);
+        if (again == m_registrations.end()) {
+            return;
+        }
+        Registration& current = *again->second;
+        if (op == OP_ACCEPT && !current.acceptArmed && !current.acceptPaused) {
+            armAccept(id, current);
+        } else if (op == OP_RECV && !current.recvArmed && !current.recvPaused) {
+            armRecv(id, current);
+        } else if (op == OP_POLL && !current.pollArmed) {
+            armPoll(id, current);
+        }
+    }
+}
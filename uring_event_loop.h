@@ -0,0 +1,150 @@
+/*
+ * uring_event_loop.h
+ *
+ * Boucle d'événements io_uring (appels système bruts, sans liburing).
+ *
+ * Chaque boucle possède son anneau de soumission et de complétion,
+ * partagé avec le noyau par mmap(). Les requêtes sont « multishot » :
+ * armées une fois, elles produisent une complétion par événement.
+ *   - socket d'écoute : accept multishot, une complétion par connexion
+ *   - connexion       : recv multishot dans des tampons fournis au noyau
+ *                       (anneau de tampons enregistré, voir ci-dessous)
+ *                       et poll multishot sur POLLOUT
+ *   - eventfd         : poll multishot (réveil de la boucle)
+ *
+ * Les soumissions d'un tour de boucle et l'attente des complétions
+ * suivantes passent par un seul io_uring_enter().
+ *
+ * Tampons de réception : RECV_BUFFER_COUNT tampons de RECV_BUFFER_SIZE
+ * octets, enregistrés auprès du noyau (IORING_REGISTER_PBUF_RING). Le
+ * noyau choisit un tampon libre au moment où des données arrivent, si
+ * bien qu'une connexion inactive n'en immobilise aucun. Un tampon est
+ * rendu au noyau dès que le gestionnaire onData a copié son contenu.
+ *
+ * Les envois restent des sendmsg() non bloquants faits par le serveur
+ * (voir Connection) ; POLLOUT signale la place libérée.
+ *
+ * Nécessite Linux 6.0 ou plus récent (recv multishot).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef URING_EVENT_LOOP_H
+#define URING_EVENT_LOOP_H
+
+#include "event_loop.h"
+#include <linux/io_uring.h>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+constexpr unsigned URING_QUEUE_DEPTH = 1024;    /* Entrées de l'anneau de soumission */
+constexpr unsigned RECV_BUFFER_COUNT = 256;     /* Tampons de réception (puissance de 2) */
+constexpr size_t RECV_BUFFER_SIZE = 16 * 1024;  /* Taille d'un tampon de réception */
+
+/*
+ * Classe UringEventLoop
+ *
+ * Le constructeur lève std::runtime_error si io_uring est indisponible
+ * (noyau trop ancien, désactivé par sysctl ou par un filtre seccomp).
+ */
+class UringEventLoop : public EventLoop {
+public:
+    UringEventLoop();
+    ~UringEventLoop() override;
+
+    void addListener(SOCKET fd, bool exclusive, AcceptHandler handler) override;
+    void addStream(SOCKET fd, Handler handler, DataHandler onData) override;
+    void add(SOCKET fd, uint32_t events, Handler handler) override;
+    void modify(SOCKET fd, uint32_t events) override;
+    void remove(SOCKET fd) override;
+    void run() override;
+    bool receivesData() const override { return true; }
+    void pauseInput(SOCKET fd) override;
+    void resumeInput(SOCKET fd) override;
+    const char* backendName() const override { return "io_uring"; }
+
+private:
+    /* Nature d'une requête, codée dans les 3 bits de poids faible de user_data */
+    enum Op : uint64_t {
+        OP_WAKE = 0,
+        OP_ACCEPT = 1,
+        OP_RECV = 2,
+        OP_POLL = 3,
+        OP_CANCEL = 4
+    };
+
+    /*
+     * Descripteur enregistré. L'identifiant (croissant, jamais réutilisé)
+     * est placé dans user_data : une complétion tardive d'un descripteur
+     * désenregistré, dont le numéro a pu être réattribué, est ignorée.
+     */
+    struct Registration {
+        SOCKET fd;
+        uint32_t events;            /* Masque poll (add/modify)           */
+        Handler handler;
+        DataHandler onData;
+        AcceptHandler onAccept;
+        bool acceptArmed = false;
+        bool recvArmed = false;
+        bool pollArmed = false;
+        bool recvPaused = false;    /* pauseInput() : pas de réarmement   */
+        bool acceptPaused = false;  /* Plus de descripteur : attente poll */
+    };
+
+    static uint64_t tag(uint64_t id, Op op) { return (id << 3) | op; }
+
+    /* Soumission */
+    io_uring_sqe* nextSqe();
+    void submit(unsigned waitFor);
+    void armAccept(uint64_t id, Registration& reg);
+    void armRecv(uint64_t id, Registration& reg);
+    void armPoll(uint64_t id, Registration& reg);
+    void armListenWait(uint64_t id, Registration& reg);
+    void armWake();
+    void cancel(uint64_t userData);
+
+    /* Complétions */
+    void processCompletions();
+    void handleCompletion(uint64_t userData, int32_t res, uint32_t flags);
+    void recycleBuffer(uint16_t bufferId);
+
+    uint64_t addRegistration(SOCKET fd, std::unique_ptr<Registration> reg);
+    void releaseRing();
+
+    int m_ringFd;
+    bool m_enableRing;                  /* Anneau créé désactivé (SINGLE_ISSUER) */
+
+    /* Anneau de soumission */
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned m_sqMask;
+    unsigned m_sqEntries;
+    unsigned* m_sqArray;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+    unsigned m_sqeTail;                 /* Queue locale, publiée par submit()   */
+    unsigned m_toSubmit;
+
+    /* Anneau de complétion */
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    /* Tampons de réception fournis au noyau */
+    io_uring_buf_ring* m_bufRing;
+    size_t m_bufRingSize;
+    char* m_buffers;
+    uint16_t m_bufTail;
+
+    uint64_t m_nextId;
+    std::unordered_map<uint64_t, std::unique_ptr<Registration>> m_registrations;
+    std::unordered_map<int, uint64_t> m_ids;   /* fd -> identifiant courant */
+};
+
+#endif /* URING_EVENT_LOOP_H */
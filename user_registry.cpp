@@ -0,0 +1,167 @@
+/*
+ * user_registry.cpp
+ *
+ * Implémentation du registre shardé des utilisateurs connectés.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "user_registry.h"
+#include <mutex>
+
+/* ========================================================================== */
+/*                            CONSTRUCTION                                    */
+/* ========================================================================== */
+
+UserRegistry::UserRegistry(size_t shardCount)
+    : m_shardCount(shardCount == 0 ? 1 : shardCount),
+      m_byName(new Shard<std::string>[m_shardCount]),
+      m_bySocket(new Shard<SOCKET>[m_shardCount]),
+      m_connectionCount(0) {
+}
+
+/* ========================================================================== */
+/*                         SÉLECTION DES SHARDS                               */
+/* ========================================================================== */
+
+size_t UserRegistry::userShard(const std::string& username) const {
+    return std::hash<std::string>{}(username) % m_shardCount;
+}
+
+UserRegistry::Shard<std::string>& UserRegistry::nameShard(const std::string& username) const {
+    return m_byName[userShard(username)];
+}
+
+UserRegistry::Shard<SOCKET>& UserRegistry::socketShard(SOCKET sock) const {
+    return m_bySocket[static_cast<size_t>(sock) % m_shardCount];
+}
+
+/* ========================================================================== */
+/*                     CONNEXION / DÉCONNEXION                                */
+/* ========================================================================== */
+
+void UserRegistry::addConnection(const ConnectionPtr& conn) {
+    Shard<SOCKET>& shard = socketShard(conn->socket);
+    UniqueLock<UsersMutex> lock(shard.mutex);
+    shard.map[conn->socket] = conn;
+    m_connectionCount++;
+}
+
+/*
+ * Associe un nom à une connexion.
+ * Le nom est écrit dans la connexion sous le verrou du shard : tout
+ * thread qui la retrouve via findByName() voit donc le nom à jour.
+ */
+bool UserRegistry::registerUsername(const ConnectionPtr& conn, const std::string& username) {
+    Shard<std::string>& shard = nameShard(username);
+    UniqueLock<UsersMutex> lock(shard.mutex);
+    if (shard.map.count(username) != 0) {
+        return false;
+    }
+    conn->username = username;
+    shard.map[username] = conn;
+    return true;
+}
+
+/*
+ * Retire une connexion des deux index.
+ * L'entrée par nom n'est effacée que si elle désigne bien cette connexion.
+ */
+UserRegistry::ConnectionPtr UserRegistry::removeConnection(SOCKET sock) {
+    ConnectionPtr conn;
+    {
+        Shard<SOCKET>& shard = socketShard(sock);
+        UniqueLock<UsersMutex> lock(shard.mutex);
+        auto it = shard.map.find(sock);
+        if (it == shard.map.end()) {
+            return nullptr;
+        }
+        conn = it->second;
+        shard.map.erase(it);
+        m_connectionCount--;
+    }
+
+    if (!conn->username.empty()) {
+        Shard<std::string>& shard = nameShard(conn->username);
+        UniqueLock<UsersMutex> lock(shard.mutex);
+        auto it = shard.map.find(conn->username);
+        if (it != shard.map.end() && it->second == conn) {
+            shard.map.erase(it);
+        }
+    }
+
+    return conn;
+}
+
+/* ========================================================================== */
+/*                            RECHERCHES                                      */
+/* ========================================================================== */
+
+UserRegistry::ConnectionPtr UserRegistry::findByName(const std::string& username) const {
+    Shard<std::string>& shard = nameShard(username);
+    SharedLock<UsersMutex> lock(shard.mutex);
+    auto it = shard.map.find(username);
+    return it == shard.map.end() ? nullptr : it->second;
+}
+
+UserRegistry::ConnectionPtr UserRegistry::findBySocket(SOCKET sock) const {
+    Shard<SOCKET>& shard = socketShard(sock);
+    SharedLock<UsersMutex> lock(shard.mutex);
+    auto it = shard.map.find(sock);
+    return it == shard.map.end() ? nullptr : it->second;
+}
+
+bool UserRegistry::contains(const std::string& username) const {
+    Shard<std::string>& shard = nameShard(username);
+    SharedLock<UsersMutex> lock(shard.mutex);
+    return shard.map.count(username) != 0;
+}
+
+size_t UserRegistry::connectionCount() const {
+    return m_connectionCount.load();
+}
+
+/* ========================================================================== */
+/*                              PARCOURS                                      */
+/* ========================================================================== */
+
+/*
+ * Parcourt les utilisateurs identifiés, shard par shard.
+ * Les pointeurs sont copiés sous verrou partagé puis le visiteur est
+ * appelé hors verrou : un envoi lent ne bloque aucun login/logout.
+ */
+void UserRegistry::forEachUser(const Visitor& visitor) const {
+    forEachUser(visitor, 0, 1);
+}
+
+void UserRegistry::forEachUser(const Visitor& visitor, size_t part, size_t parts) const {
+    std::vector<ConnectionPtr> users;
+    for (size_t i = part; i < m_shardCount; i += parts) {
+        users.clear();
+        {
+            SharedLock<UsersMutex> lock(m_byName[i].mutex);
+            for (const auto& entry : m_byName[i].map) {
+                users.push_back(entry.second);
+            }
+        }
+        for (const auto& conn : users) {
+            visitor(conn);
+        }
+    }
+}
+
+void UserRegistry::forEachConnection(const Visitor& visitor) const {
+    std::vector<ConnectionPtr> connections;
+    for (size_t i = 0; i < m_shardCount; ++i) {
+        connections.clear();
+        {
+            SharedLock<UsersMutex> lock(m_bySocket[i].mutex);
+            for (const auto& entry : m_bySocket[i].map) {
+                connections.push_back(entry.second);
+            }
+        }
+        for (const auto& conn : connections) {
+            visitor(conn);
+        }
+    }
+}
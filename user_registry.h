@@ -0,0 +1,96 @@
+/*
+ * user_registry.h
+ *
+ * Registre des connexions et des utilisateurs connectés.
+ *
+ * Deux index sont maintenus :
+ *   - par socket : toutes les connexions, y compris avant la réception du nom
+ *   - par nom    : les utilisateurs identifiés (routage des messages)
+ *
+ * Chaque index est découpé en shards protégés par un std::shared_mutex :
+ * les recherches (routage) prennent un verrou partagé, et une connexion
+ * ou déconnexion ne bloque que le shard concerné.
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef USER_REGISTRY_H
+#define USER_REGISTRY_H
+
+#include "connection.h"
+#include "lock_profiler.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+
+constexpr size_t DEFAULT_REGISTRY_SHARDS = 64;   /* Nombre de shards par index */
+
+/*
+ * Classe UserRegistry
+ *
+ * Les callbacks de forEachUser() et forEachConnection() sont appelés
+ * hors verrou, sur une copie des pointeurs du shard : ils peuvent donc
+ * envoyer des données sans bloquer les autres threads.
+ */
+class UserRegistry {
+public:
+    using ConnectionPtr = std::shared_ptr<Connection>;
+    using Visitor = std::function<void(const ConnectionPtr&)>;
+
+    explicit UserRegistry(size_t shardCount = DEFAULT_REGISTRY_SHARDS);
+
+    /* Enregistrement d'une nouvelle connexion (nom encore inconnu) */
+    void addConnection(const ConnectionPtr& conn);
+
+    /* Association d'un nom à la connexion ; false si le nom est déjà pris */
+    bool registerUsername(const ConnectionPtr& conn, const std::string& username);
+
+    /* Retrait d'une connexion (et de son nom) ; nullptr si inconnue */
+    ConnectionPtr removeConnection(SOCKET sock);
+
+    /* Recherches en O(1) */
+    ConnectionPtr findByName(const std::string& username) const;
+    ConnectionPtr findBySocket(SOCKET sock) const;
+    bool contains(const std::string& username) const;
+
+    /* Parcours des utilisateurs identifiés / de toutes les connexions */
+    void forEachUser(const Visitor& visitor) const;
+    void forEachConnection(const Visitor& visitor) const;
+
+    /*
+     * Parcours des utilisateurs des shards d'indice i tels que
+     * i % parts == part : parts appels (part = 0..parts-1) couvrent
+     * chacun une partie disjointe des utilisateurs.
+     */
+    void forEachUser(const Visitor& visitor, size_t part, size_t parts) const;
+
+    /* Shard d'un nom (dans [0, shardCount()[) */
+    size_t userShard(const std::string& username) const;
+    size_t shardCount() const { return m_shardCount; }
+
+    /* Nombre de connexions ouvertes (identifiées ou non) */
+    size_t connectionCount() const;
+
+private:
+    using UsersMutex = ProfiledSharedMutex<LockClass::Users>;
+
+    /* Shard aligné sur une ligne de cache pour éviter le faux partage */
+    template <typename Key>
+    struct alignas(64) Shard {
+        mutable UsersMutex mutex;
+        std::unordered_map<Key, ConnectionPtr> map;
+    };
+
+    Shard<std::string>& nameShard(const std::string& username) const;
+    Shard<SOCKET>& socketShard(SOCKET sock) const;
+
+    size_t m_shardCount;
+    std::unique_ptr<Shard<std::string>[]> m_byName;
+    std::unique_ptr<Shard<SOCKET>[]> m_bySocket;
+    std::atomic<size_t> m_connectionCount;
+};
+
+#endif /* USER_REGISTRY_H */
@@ -0,0 +1,153 @@
+/*
+ * worker_pool.cpp
+ *
+ * Implémentation du pool d'exécution des commandes (voir worker_pool.h).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#include "worker_pool.h"
+#include "server_stats.h"
+#include <utility>
+
+namespace {
+
+/* Index du worker appelant dans son pool, SIZE_MAX hors d'un worker */
+thread_local const WorkerPool* t_pool = nullptr;
+thread_local size_t t_workerIndex = SIZE_MAX;
+
+} /* namespace */
+
+/* ========================================================================== */
+/*                       DÉMARRAGE / ARRÊT                                    */
+/* ========================================================================== */
+
+WorkerPool::WorkerPool()
+    : m_nextQueue(0), m_pending(0), m_sleepers(0), m_stopping(false) {
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::start(size_t workers) {
+    m_queues.reset(new WorkerQueue[workers == 0 ? 1 : workers]);
+    for (size_t i = 0; i < workers; ++i) {
+        m_workers.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+}
+
+/*
+ * Le mutex de sommeil est pris pour qu'un worker entre le test de son
+ * prédicat et sa mise en attente ne manque pas la notification.
+ */
+void WorkerPool::stop() {
+    m_stopping = true;
+    {
+        LockGuard<PoolMutex> lock(m_sleepMutex);
+        m_sleepCond.notify_all();
+    }
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+/* ========================================================================== */
+/*                          DÉPÔT DES TRAVAUX                                 */
+/* ========================================================================== */
+
+/*
+ * Un worker dépose dans sa propre file (il la videra lui-même si
+ * personne ne vient la voler) ; les autres threads répartissent leurs
+ * dépôts à tour de rôle. Un worker endormi n'est réveillé que s'il y en
+ * a un : tant que tous travaillent, un dépôt ne prend que le verrou de
+ * la file visée. m_pending est compté avant le dépôt pour ne jamais
+ * passer sous zéro si un worker prend le travail aussitôt.
+ */
+void WorkerPool::submit(Job job) {
+    size_t index = (t_pool == this) ? t_workerIndex
+                                    : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+    m_pending.fetch_add(1);
+    {
+        WorkerQueue& queue = m_queues[index];
+        LockGuard<PoolMutex> lock(queue.mutex);
+        queue.jobs.push_back(Entry{std::move(job), statsClockNanos()});
+    }
+
+    if (m_sleepers.load() > 0) {
+        LockGuard<PoolMutex> lock(m_sleepMutex);
+        m_sleepCond.notify_one();
+    }
+}
+
+/* Plus ancien travail de la file du worker */
+bool WorkerPool::takeLocal(size_t index, Entry& entry) {
+    WorkerQueue& queue = m_queues[index];
+    LockGuard<PoolMutex> lock(queue.mutex);
+    if (queue.jobs.empty()) {
+        return false;
+    }
+    entry = std::move(queue.jobs.front());
+    queue.jobs.pop_front();
+    return true;
+}
+
+/*
+ * Vol du plus récent travail d'une autre file, en partant de la
+ * voisine : le propriétaire et le voleur travaillent aux deux bouts de
+ * la file, et deux voleurs ne commencent pas par la même victime.
+ */
+bool WorkerPool::steal(size_t thief, Entry& entry) {
+    size_t count = m_workers.size();
+    for (size_t offset = 1; offset < count; ++offset) {
+        WorkerQueue& queue = m_queues[(thief + offset) % count];
+        LockGuard<PoolMutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            entry = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ========================================================================== */
+/*                              WORKERS                                       */
+/* ========================================================================== */
+
+/*
+ * Boucle d'un worker : sa file, puis celles des autres, puis sommeil
+ * jusqu'au prochain dépôt. Le compteur m_pending est publié par le
+ * dépôt avant le test de m_sleepers, et m_sleepers par le worker avant
+ * le test de m_pending : l'un des deux voit toujours l'autre.
+ */
+void WorkerPool::workerLoop(size_t index) {
+    t_pool = this;
+    t_workerIndex = index;
+    Entry entry;
+
+    while (!m_stopping) {
+        bool stolen = false;
+        if (!takeLocal(index, entry)) {
+            stolen = steal(index, entry);
+            if (!stolen) {
+                UniqueLock<PoolMutex> lock(m_sleepMutex);
+                m_sleepers.fetch_add(1);
+                m_sleepCond.wait(lock, [this] { return m_pending.load() > 0 || m_stopping.load(); });
+                m_sleepers.fetch_sub(1);
+                continue;
+            }
+        }
+
+        m_pending.fetch_sub(1);
+        serverStats().record(StatTimer::PoolWait, statsClockNanos() - entry.submittedAt);
+        serverStats().add(StatCounter::PoolJobs);
+        if (stolen) {
+            serverStats().add(StatCounter::PoolSteals);
+        }
+
+        entry.job();
+        entry.job = nullptr;
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ * worker_pool.h
+ *
+ * Pool de threads d'exécution des commandes coûteuses (LIST_USERS,
+ * GET_HISTORY, GET_LOG, STATS), distinct des boucles d'événements : une
+ * commande lente ne bloque plus les autres connexions de sa boucle.
+ *
+ * Vol de travail : chaque worker a sa propre file. Un dépôt depuis un
+ * autre thread (boucle) va dans les files à tour de rôle, un dépôt
+ * depuis un worker dans sa propre file ; un worker prend le plus ancien
+ * travail de sa file et, si elle est vide, vole le plus récent d'une
+ * autre avant de s'endormir. Les files ne partagent aucun verrou et un
+ * worker inoccupé n'attend pas qu'un voisin chargé ait fini.
+ *
+ * Une session confie un calcul au pool par co_await pool.offload(...) :
+ * elle est suspendue jusqu'à la fin du calcul puis reprise dans le
+ * thread de sa boucle. Une session n'ayant qu'un calcul en cours à la
+ * fois, les réponses d'une connexion restent dans l'ordre des commandes.
+ *
+ * Le délai entre le dépôt et le début d'un travail est mesuré
+ * (pool_wait dans STATS, voir server_stats.h).
+ *
+ * Projet R3.05 - Programmation Système
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "lock_profiler.h"
+#include <functional>
+#include <coroutine>
+#include <exception>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+template <typename Fn, typename Resume>
+class OffloadAwaiter;
+
+/*
+ * Classe WorkerPool
+ *
+ * submit() est appelable depuis n'importe quel thread. Sans worker
+ * (start(0)), offload() exécute le calcul dans le thread appelant.
+ */
+class WorkerPool {
+public:
+    using Job = std::function<void()>;
+
+    WorkerPool();
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /* Démarrage des workers (0 : calculs exécutés par l'appelant) */
+    void start(size_t workers);
+
+    /* Arrêt : les travaux en cours se terminent, ceux en attente sont abandonnés */
+    void stop();
+
+    /* Dépôt d'un travail */
+    void submit(Job job);
+
+    size_t workerCount() const { return m_workers.size(); }
+
+    /* Travaux déposés et pas encore commencés */
+    size_t pending() const { return m_pending.load(std::memory_order_relaxed); }
+
+    /*
+     * co_await pool.offload(fn, resume) : fn() s'exécute dans un worker,
+     * puis resume(session) doit reprendre la coroutine dans son thread
+     * (typiquement via EventLoop::post). Une exception levée par fn()
+     * est relancée dans la coroutine.
+     */
+    template <typename Fn, typename Resume>
+    OffloadAwaiter<Fn, Resume> offload(Fn fn, Resume resume) {
+        return OffloadAwaiter<Fn, Resume>(*this, std::move(fn), std::move(resume));
+    }
+
+private:
+    using PoolMutex = ProfiledMutex<LockClass::Pool>;
+
+    struct Entry {
+        Job job;
+        uint64_t submittedAt;           /* statsClockNanos() au dépôt          */
+    };
+
+    /* File d'un worker, alignée sur une ligne de cache */
+    struct alignas(64) WorkerQueue {
+        PoolMutex mutex;
+        std::deque<Entry> jobs;
+    };
+
+    void workerLoop(size_t index);
+    bool takeLocal(size_t index, Entry& entry);
+    bool steal(size_t thief, Entry& entry);
+
+    std::unique_ptr<WorkerQueue[]> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_nextQueue;    /* Répartition des dépôts externes     */
+    std::atomic<size_t> m_pending;      /* Travaux déposés non commencés       */
+    std::atomic<size_t> m_sleepers;     /* Workers endormis                    */
+    std::atomic<bool> m_stopping;
+
+    PoolMutex m_sleepMutex;             /* Sommeil des workers uniquement      */
+    LockCondition m_sleepCond;
+};
+
+/*
+ * Attente d'un calcul confié au pool (voir WorkerPool::offload).
+ *
+ * L'awaiter vit dans le cadre de la coroutine suspendue : le travail
+ * l'utilise jusqu'à la fin du calcul, puis ne touche plus qu'à sa
+ * propre copie de resume (la coroutine peut reprendre, et l'awaiter
+ * disparaître, dès que resume() l'a confiée à sa boucle).
+ */
+template <typename Fn, typename Resume>
+class OffloadAwaiter {
+public:
+    OffloadAwaiter(WorkerPool& pool, Fn fn, Resume resume)
+        : m_pool(pool), m_fn(std::move(fn)), m_resume(std::move(resume)) {}
+
+    bool await_ready() {
+        if (m_pool.workerCount() == 0) {
+            run();
+            return true;
+        }
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> session) {
+        m_pool.submit([this, session, resume = m_resume]() {
+            run();
+            resume(session);
+        });
+    }
+
+    void await_resume() const {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    void run() {
+        try {
+            m_fn();
+        } catch (...) {
+            m_error = std::current_exception();
+        }
+    }
+
+    WorkerPool& m_pool;
+    Fn m_fn;
+    Resume m_resume;
+    std::exception_ptr m_error;
+};
+
+#endif /* WORKER_POOL_H */